@@ -0,0 +1,585 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "file_reader.h"
+
+/* io_uring can be compiled out with -DNO_IO_URING */
+#if defined(__linux__) && !defined(NO_IO_URING)
+#define USE_IO_URING
+#endif
+
+#ifdef USE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/*
+ * The number of files kept in flight at once.
+ */
+#define READER_QUEUE_DEPTH 64
+
+/*
+ * Bounds on the number of blocking reader threads used without io_uring.
+ */
+#define READER_MIN_THREADS 4
+#define READER_MAX_THREADS 16
+
+/*
+ * Reads a whole file with blocking calls. Returns NULL if there was an error.
+ * Otherwise, the caller is responsible for freeing the allocated memory.
+ */
+static char *read_file_blocking(char *file_path, size_t *size) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Problem opening file.\n");
+        return NULL;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        fprintf(stderr, "Error: Could not get stat for file.\n");
+        close(fd);
+        return NULL;
+    }
+    size_t capacity = file_stat.st_size > 0 ? (size_t) file_stat.st_size : 0;
+    char *data = malloc(capacity + sizeof(char));
+    size_t offset = 0;
+    while (offset < capacity) {
+        ssize_t result = read(fd, data + offset, capacity - offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            /* the file shrank (or failed) while we were reading it, we keep what we have */
+            break;
+        }
+        offset += (size_t) result;
+    }
+    close(fd);
+    data[offset] = '\0';
+    *size = offset;
+    return data;
+}
+
+/*
+ * A file that finished reading on a pool thread, waiting for the callback.
+ */
+typedef struct read_result {
+    char *file_path;
+    char *data;
+    size_t size;
+} read_result_t;
+
+/*
+ * The state shared by the blocking reader threads and the calling thread.
+ */
+typedef struct reader_pool {
+    char **file_paths;
+    int count;
+    int next;
+    int finished_threads;
+    read_result_t queue[READER_QUEUE_DEPTH];
+    int queue_head;
+    int queue_size;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} reader_pool_t;
+
+static void *reader_thread(void *argument) {
+    reader_pool_t *pool = argument;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next < pool->count ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (index < 0) {
+            break;
+        }
+        read_result_t result;
+        result.file_path = pool->file_paths[index];
+        result.data = read_file_blocking(result.file_path, &result.size);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queue_size == READER_QUEUE_DEPTH) {
+            pthread_cond_wait(&pool->not_full, &pool->lock);
+        }
+        pool->queue[(pool->queue_head + pool->queue_size) % READER_QUEUE_DEPTH] = result;
+        pool->queue_size++;
+        pthread_cond_signal(&pool->not_empty);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->finished_threads++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * Reads the files with a pool of threads doing blocking reads, and runs the
+ * callback on the calling thread as they finish.
+ */
+static int read_files_with_threads(char **file_paths, int count, file_callback_t *callback, void *argument) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = processors > 0 ? (int) processors * 2 : READER_MIN_THREADS;
+    if (thread_count < READER_MIN_THREADS) thread_count = READER_MIN_THREADS;
+    if (thread_count > READER_MAX_THREADS) thread_count = READER_MAX_THREADS;
+    if (thread_count > count) thread_count = count;
+
+    reader_pool_t pool;
+    pool.file_paths = file_paths;
+    pool.count = count;
+    pool.next = 0;
+    pool.finished_threads = 0;
+    pool.queue_head = 0;
+    pool.queue_size = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.not_empty, NULL);
+    pthread_cond_init(&pool.not_full, NULL);
+
+    pthread_t threads[READER_MAX_THREADS];
+    int started = 0;
+    while (started < thread_count && pthread_create(&threads[started], NULL, &reader_thread, &pool) == 0) {
+        started++;
+    }
+    int success_count = 0;
+    int i;
+    if (started == 0) {
+        /* we couldn't start any threads, so we do the work ourselves */
+        for (i = 0; i < count; i++) {
+            size_t size;
+            char *data = read_file_blocking(file_paths[i], &size);
+            if (data != NULL) {
+                callback(file_paths[i], data, size, argument);
+                free(data);
+                success_count++;
+            }
+        }
+    }
+
+    while (started > 0) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.queue_size == 0 && pool.finished_threads < started) {
+            pthread_cond_wait(&pool.not_empty, &pool.lock);
+        }
+        if (pool.queue_size == 0) {
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+        read_result_t result = pool.queue[pool.queue_head];
+        pool.queue_head = (pool.queue_head + 1) % READER_QUEUE_DEPTH;
+        pool.queue_size--;
+        pthread_cond_signal(&pool.not_full);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (result.data != NULL) {
+            callback(result.file_path, result.data, result.size, argument);
+            free(result.data);
+            success_count++;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.not_empty);
+    pthread_cond_destroy(&pool.not_full);
+    return success_count;
+}
+
+#ifdef USE_IO_URING
+
+/*
+ * The stages a file goes through in the ring.
+ */
+typedef enum slot_stage {
+    STAGE_FREE,
+    STAGE_OPENING,
+    STAGE_READING
+} slot_stage_t;
+
+/*
+ * A file in flight in the ring.
+ */
+typedef struct reader_slot {
+    slot_stage_t stage;
+    char *file_path;
+    int fd;
+    char *data;
+    size_t size;
+    size_t offset;
+} reader_slot_t;
+
+/*
+ * An io_uring instance, set up with raw system calls.
+ */
+typedef struct uring {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* the entries queued but not yet submitted, and the ones the kernel has
+     * taken but not completed */
+    unsigned pending;
+    unsigned in_flight;
+} uring_t;
+
+/*
+ * Checks that the kernel supports every operation we need.
+ */
+static bool probe_uring(int fd) {
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0
+            && probe->ops_len > IORING_OP_OPENAT && probe->ops_len > IORING_OP_READ
+            && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+            && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+static void destroy_uring(uring_t *ring) {
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL) munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+/*
+ * Sets up a ring. Returns false if io_uring is unavailable.
+ */
+static bool create_uring(uring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(uring_t));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    if (!probe_uring(ring->fd)) {
+        close(ring->fd);
+        return false;
+    }
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        destroy_uring(ring);
+        return false;
+    }
+    if (single_mmap) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            destroy_uring(ring);
+            return false;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        destroy_uring(ring);
+        return false;
+    }
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return true;
+}
+
+/*
+ * Gets the next free submission queue entry. There is never more than one
+ * entry per slot in flight, so the queue can't overflow.
+ */
+static struct io_uring_sqe *get_sqe(uring_t *ring) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+    return sqe;
+}
+
+static void submit_open(uring_t *ring, reader_slot_t *slot, int slot_index) {
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long) slot->file_path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = (unsigned long) slot_index;
+    slot->stage = STAGE_OPENING;
+}
+
+static void submit_read(uring_t *ring, reader_slot_t *slot, int slot_index) {
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (unsigned long) (slot->data + slot->offset);
+    sqe->len = (unsigned) (slot->size - slot->offset);
+    sqe->off = slot->offset;
+    sqe->user_data = (unsigned long) slot_index;
+    slot->stage = STAGE_READING;
+}
+
+/*
+ * Hands a finished file to the callback and frees its slot.
+ */
+static void finish_slot(reader_slot_t *slot, file_callback_t *callback, void *argument) {
+    close(slot->fd);
+    slot->data[slot->offset] = '\0';
+    callback(slot->file_path, slot->data, slot->offset, argument);
+    free(slot->data);
+    slot->data = NULL;
+    slot->stage = STAGE_FREE;
+}
+
+/*
+ * Handles the completion of an open or a read. Returns true if the file
+ * was read successfully.
+ */
+static bool handle_completion(uring_t *ring, reader_slot_t *slots, int slot_index, int result,
+        file_callback_t *callback, void *argument) {
+    reader_slot_t *slot = &slots[slot_index];
+    if (slot->stage == STAGE_OPENING) {
+        if (result < 0) {
+            fprintf(stderr, "Error: Problem opening file.\n");
+            slot->stage = STAGE_FREE;
+            return false;
+        }
+        slot->fd = result;
+        struct stat file_stat;
+        if (fstat(slot->fd, &file_stat) != 0) {
+            fprintf(stderr, "Error: Could not get stat for file.\n");
+            close(slot->fd);
+            slot->stage = STAGE_FREE;
+            return false;
+        }
+        slot->size = file_stat.st_size > 0 ? (size_t) file_stat.st_size : 0;
+        slot->offset = 0;
+        slot->data = malloc(slot->size + sizeof(char));
+        if (slot->size == 0) {
+            finish_slot(slot, callback, argument);
+            return true;
+        }
+        submit_read(ring, slot, slot_index);
+        return false;
+    }
+    if (result == -EINTR || result == -EAGAIN) {
+        submit_read(ring, slot, slot_index);
+        return false;
+    }
+    if (result > 0) {
+        slot->offset += (size_t) result;
+        if (slot->offset < slot->size) {
+            /* a short read, so we ask for the rest */
+            submit_read(ring, slot, slot_index);
+            return false;
+        }
+    }
+    /* we're at the end of the file (or it failed), so we keep what we have */
+    finish_slot(slot, callback, argument);
+    return true;
+}
+
+/*
+ * Gives up on the file of a slot, adding its path to the given array of
+ * paths that are still to be read.
+ */
+static void abandon_slot(reader_slot_t *slot, char **unread, int *unread_count) {
+    if (slot->stage == STAGE_READING) {
+        close(slot->fd);
+    }
+    free(slot->data);
+    slot->data = NULL;
+    unread[(*unread_count)++] = slot->file_path;
+    slot->stage = STAGE_FREE;
+}
+
+/*
+ * Stops reading files through a ring after io_uring_enter failed. The
+ * entries that were never submitted are taken back off the queue, and the
+ * ones the kernel has are waited for, since they still write into the
+ * slots' buffers. A read that completes a file still hands it to the
+ * callback; every other file that was started is added to the given array
+ * of paths to read some other way. Returns the number of files that were
+ * read, or -1 if the kernel's entries couldn't be waited for, in which case
+ * their buffers are left allocated rather than freed under the kernel.
+ */
+static int stop_uring(uring_t *ring, reader_slot_t *slots, char **unread, int *unread_count,
+        file_callback_t *callback, void *argument) {
+    unsigned tail = *ring->sq_tail;
+    unsigned i;
+    for (i = 1; i <= ring->pending; i++) {
+        struct io_uring_sqe *sqe = &ring->sqes[(tail - i) & *ring->sq_mask];
+        abandon_slot(&slots[sqe->user_data], unread, unread_count);
+    }
+    __atomic_store_n(ring->sq_tail, tail - ring->pending, __ATOMIC_RELEASE);
+    ring->pending = 0;
+    int success_count = 0;
+    while (ring->in_flight > 0) {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int j;
+            for (j = 0; j < READER_QUEUE_DEPTH; j++) {
+                if (slots[j].stage != STAGE_FREE) {
+                    slots[j].data = NULL;
+                    abandon_slot(&slots[j], unread, unread_count);
+                }
+            }
+            return -1;
+        }
+        unsigned head = *ring->cq_head;
+        unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            reader_slot_t *slot = &slots[cqe->user_data];
+            int result = cqe->res;
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            ring->in_flight--;
+            if (slot->stage == STAGE_OPENING && result >= 0) {
+                close(result);
+            }
+            if (slot->stage == STAGE_READING && result > 0 && slot->offset + (size_t) result == slot->size) {
+                slot->offset = slot->size;
+                finish_slot(slot, callback, argument);
+                success_count++;
+            } else {
+                abandon_slot(slot, unread, unread_count);
+            }
+        }
+    }
+    return success_count;
+}
+
+/*
+ * Reads the files through io_uring, keeping up to READER_QUEUE_DEPTH files
+ * open and being read at once. If the ring fails partway, the files it
+ * didn't read are read with threads instead. Returns -1 if io_uring is
+ * unavailable.
+ */
+static int read_files_with_uring(char **file_paths, int count, file_callback_t *callback, void *argument) {
+    uring_t ring;
+    if (!create_uring(&ring, READER_QUEUE_DEPTH)) {
+        return -1;
+    }
+    reader_slot_t slots[READER_QUEUE_DEPTH];
+    int i;
+    for (i = 0; i < READER_QUEUE_DEPTH; i++) {
+        slots[i].stage = STAGE_FREE;
+        slots[i].data = NULL;
+    }
+    int next = 0;
+    int active = 0;
+    int success_count = 0;
+    char **unread = NULL;
+    int unread_count = 0;
+    while (next < count || active > 0) {
+        /* we fill every free slot with a new file */
+        for (i = 0; i < READER_QUEUE_DEPTH && next < count; i++) {
+            if (slots[i].stage == STAGE_FREE) {
+                slots[i].file_path = file_paths[next++];
+                submit_open(&ring, &slots[i], i);
+                active++;
+            }
+        }
+        /* next, we submit everything and wait for at least one completion */
+        int entered = (int) syscall(__NR_io_uring_enter, ring.fd, ring.pending, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (entered < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Warning: io_uring_enter failed: %s, reading the remaining files with threads.\n",
+                    strerror(errno));
+            unread = malloc((READER_QUEUE_DEPTH + count - next) * sizeof(char *));
+            int stopped_count = stop_uring(&ring, slots, unread, &unread_count, callback, argument);
+            success_count += stopped_count > 0 ? stopped_count : 0;
+            while (next < count) {
+                unread[unread_count++] = file_paths[next++];
+            }
+            break;
+        }
+        ring.pending -= (unsigned) entered;
+        ring.in_flight += (unsigned) entered;
+        /* then we handle every completion that's ready */
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            int slot_index = (int) cqe->user_data;
+            int result = cqe->res;
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+            ring.in_flight--;
+            if (handle_completion(&ring, slots, slot_index, result, callback, argument)) {
+                success_count++;
+            }
+            if (slots[slot_index].stage == STAGE_FREE) {
+                active--;
+            }
+        }
+    }
+    for (i = 0; i < READER_QUEUE_DEPTH; i++) {
+        free(slots[i].data);
+    }
+    destroy_uring(&ring);
+    if (unread != NULL) {
+        success_count += read_files_with_threads(unread, unread_count, callback, argument);
+        free(unread);
+    }
+    return success_count;
+}
+
+#endif
+
+/*
+ * Reads every file in the given array of paths, with io_uring if we can.
+ */
+int read_files(char **file_paths, int count, file_callback_t *callback, void *argument) {
+    if (count == 0) {
+        return 0;
+    }
+#ifdef USE_IO_URING
+    int success_count = read_files_with_uring(file_paths, count, callback, argument);
+    if (success_count >= 0) {
+        return success_count;
+    }
+#endif
+    return read_files_with_threads(file_paths, count, callback, argument);
+}
@@ -0,0 +1,25 @@
+#ifndef _FILE_READER_H_
+#define _FILE_READER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Called with the contents of every file that was read, given the file
+ * path, its contents (null terminated), its size, and the argument passed
+ * to read_files. The contents belong to the reader and are freed once the
+ * callback returns. Implemented by the caller.
+ */
+typedef void file_callback_t(char *, char *, size_t, void *);
+
+/*
+ * Reads every file in the given array of paths, keeping many opens and reads
+ * in flight at once, given the paths, their count, the callback, and its
+ * argument. On Linux this uses io_uring; when io_uring is unavailable, a pool
+ * of threads doing blocking reads is used instead. The callback is always run
+ * on the calling thread, in whatever order the files finish reading. Returns
+ * the number of files that were read successfully.
+ */
+int read_files(char **, int, file_callback_t *, void *);
+
+#endif
@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "file_walker.h"
+
+#if defined(__linux__)
+#include <stdint.h>
+#include <sys/syscall.h>
+#define USE_GETDENTS
+#endif
+
+/*
+ * Size of the buffer directory entries are read into, per open directory.
+ */
+#define WALKER_BUFFER_SIZE (32 * 1024)
+
+/*
+ * The state of a walk: the path of the directory being walked, which is
+ * extended and truncated in place as we go down and back up, and the list
+ * the files are added to.
+ */
+typedef struct walker {
+    char *path;
+    size_t path_capacity;
+    file_list_t *files;
+} walker_t;
+
+#ifdef USE_GETDENTS
+/*
+ * A directory entry, as returned by the getdents64 system call.
+ */
+typedef struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linux_dirent64_t;
+#endif
+
+/*
+ * Makes sure the path buffer can hold the given number of bytes.
+ */
+static void reserve_path(walker_t *walker, size_t size) {
+    if (size > walker->path_capacity) {
+        while (size > walker->path_capacity) {
+            walker->path_capacity *= 2;
+        }
+        walker->path = realloc(walker->path, walker->path_capacity);
+    }
+}
+
+/*
+ * Adds the path currently in the path buffer to the file list.
+ */
+static void add_path(walker_t *walker, size_t path_length) {
+    file_list_t *files = walker->files;
+    if (files->count == files->capacity) {
+        files->capacity = files->capacity == 0 ? 64 : files->capacity * 2;
+        files->offsets = realloc(files->offsets, files->capacity * sizeof(size_t));
+    }
+    if (files->data_size + path_length + 1 > files->data_capacity) {
+        files->data_capacity = files->data_capacity == 0 ? 4096 : files->data_capacity;
+        while (files->data_size + path_length + 1 > files->data_capacity) {
+            files->data_capacity *= 2;
+        }
+        files->data = realloc(files->data, files->data_capacity);
+    }
+    memcpy(files->data + files->data_size, walker->path, path_length + 1);
+    files->offsets[files->count++] = files->data_size;
+    files->data_size += path_length + 1;
+}
+
+static void walk(walker_t *, int, size_t);
+
+/*
+ * Handles an entry of the directory whose path is in the path buffer, given
+ * the directory's file descriptor, the entry's name and type, and the
+ * length of the directory's path.
+ */
+static void handle_entry(walker_t *walker, int directory, char *name, unsigned char type,
+        size_t path_length) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        /* we skip local and parent directory file links */
+        return;
+    }
+    if (type == DT_UNKNOWN) {
+        /* some file systems don't give us the type, so we have to ask for it */
+        struct stat file_stat;
+        if (fstatat(directory, name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+            return;
+        }
+        type = S_ISDIR(file_stat.st_mode) ? DT_DIR : (S_ISREG(file_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+    }
+    if (type != DT_DIR && type != DT_REG) {
+        return;
+    }
+    size_t name_length = strlen(name);
+    reserve_path(walker, path_length + name_length + 2);
+    walker->path[path_length] = '/';
+    memcpy(walker->path + path_length + 1, name, name_length + 1);
+    if (type == DT_REG) {
+        add_path(walker, path_length + name_length + 1);
+    } else {
+        int child = openat(directory, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child != -1) {
+            walk(walker, child, path_length + name_length + 1);
+        }
+    }
+    walker->path[path_length] = '\0';
+}
+
+/*
+ * Walks the directory with the given file descriptor, whose path of the
+ * given length is in the path buffer, and closes it.
+ */
+static void walk(walker_t *walker, int directory, size_t path_length) {
+#ifdef USE_GETDENTS
+    /* we read many entries per system call, straight from the kernel */
+    char *buffer = malloc(WALKER_BUFFER_SIZE);
+    long size;
+    while ((size = syscall(SYS_getdents64, directory, buffer, WALKER_BUFFER_SIZE)) > 0) {
+        long position = 0;
+        while (position < size) {
+            linux_dirent64_t *entry = (linux_dirent64_t *) (buffer + position);
+            handle_entry(walker, directory, entry->d_name, entry->d_type, path_length);
+            position += entry->d_reclen;
+        }
+    }
+    free(buffer);
+    close(directory);
+#else
+    DIR *stream = fdopendir(directory);
+    if (stream == NULL) {
+        close(directory);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        handle_entry(walker, directory, entry->d_name, entry->d_type, path_length);
+    }
+    closedir(stream);
+#endif
+}
+
+/*
+ * Recursively walks a directory and adds every regular file to the list.
+ */
+bool walk_directory(char *path, file_list_t *files) {
+    int directory = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory == -1) {
+        return false;
+    }
+    walker_t walker;
+    size_t path_length = strlen(path);
+    walker.path_capacity = 256;
+    walker.path = malloc(walker.path_capacity);
+    walker.files = files;
+    reserve_path(&walker, path_length + 1);
+    memcpy(walker.path, path, path_length + 1);
+    walk(&walker, directory, path_length);
+    free(walker.path);
+
+    /* now that the buffer won't move anymore, we can point into it */
+    files->paths = malloc((files->count > 0 ? files->count : 1) * sizeof(char *));
+    int i;
+    for (i = 0; i < files->count; i++) {
+        files->paths[i] = files->data + files->offsets[i];
+    }
+    return true;
+}
+
+/*
+ * Frees the memory held by a file list.
+ */
+void clear_file_list(file_list_t *files) {
+    free(files->paths);
+    free(files->offsets);
+    free(files->data);
+    memset(files, 0, sizeof(file_list_t));
+}
@@ -0,0 +1,37 @@
+#ifndef _FILE_WALKER_H_
+#define _FILE_WALKER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * A list of file paths, such as the regular files found by walk_directory.
+ * The paths are stored back to back in a single buffer, and the array of
+ * paths can be handed as is to stages that work through the files in
+ * parallel, like read_files.
+ */
+typedef struct file_list {
+    char **paths;
+    int count;
+    /* where every path starts in the buffer, until the list is finished */
+    size_t *offsets;
+    int capacity;
+    char *data;
+    size_t data_size;
+    size_t data_capacity;
+} file_list_t;
+
+/*
+ * Recursively walks a directory, given its path and an empty file list,
+ * and adds the path of every regular file under it to the list. Symbolic
+ * links are not followed. Returns false if the path is not a directory
+ * that can be opened.
+ */
+bool walk_directory(char *, file_list_t *);
+
+/*
+ * Frees the memory held by a file list, leaving it empty.
+ */
+void clear_file_list(file_list_t *);
+
+#endif
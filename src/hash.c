@@ -0,0 +1,31 @@
+#include "hash.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+ * Hashes a null terminated string (64-bit FNV-1a).
+ */
+uint64_t hash_string(const char *string) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    const unsigned char *current = (const unsigned char *) string;
+    while (*current != '\0') {
+        hash ^= *current++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Hashes the given bytes (64-bit FNV-1a), given a pointer and a size.
+ */
+uint64_t hash_bytes(const void *bytes, size_t size) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    const unsigned char *current = bytes;
+    const unsigned char *end = current + size;
+    while (current != end) {
+        hash ^= *current++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
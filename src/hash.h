@@ -0,0 +1,17 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hashes a null terminated string (64-bit FNV-1a).
+ */
+uint64_t hash_string(const char *);
+
+/*
+ * Hashes the given bytes (64-bit FNV-1a), given a pointer and a size.
+ */
+uint64_t hash_bytes(const void *, size_t);
+
+#endif
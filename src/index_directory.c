@@ -0,0 +1,483 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "index_directory.h"
+#include "index_parser.h"
+#include "term_dictionary.h"
+#include "term_hash.h"
+
+/*
+ * A term of the directory, with where its block is in the index file. Its
+ * position in the directory is its id in the term dictionary.
+ */
+typedef struct directory_term {
+    long offset;
+    /* kept narrow, since there is one of these for every term */
+    int length;
+    int frequency;
+    /* the decoded postings and their size, while the term is cached */
+    postings_t *postings;
+    size_t size;
+    /* the terms used just after and just before this one, while it is
+     * cached, or -1 */
+    int newer;
+    int older;
+} directory_term_t;
+
+struct index_directory {
+    /* the index file, which blocks are read from */
+    int file;
+    /* the tokens of the terms, in sorted order */
+    term_dictionary_t *dictionary;
+    directory_term_t *terms;
+    int term_count;
+
+    /* the cache, with its terms in a list from the most recently used to
+     * the least recently used */
+    size_t cache_capacity;
+    size_t cache_size;
+    int newest;
+    int oldest;
+    pthread_mutex_t lock;
+    /* how the cache has done so far, see get_directory_stats */
+    directory_stats_t stats;
+};
+
+/*
+ * Reads the whole directory file into memory. Returns NULL if it can't
+ * be read.
+ */
+static char *read_directory_file(char *file_path) {
+    FILE *file = fopen(file_path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    struct stat file_stat;
+    char *data = NULL;
+    if (fstat(fileno(file), &file_stat) == 0) {
+        data = malloc((size_t) file_stat.st_size + 1);
+        if (fread(data, 1, (size_t) file_stat.st_size, file) == (size_t) file_stat.st_size) {
+            data[file_stat.st_size] = '\0';
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+/*
+ * Gets the next line of the directory file, null terminating it in place
+ * and advancing the given position past it. Returns NULL at the end.
+ */
+static char *next_line(char **position) {
+    char *line = *position;
+    if (*line == '\0') {
+        return NULL;
+    }
+    char *end = strchr(line, '\n');
+    if (end != NULL) {
+        *end = '\0';
+        *position = end + 1;
+    } else {
+        *position = line + strlen(line);
+    }
+    return line;
+}
+
+/*
+ * Parses a term line, such as "1024 57 3 token", given the line, the term
+ * to fill in, and where to store the term's token, which points into the
+ * line.
+ */
+static bool parse_term_line(char *line, directory_term_t *term, char **token) {
+    char *end;
+    term->offset = strtol(line, &end, 10);
+    term->length = (int) strtol(end, &end, 10);
+    term->frequency = (int) strtol(end, &end, 10);
+    if (*end != ' ' || term->length <= 0) {
+        return false;
+    }
+    *token = end + 1;
+    term->postings = NULL;
+    term->size = 0;
+    term->newer = -1;
+    term->older = -1;
+    return true;
+}
+
+/*
+ * Parses the document table of the directory file into the indexer. The
+ * writer saves it in sorted order, so it can be used as is.
+ */
+static bool parse_documents(indexer_t *indexer, char **position) {
+    char *line = next_line(position);
+    if (line == NULL || strncmp(line, "<documents> ", 12) != 0) {
+        return false;
+    }
+    int count = atoi(line + 12);
+    while ((line = next_line(position)) != NULL && strcmp(line, "</documents>") != 0) {
+        char *save = NULL;
+        char *path = strtok_r(line, " ", &save);
+        while (path != NULL && indexer->documents->count < count) {
+            add_pooled_string(indexer->documents, path);
+            path = strtok_r(NULL, " ", &save);
+        }
+    }
+    trim_string_pool(indexer->documents);
+    return line != NULL && indexer->documents->count == count;
+}
+
+/*
+ * Parses the term hash that follows the document table, given the tokens
+ * of the directory's terms in id order. The slots of the terms only depend
+ * on their tokens, so the hash holds even if the terms had to be sorted.
+ * Returns NULL if there is no hash, or if it wasn't built over these terms.
+ */
+static term_hash_t *parse_hash(char **position, char **tokens, int count) {
+    char *line = next_line(position);
+    if (line == NULL || strncmp(line, "<hash> ", 7) != 0) {
+        return NULL;
+    }
+    char *end;
+    long term_count = strtol(line + 7, &end, 10);
+    long bucket_count = strtol(end, &end, 10);
+    uint64_t seed = strtoull(end, &end, 16);
+    if (term_count != count || bucket_count <= 0 || bucket_count > INT_MAX) {
+        return NULL;
+    }
+    /* the pilots of the buckets come first, then the fingerprints of the slots */
+    term_hash_t *hash = create_empty_term_hash(count, (int) bucket_count, seed);
+    long total = bucket_count + count;
+    long read = 0;
+    while (read < total && (line = next_line(position)) != NULL) {
+        char *number = line;
+        while (read < total) {
+            uint32_t value = (uint32_t) strtoul(number, &end, 16);
+            if (end == number) {
+                break;
+            }
+            if (read < bucket_count) {
+                hash->pilots[read] = value;
+            } else {
+                hash->slots[read - bucket_count].fingerprint = value;
+            }
+            read++;
+            number = end;
+        }
+    }
+    line = next_line(position);
+    if (read < total || line == NULL || strcmp(line, "</hash>") != 0 || !link_term_hash(hash, tokens, count)) {
+        destroy_term_hash(hash);
+        return NULL;
+    }
+    return hash;
+}
+
+/*
+ * A term line of the directory file, for sorting the terms of a directory
+ * that wasn't written in order.
+ */
+typedef struct term_line {
+    char *token;
+    directory_term_t term;
+} term_line_t;
+
+static int term_compare_function(const void *first, const void *second) {
+    return strcmp(((const term_line_t *) first)->token, ((const term_line_t *) second)->token);
+}
+
+/*
+ * Sorts the terms of a directory, given the directory and the token of
+ * every term, which are sorted along with them.
+ */
+static void sort_terms(index_directory_t *directory, char **tokens) {
+    term_line_t *lines = malloc(directory->term_count * sizeof(term_line_t));
+    int i;
+    for (i = 0; i < directory->term_count; i++) {
+        lines[i].token = tokens[i];
+        lines[i].term = directory->terms[i];
+    }
+    qsort(lines, directory->term_count, sizeof(term_line_t), &term_compare_function);
+    for (i = 0; i < directory->term_count; i++) {
+        tokens[i] = lines[i].token;
+        directory->terms[i] = lines[i].term;
+    }
+    free(lines);
+}
+
+/*
+ * Parses the directory file, given its contents. The directory is only used
+ * if it describes an index file of exactly the current size, since the
+ * offsets of a changed file can't be trusted. It starts with the token
+ * filters of the index, if it has any. The tokens are packed into the term
+ * dictionary, so the contents can be freed afterwards. A directory without
+ * a term hash, such as one written before there were any, has its hash
+ * built here instead.
+ */
+static bool parse_directory(index_directory_t *directory, indexer_t *indexer, char *data, long index_size) {
+    char *position = data;
+    char *line = next_line(&position);
+    char *end;
+    if (line != NULL && strncmp(line, "<filters> ", 10) == 0) {
+        if (!parse_token_filter(&indexer->filter, line + 10)) {
+            return false;
+        }
+        line = next_line(&position);
+    }
+    if (line == NULL || strncmp(line, "<directory> ", 12) != 0
+            || strtol(line + 12, &end, 10) != index_size) {
+        return false;
+    }
+    int count = atoi(end);
+    directory->terms = malloc((count > 0 ? count : 1) * sizeof(directory_term_t));
+    char **tokens = malloc((count > 0 ? count : 1) * sizeof(char *));
+    bool sorted = true;
+    while ((line = next_line(&position)) != NULL && strcmp(line, "</directory>") != 0) {
+        if (directory->term_count == count || !parse_term_line(line,
+                &directory->terms[directory->term_count], &tokens[directory->term_count])) {
+            free(tokens);
+            return false;
+        }
+        if (directory->term_count > 0 && strcmp(tokens[directory->term_count - 1],
+                tokens[directory->term_count]) >= 0) {
+            sorted = false;
+        }
+        directory->term_count++;
+    }
+    if (line == NULL || directory->term_count != count) {
+        free(tokens);
+        return false;
+    }
+    if (!sorted) {
+        sort_terms(directory, tokens);
+    }
+    directory->dictionary = create_term_dictionary(tokens, directory->term_count);
+    bool success = parse_documents(indexer, &position);
+    if (success) {
+        term_hash_t *hash = parse_hash(&position, tokens, directory->term_count);
+        set_dictionary_hash(directory->dictionary,
+                hash != NULL ? hash : create_term_hash(tokens, directory->term_count));
+    }
+    free(tokens);
+    return success;
+}
+
+/*
+ * Loads the term directory of an index file.
+ */
+indexer_t *load_index_directory(char *file_path, size_t cache_capacity) {
+    char *directory_path = create_directory_path(file_path);
+    char *data = read_directory_file(directory_path);
+    free(directory_path);
+    if (data == NULL) {
+        return NULL;
+    }
+    int file = open(file_path, O_RDONLY);
+    struct stat file_stat;
+    if (file == -1 || fstat(file, &file_stat) != 0) {
+        if (file != -1) {
+            close(file);
+        }
+        free(data);
+        return NULL;
+    }
+    index_directory_t *directory = malloc(sizeof(index_directory_t));
+    directory->file = file;
+    directory->dictionary = NULL;
+    directory->terms = NULL;
+    directory->term_count = 0;
+    directory->cache_capacity = cache_capacity;
+    directory->cache_size = 0;
+    directory->newest = -1;
+    directory->oldest = -1;
+    pthread_mutex_init(&directory->lock, NULL);
+    memset(&directory->stats, 0, sizeof(directory_stats_t));
+
+    indexer_t *indexer = create_indexer();
+    indexer->directory = directory;
+    bool success = parse_directory(directory, indexer, data, (long) file_stat.st_size);
+    free(data);
+    if (!success) {
+        destroy_index_directory(directory);
+        destroy_indexer(indexer);
+        return NULL;
+    }
+    return indexer;
+}
+
+/*
+ * Destroys a term directory, along with its cache.
+ */
+void destroy_index_directory(index_directory_t *directory) {
+    int i;
+    for (i = 0; i < directory->term_count; i++) {
+        if (directory->terms[i].postings != NULL) {
+            destroy_postings(directory->terms[i].postings);
+        }
+    }
+    pthread_mutex_destroy(&directory->lock);
+    close(directory->file);
+    if (directory->dictionary != NULL) {
+        destroy_term_dictionary(directory->dictionary);
+    }
+    free(directory->terms);
+    free(directory);
+}
+
+/*
+ * Finds a term of the directory in the term dictionary. Returns NULL if the
+ * term is not in the index.
+ */
+static directory_term_t *find_term(index_directory_t *directory, char *token) {
+    int id = find_dictionary_term(directory->dictionary, token);
+    return id >= 0 ? &directory->terms[id] : NULL;
+}
+
+/*
+ * Gets the document frequency of a term.
+ */
+long get_directory_frequency(indexer_t *indexer, char *token) {
+    directory_term_t *term = find_term(indexer->directory, token);
+    return term != NULL ? term->frequency : 0;
+}
+
+/*
+ * Gets the terms of a directory.
+ */
+term_dictionary_t *get_directory_terms(indexer_t *indexer) {
+    return indexer->directory->dictionary;
+}
+
+/*
+ * Gets how the cache of a directory has done so far.
+ */
+void get_directory_stats(indexer_t *indexer, directory_stats_t *stats) {
+    pthread_mutex_lock(&indexer->directory->lock);
+    *stats = indexer->directory->stats;
+    pthread_mutex_unlock(&indexer->directory->lock);
+}
+
+/*
+ * Takes a cached term out of the recency list.
+ */
+static void unlink_term(index_directory_t *directory, int index) {
+    directory_term_t *term = &directory->terms[index];
+    if (term->newer >= 0) {
+        directory->terms[term->newer].older = term->older;
+    } else {
+        directory->newest = term->older;
+    }
+    if (term->older >= 0) {
+        directory->terms[term->older].newer = term->newer;
+    } else {
+        directory->oldest = term->newer;
+    }
+    term->newer = -1;
+    term->older = -1;
+}
+
+/*
+ * Puts a cached term at the front of the recency list.
+ */
+static void link_newest_term(index_directory_t *directory, int index) {
+    directory_term_t *term = &directory->terms[index];
+    term->newer = -1;
+    term->older = directory->newest;
+    if (directory->newest >= 0) {
+        directory->terms[directory->newest].newer = index;
+    } else {
+        directory->oldest = index;
+    }
+    directory->newest = index;
+}
+
+/*
+ * Adds decoded postings to the cache, evicting the least recently used
+ * terms until they fit.
+ */
+static void cache_postings(index_directory_t *directory, directory_term_t *term,
+        postings_t *postings, size_t size) {
+    while (directory->cache_size + size > directory->cache_capacity && directory->oldest >= 0) {
+        directory_term_t *oldest = &directory->terms[directory->oldest];
+        unlink_term(directory, directory->oldest);
+        directory->cache_size -= oldest->size;
+        destroy_postings(oldest->postings);
+        oldest->postings = NULL;
+        oldest->size = 0;
+    }
+    term->postings = postings;
+    term->size = size;
+    directory->cache_size += size;
+    link_newest_term(directory, (int) (term - directory->terms));
+}
+
+/*
+ * Reads the block of a term from the index file and decodes it.
+ */
+static postings_t *read_postings(indexer_t *indexer, directory_term_t *term, char *token) {
+    char *block = malloc((size_t) term->length + 1);
+    long done = 0;
+    while (done < term->length) {
+        ssize_t size = pread(indexer->directory->file, block + done,
+                (size_t) (term->length - done), (off_t) (term->offset + done));
+        if (size <= 0) {
+            fprintf(stderr, "Error: Could not read the postings of '%s'.\n", token);
+            free(block);
+            return NULL;
+        }
+        done += size;
+    }
+    block[term->length] = '\0';
+    postings_t *postings = parse_postings_block(indexer, block);
+    if (postings == NULL) {
+        fprintf(stderr, "Error: The postings of '%s' are corrupt.\n", token);
+    }
+    free(block);
+    return postings;
+}
+
+/*
+ * Gets the postings list of a term. The cache keeps its own copy, so the
+ * caller's postings stay valid if the term is evicted.
+ */
+postings_t *get_directory_postings(indexer_t *indexer, char *token) {
+    index_directory_t *directory = indexer->directory;
+    directory_term_t *term = find_term(directory, token);
+    if (term == NULL) {
+        return create_postings(0);
+    }
+    pthread_mutex_lock(&directory->lock);
+    if (term->postings != NULL) {
+        unlink_term(directory, (int) (term - directory->terms));
+        link_newest_term(directory, (int) (term - directory->terms));
+        postings_t *copy = copy_postings(term->postings);
+        directory->stats.hits++;
+        pthread_mutex_unlock(&directory->lock);
+        return copy;
+    }
+    directory->stats.misses++;
+    directory->stats.decoded_bytes += term->length;
+    pthread_mutex_unlock(&directory->lock);
+
+    /* the block is read and decoded without holding the lock */
+    postings_t *postings = read_postings(indexer, term, token);
+    if (postings == NULL) {
+        return create_postings(0);
+    }
+    size_t size = get_postings_memory_size(postings);
+    pthread_mutex_lock(&directory->lock);
+    /* another thread may have cached the term while we were reading it */
+    if (term->postings == NULL && size <= directory->cache_capacity) {
+        cache_postings(directory, term, postings, size);
+        postings = copy_postings(postings);
+    }
+    pthread_mutex_unlock(&directory->lock);
+    return postings;
+}
@@ -0,0 +1,70 @@
+#ifndef _INDEX_DIRECTORY_H_
+#define _INDEX_DIRECTORY_H_
+
+#include <stddef.h>
+#include "indexer.h"
+#include "postings.h"
+#include "term_dictionary.h"
+
+/*
+ * The term directory of an index file, loaded from its "<path>.dir" sidecar.
+ * It holds the offset, length and document frequency of every term's block,
+ * so the postings of a term are only read from the index file (and decoded)
+ * the first time a query needs them. Terms are found through the term hash
+ * saved along with the directory. Decoded postings are kept in a cache of
+ * bounded size, evicting the least recently used terms first.
+ */
+typedef struct index_directory index_directory_t;
+
+/*
+ * The counters of a directory's postings cache, since it was loaded: the
+ * lookups it answered, those it had to read from the index file for, and
+ * the bytes of postings blocks those reads decoded.
+ */
+typedef struct directory_stats {
+    long hits;
+    long misses;
+    long decoded_bytes;
+} directory_stats_t;
+
+/*
+ * Loads the term directory of an index file, given the index file path and
+ * the size of the postings cache in bytes. Returns an indexer with its
+ * document table built and its directory set, but without any entries, or
+ * NULL if the index has no directory or its directory is out of date. The
+ * caller is responsible for freeing the directory and the indexer.
+ */
+indexer_t *load_index_directory(char *, size_t);
+
+/*
+ * Destroys a term directory, along with its cache.
+ */
+void destroy_index_directory(index_directory_t *);
+
+/*
+ * Gets the document frequency of a term, given an indexer loaded with
+ * load_index_directory and the term.
+ */
+long get_directory_frequency(indexer_t *, char *);
+
+/*
+ * Gets the terms of an indexer loaded with load_index_directory. The
+ * dictionary belongs to the directory.
+ */
+term_dictionary_t *get_directory_terms(indexer_t *);
+
+/*
+ * Gets the counters of the postings cache of an indexer loaded with
+ * load_index_directory. Safe to call while it is being searched.
+ */
+void get_directory_stats(indexer_t *, directory_stats_t *);
+
+/*
+ * Gets the postings list of a term, reading it from the index file if it
+ * isn't cached, given an indexer loaded with load_index_directory and the
+ * term. Safe to call from several threads at once. The caller is
+ * responsible for freeing the returned postings list.
+ */
+postings_t *get_directory_postings(indexer_t *, char *);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "index_handle.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define USE_INOTIFY
+#endif
+
+/*
+ * How long the index files have to stay untouched, in milliseconds, before
+ * they are reloaded, so an index that is still being written (or a sharded
+ * index whose shards are written one by one) is only loaded once.
+ */
+#ifndef RELOAD_DELAY
+#define RELOAD_DELAY 250
+#endif
+
+struct index_handle {
+    char *file_path;
+    /* the name of the index file, without its directory */
+    char *file_name;
+    /* the current version, which the handle holds a reference to */
+    index_set_t *current;
+    pthread_mutex_t lock;
+
+    /* the background thread, which waits on the inotify instance watching
+     * the index's directory (or -1) and on the read end of a pipe that
+     * requests are written to */
+    pthread_t thread;
+    bool started;
+    int watch;
+    int requests[2];
+};
+
+/*
+ * Checks whether a file name is one of the index's files: the index file,
+ * one of its shards, or the trigram index or term directory of either. If
+ * temporary files are accepted, so are the ".tmp" files the indexer writes
+ * them to.
+ */
+static bool is_index_file_name(index_handle_t *handle, const char *name, bool temporary) {
+    size_t length = strlen(handle->file_name);
+    if (strncmp(name, handle->file_name, length) != 0) {
+        return false;
+    }
+    name += length;
+    if (name[0] == '.' && name[1] >= '0' && name[1] <= '9') {
+        name++;
+        while (*name >= '0' && *name <= '9') {
+            name++;
+        }
+    }
+    if (strncmp(name, ".tri", 4) == 0) {
+        name += 4;
+    }
+    if (strncmp(name, ".dir", 4) == 0) {
+        name += 4;
+    }
+    return *name == '\0' || (temporary && strcmp(name, ".tmp") == 0);
+}
+
+/*
+ * Gets the time of a monotonic clock, in milliseconds.
+ */
+static long long get_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (long long) time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+/*
+ * Loads the new version of the index and swaps it in. The old version is
+ * freed by whoever releases it last, which may be us.
+ */
+static void reload_index(index_handle_t *handle) {
+    index_set_t *set = load_index_set(handle->file_path);
+    if (set == NULL) {
+        fprintf(stderr, "Warning: Could not reload the index, keeping the loaded one.\n");
+        return;
+    }
+    pthread_mutex_lock(&handle->lock);
+    index_set_t *old_set = handle->current;
+    handle->current = set;
+    pthread_mutex_unlock(&handle->lock);
+    release_index_set(old_set);
+    fprintf(stderr, "Reloaded the index.\n");
+}
+
+#ifdef USE_INOTIFY
+/*
+ * What the pending events of the inotify instance say about the index.
+ */
+typedef enum index_activity {
+    /* only other files of the directory were touched */
+    ACTIVITY_NONE,
+    /* the index is being written */
+    ACTIVITY_WRITING,
+    /* one of the index's files was rewritten or moved into place */
+    ACTIVITY_CHANGED
+} index_activity_t;
+
+/*
+ * Reads the pending events of the inotify instance.
+ */
+static index_activity_t read_events(index_handle_t *handle) {
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    index_activity_t activity = ACTIVITY_NONE;
+    ssize_t size;
+    while ((size = read(handle->watch, buffer, sizeof(buffer))) > 0) {
+        ssize_t position = 0;
+        while (position < size) {
+            struct inotify_event *event = (struct inotify_event *) (buffer + position);
+            if (event->len > 0 && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0
+                    && is_index_file_name(handle, event->name, false)) {
+                activity = ACTIVITY_CHANGED;
+            } else if (event->len > 0 && activity == ACTIVITY_NONE
+                    && is_index_file_name(handle, event->name, true)) {
+                activity = ACTIVITY_WRITING;
+            }
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return activity;
+}
+
+/*
+ * Starts watching the directory of the index file. Returns the inotify
+ * instance, or -1 if the index can't be watched.
+ */
+static int watch_index(char *file_path) {
+    int watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch == -1) {
+        return -1;
+    }
+    char *directory = strdup(file_path);
+    char *slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else {
+        slash[slash == directory ? 1 : 0] = '\0';
+    }
+    /* modifications don't start a reload, but they do put it off */
+    if (inotify_add_watch(watch, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY) == -1) {
+        close(watch);
+        watch = -1;
+    }
+    free(directory);
+    return watch;
+}
+#endif
+
+/*
+ * The background thread. A reload is started once the index files have
+ * been left alone for a while after they were rewritten or a reload was
+ * requested, and the thread stops when it gets a 'q' request.
+ */
+static void *reload_thread(void *argument) {
+    index_handle_t *handle = argument;
+    struct pollfd descriptors[2];
+    descriptors[0].fd = handle->requests[0];
+    descriptors[0].events = POLLIN;
+    /* poll skips negative descriptors, so this works without a watch too */
+    descriptors[1].fd = handle->watch;
+    descriptors[1].events = POLLIN;
+    bool pending = false;
+    long long deadline = 0;
+    while (true) {
+        int timeout = -1;
+        if (pending) {
+            long long left = deadline - get_milliseconds();
+            timeout = left > 0 ? (int) left : 0;
+        }
+        int ready = poll(descriptors, 2, timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        } else if (ready == 0) {
+            reload_index(handle);
+            pending = false;
+            continue;
+        }
+        if ((descriptors[0].revents & POLLIN) != 0) {
+            char request;
+            if (read(handle->requests[0], &request, 1) != 1 || request == 'q') {
+                break;
+            }
+            pending = true;
+            deadline = get_milliseconds() + RELOAD_DELAY;
+        }
+#ifdef USE_INOTIFY
+        if ((descriptors[1].revents & POLLIN) != 0) {
+            index_activity_t activity = read_events(handle);
+            pending = pending || activity == ACTIVITY_CHANGED;
+            if (pending && activity != ACTIVITY_NONE) {
+                /* the index is still being written, so we put the reload off */
+                deadline = get_milliseconds() + RELOAD_DELAY;
+            }
+        }
+#endif
+    }
+    return NULL;
+}
+
+/*
+ * Creates a handle and loads the first version of the index.
+ */
+index_handle_t *create_index_handle(char *file_path) {
+    index_set_t *set = load_index_set(file_path);
+    if (set == NULL) {
+        return NULL;
+    }
+    index_handle_t *handle = malloc(sizeof(index_handle_t));
+    handle->file_path = strdup(file_path);
+    char *slash = strrchr(handle->file_path, '/');
+    handle->file_name = slash != NULL ? slash + 1 : handle->file_path;
+    handle->current = set;
+    pthread_mutex_init(&handle->lock, NULL);
+    handle->watch = -1;
+    handle->started = false;
+    if (pipe(handle->requests) == -1) {
+        fprintf(stderr, "Warning: The index can't be reloaded.\n");
+        handle->requests[0] = -1;
+        handle->requests[1] = -1;
+        return handle;
+    }
+#ifdef USE_INOTIFY
+    handle->watch = watch_index(file_path);
+    if (handle->watch == -1) {
+        fprintf(stderr, "Warning: Could not watch the index for changes.\n");
+    }
+#endif
+    handle->started = pthread_create(&handle->thread, NULL, &reload_thread, handle) == 0;
+    return handle;
+}
+
+/*
+ * Stops the background thread and destroys the handle.
+ */
+void destroy_index_handle(index_handle_t *handle) {
+    if (handle->started) {
+        char request = 'q';
+        if (write(handle->requests[1], &request, 1) == 1) {
+            pthread_join(handle->thread, NULL);
+        } else {
+            pthread_detach(handle->thread);
+        }
+    }
+    if (handle->requests[0] != -1) {
+        close(handle->requests[0]);
+        close(handle->requests[1]);
+    }
+    if (handle->watch != -1) {
+        close(handle->watch);
+    }
+    pthread_mutex_destroy(&handle->lock);
+    release_index_set(handle->current);
+    free(handle->file_path);
+    free(handle);
+}
+
+/*
+ * Acquires the current index set. The reference is taken under the lock, so
+ * the set can't be swapped out and freed in between.
+ */
+index_set_t *acquire_index_set(index_handle_t *handle) {
+    pthread_mutex_lock(&handle->lock);
+    index_set_t *set = handle->current;
+    __atomic_add_fetch(&set->references, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&handle->lock);
+    return set;
+}
+
+/*
+ * Releases an index set, freeing it with its last holder.
+ */
+void release_index_set(index_set_t *set) {
+    if (__atomic_sub_fetch(&set->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        destroy_index_set(set);
+    }
+}
+
+/*
+ * Asks the background thread to reload the index.
+ */
+void request_index_reload(index_handle_t *handle) {
+    char request = 'r';
+    if (!handle->started || write(handle->requests[1], &request, 1) != 1) {
+        fprintf(stderr, "Warning: The index can't be reloaded.\n");
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _INDEX_HANDLE_H_
+#define _INDEX_HANDLE_H_
+
+#include <stdbool.h>
+#include "index_set.h"
+
+/*
+ * A handle to the current version of an index, which can be reloaded while
+ * it is being searched. Searches acquire the current index set and release
+ * it when they are done. A reload loads the new version in the background
+ * and swaps it in, so searches that started before the swap finish on the
+ * old version, which is freed once the last of them releases it.
+ */
+typedef struct index_handle index_handle_t;
+
+/*
+ * Creates a handle and loads the first version of the index, given the
+ * path of the index file (or of its shards, see load_index_set). A
+ * background thread reloads the index when any of its files are rewritten,
+ * or when asked to with request_index_reload. Returns NULL if the index
+ * could not be loaded. The caller is responsible for freeing the handle
+ * using destroy_index_handle.
+ */
+index_handle_t *create_index_handle(char *);
+
+/*
+ * Stops the background thread and destroys the handle. Index sets that are
+ * still acquired stay valid until they are released.
+ */
+void destroy_index_handle(index_handle_t *);
+
+/*
+ * Acquires the current index set of a handle. The set stays valid, even if
+ * a newer version is swapped in, until it is released.
+ */
+index_set_t *acquire_index_set(index_handle_t *);
+
+/*
+ * Releases an index set acquired with acquire_index_set, freeing it if it
+ * has been replaced and this was its last holder.
+ */
+void release_index_set(index_set_t *);
+
+/*
+ * Asks the background thread of a handle to reload the index, without
+ * waiting for it to be done.
+ */
+void request_index_reload(index_handle_t *);
+
+#endif
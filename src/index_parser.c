@@ -1,58 +1,669 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "index_parser.h"
-#include "util.h"
+#include "postings.h"
+#include "hash.h"
 
 /*
- * Parses and loads an indexer into memory, given the file path
- * of the indexer file.
+ * The smallest part of an index file worth parsing on its own thread.
  */
-indexer_t *parse_indexer_file(char *file_path) {
-    indexer_t *indexer = create_indexer();
+#ifndef PARSER_CHUNK_SIZE
+#define PARSER_CHUNK_SIZE (1 << 20)
+#endif
 
-    char *input = read_file(file_path);
-    if(input == NULL) {
-        return NULL;
+/*
+ * The kind of block the parser is currently inside of.
+ */
+typedef enum parser_mode {
+    MODE_NONE,
+    MODE_LIST,
+    MODE_BITMAP,
+    MODE_DOCUMENTS
+} parser_mode_t;
+
+/*
+ * A hash table of entries by token, which also remembers the order the
+ * entries were added in.
+ */
+typedef struct entry_table {
+    indexer_entry_t **entries;
+    int count;
+    int capacity;
+    /* open addressing slots holding an entry's position plus one, or 0 */
+    int *slots;
+    int slot_count;
+} entry_table_t;
+
+/*
+ * A "<documents>" section of the index file, and the id of its first
+ * document in the whole file.
+ */
+typedef struct document_section {
+    size_t offset;
+    int first_id;
+} document_section_t;
+
+/*
+ * A part of the index file that is parsed on its own thread. Chunks always
+ * start at a block, so no block is split between two chunks.
+ */
+typedef struct parse_chunk {
+    const char *data;
+    size_t start;
+    size_t end;
+    document_section_t *sections;
+    int section_count;
+
+    /* what was parsed: the entries in the order they first appeared, and
+     * the documents of the chunk's "<documents>" sections, in file order */
+    entry_table_t table;
+    string_pool_t *documents;
+    /* the token filters of the chunk's first "<filters>" line, if any */
+    token_filter_t filter;
+    bool has_filter;
+} parse_chunk_t;
+
+static void init_entry_table(entry_table_t *table) {
+    table->entries = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->slot_count = 1024;
+    table->slots = calloc(table->slot_count, sizeof(int));
+}
+
+/*
+ * Finds the slot of a token: either the slot of its entry or the empty
+ * slot where its entry belongs.
+ */
+static int find_slot(entry_table_t *table, const char *token) {
+    int mask = table->slot_count - 1;
+    int slot = (int) (hash_string(token) & (uint64_t) mask);
+    while (table->slots[slot] != 0 && strcmp(table->entries[table->slots[slot] - 1]->token, token) != 0) {
+        slot = (slot + 1) & mask;
     }
-    list_t *lines = tokenize(input, '\n', false);
-    free(input);
+    return slot;
+}
 
-    list_iterator_t *iterator = create_iterator(lines);
-    char *line = get_item(iterator);
+static indexer_entry_t *find_table_entry(entry_table_t *table, const char *token) {
+    int slot = find_slot(table, token);
+    return table->slots[slot] != 0 ? table->entries[table->slots[slot] - 1] : NULL;
+}
+
+/*
+ * Adds an entry whose token isn't in the table yet.
+ */
+static void add_table_entry(entry_table_t *table, indexer_entry_t *entry) {
+    if (2 * (table->count + 1) > table->slot_count) {
+        /* we keep the table at most half full, rehashing into twice the slots */
+        free(table->slots);
+        table->slot_count *= 2;
+        table->slots = calloc(table->slot_count, sizeof(int));
+        int i;
+        for (i = 0; i < table->count; i++) {
+            table->slots[find_slot(table, table->entries[i]->token)] = i + 1;
+        }
+    }
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity == 0 ? 1024 : table->capacity * 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(indexer_entry_t *));
+    }
+    table->entries[table->count++] = entry;
+    table->slots[find_slot(table, entry->token)] = table->count;
+}
+
+static void free_entry_table(entry_table_t *table) {
+    free(table->entries);
+    free(table->slots);
+}
+
+/*
+ * Gets the last element of a list, so elements can be appended after it.
+ */
+static list_element_t *get_tail(list_t *list) {
+    list_element_t *element = list->head;
+    while (element != NULL && element->next != NULL) {
+        element = element->next;
+    }
+    return element;
+}
+
+/*
+ * Appends a new element to the end of a list, given its current tail (or
+ * NULL if it is empty). Returns the new tail.
+ */
+static list_element_t *append_to_list(list_t *list, list_element_t *tail, void *value) {
+    list_element_t *element = create_list_element(value, NULL);
+    if (tail == NULL) {
+        list->head = element;
+    } else {
+        tail->next = element;
+    }
+    return element;
+}
+
+/*
+ * Appends the paths of a "<documents>" section line to the chunk's
+ * documents.
+ */
+static void parse_documents_line(parse_chunk_t *chunk, char *line) {
+    char *save = NULL;
+    char *path = strtok_r(line, " ", &save);
+    while (path != NULL) {
+        add_pooled_string(chunk->documents, path);
+        path = strtok_r(NULL, " ", &save);
+    }
+}
+
+/*
+ * Parses a line of "path count" records into an entry, given the entry,
+ * the line, whether the entry already had records before this
+ * block (in which case a path may repeat, and its count is replaced), and
+ * the tail of the entry's records, which is updated.
+ */
+static void parse_records_line(indexer_entry_t *entry, char *line, bool had_records,
+        list_element_t **tail) {
+    char *save = NULL;
+    char *file = strtok_r(line, " ", &save);
+    char *count = strtok_r(NULL, " ", &save);
+    while (file != NULL && count != NULL) {
+        indexer_entry_record_t *record = NULL;
+        if (had_records) {
+            record = get_indexer_entry_record(entry, file);
+        }
+        if (record == NULL) {
+            record = create_indexer_entry_record(file);
+            *tail = append_to_list(entry->records, *tail, record);
+        }
+        record->count = atoi(count);
+        file = strtok_r(NULL, " ", &save);
+        count = strtok_r(NULL, " ", &save);
+    }
+}
+
+/*
+ * Adds a bitmap to an entry, merging it with the bitmap the entry already
+ * has, if any (when the same term was appended to the file more than once).
+ */
+static void add_entry_bitmap(indexer_entry_t *entry, roaring_t *bitmap) {
+    if (entry->bitmap == NULL) {
+        entry->bitmap = bitmap;
+        return;
+    }
+    roaring_t *merged = roaring_or(entry->bitmap, bitmap);
+    destroy_roaring(entry->bitmap);
+    destroy_roaring(bitmap);
+    entry->bitmap = merged;
+}
+
+/*
+ * Parses a container line of a "<bitmap>" block, such as "a 0 1 5 9", and
+ * adds it to the given bitmap. Ids are relative to the document section the
+ * bitmap belongs to, which starts at the given id.
+ */
+static void parse_bitmap_line(roaring_t *bitmap, char *line, int first_id) {
+    char type = *line;
+    char *position = line + 1;
+    char *end;
+    uint32_t key = (uint32_t) strtoul(position, &end, 10);
+    position = end;
+    roaring_container_t container;
+    container.key = (uint16_t) key;
+    container.cardinality = 0;
+    container.size = 0;
+    container.values = NULL;
+    container.words = NULL;
+    if (type == 'b') {
+        container.type = ROARING_BITMAP;
+        container.words = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+        int i;
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            container.words[i] = strtoull(position, &end, 16);
+            if (end == position) break;
+            position = end;
+            container.cardinality += __builtin_popcountll(container.words[i]);
+        }
+    } else if (type == 'a' || type == 'r') {
+        container.type = type == 'a' ? ROARING_ARRAY : ROARING_RUN;
+        int capacity = 16;
+        container.values = malloc(capacity * sizeof(uint16_t));
+        int count = 0;
+        while (true) {
+            unsigned long value = strtoul(position, &end, 10);
+            if (end == position) break;
+            position = end;
+            if (count == capacity) {
+                capacity *= 2;
+                container.values = realloc(container.values, capacity * sizeof(uint16_t));
+            }
+            container.values[count++] = (uint16_t) value;
+        }
+        if (container.type == ROARING_ARRAY) {
+            container.size = count;
+            container.cardinality = count;
+        } else {
+            container.size = count / 2;
+            int i;
+            for (i = 0; i < container.size; i++) {
+                container.cardinality += container.values[2 * i + 1] + 1;
+            }
+        }
+    } else {
+        return;
+    }
+    if (first_id == 0) {
+        append_roaring_container(bitmap, &container);
+        return;
+    }
+    /* the ids have to be shifted past earlier sections, which can move values
+     * across containers, so we add them one at a time */
+    uint32_t *ids = malloc((container.cardinality + 1) * sizeof(uint32_t));
+    roaring_t single = { &container, 1, 1, container.cardinality };
+    roaring_to_array(&single, ids);
+    int i;
+    for (i = 0; i < container.cardinality; i++) {
+        append_roaring(bitmap, ids[i] + (uint32_t) first_id);
+    }
+    free(ids);
+    free(container.values);
+    free(container.words);
+}
+
+/*
+ * Gets the id of the first document of the section a position of the file
+ * is in, and the number of sections that start before it.
+ */
+static int find_section(parse_chunk_t *chunk, size_t position, int *section) {
+    *section = 0;
+    while (*section < chunk->section_count && chunk->sections[*section].offset < position) {
+        (*section)++;
+    }
+    return *section > 0 ? chunk->sections[*section - 1].first_id : 0;
+}
+
+/*
+ * Parses a chunk of the index file. Lines are copied out of the mapped file
+ * into a buffer, since the mapping is read only.
+ */
+static void *parse_chunk(void *argument) {
+    parse_chunk_t *chunk = argument;
+    init_entry_table(&chunk->table);
+    chunk->documents = create_string_pool();
+    size_t line_capacity = 256;
+    char *line = malloc(line_capacity);
     indexer_entry_t *current_entry = NULL;
-    while (line != NULL) {
-        char *index = NULL;
-        if ((index = strstr(line, "<list> ")) != NULL) {
-            char *token = index + (7 * sizeof(char));
-            if ((current_entry = get_indexer_entry(indexer, token)) == NULL) {
+    list_element_t *current_tail = NULL;
+    bool had_records = false;
+    roaring_t *current_bitmap = NULL;
+    parser_mode_t mode = MODE_NONE;
+    int section;
+    int first_document_id = find_section(chunk, chunk->start, &section);
+    size_t position = chunk->start;
+    while (position < chunk->end) {
+        const char *start = chunk->data + position;
+        const char *end = memchr(start, '\n', chunk->end - position);
+        size_t line_size = end != NULL ? (size_t) (end - start) : chunk->end - position;
+        if (line_size + 1 > line_capacity) {
+            while (line_size + 1 > line_capacity) {
+                line_capacity *= 2;
+            }
+            line = realloc(line, line_capacity);
+        }
+        memcpy(line, start, line_size);
+        line[line_size] = '\0';
+        position += line_size + 1;
+
+        bool is_list = strncmp(line, "<list> ", 7) == 0;
+        if (is_list || strncmp(line, "<bitmap> ", 9) == 0) {
+            char *token = line + (is_list ? 7 : 9);
+            current_entry = find_table_entry(&chunk->table, token);
+            if (current_entry == NULL) {
                 current_entry = create_indexer_entry(token);
-                insert_object(indexer->entries, current_entry);
+                add_table_entry(&chunk->table, current_entry);
+            }
+            had_records = current_entry->records->head != NULL;
+            current_tail = get_tail(current_entry->records);
+            if (is_list) {
+                mode = MODE_LIST;
+            } else {
+                current_bitmap = create_roaring();
+                mode = MODE_BITMAP;
+            }
+        } else if (strncmp(line, "<documents>", 11) == 0) {
+            /* ids in the bitmaps that follow are relative to this section */
+            if (section < chunk->section_count) {
+                first_document_id = chunk->sections[section++].first_id;
             }
-        } else if (strstr(line, "</list>")) {
+            mode = MODE_DOCUMENTS;
+        } else if (strncmp(line, "<filters> ", 10) == 0) {
+            if (!chunk->has_filter) {
+                chunk->has_filter = parse_token_filter(&chunk->filter, line + 10);
+            }
+            mode = MODE_NONE;
+        } else if (strncmp(line, "</list>", 7) == 0 || strncmp(line, "</documents>", 12) == 0) {
             current_entry = NULL;
+            mode = MODE_NONE;
+        } else if (strncmp(line, "</bitmap>", 9) == 0) {
+            if (current_entry != NULL && current_bitmap != NULL) {
+                add_entry_bitmap(current_entry, current_bitmap);
+                current_bitmap = NULL;
+            }
+            current_entry = NULL;
+            mode = MODE_NONE;
+        } else if (mode == MODE_DOCUMENTS) {
+            parse_documents_line(chunk, line);
+        } else if (mode == MODE_BITMAP) {
+            parse_bitmap_line(current_bitmap, line, first_document_id);
+        } else if (mode == MODE_LIST) {
+            parse_records_line(current_entry, line, had_records, &current_tail);
+        }
+    }
+    if (current_bitmap != NULL) {
+        /* the file ended in the middle of a bitmap */
+        destroy_roaring(current_bitmap);
+    }
+    free(line);
+    return NULL;
+}
+
+/*
+ * Checks if a block starts at the given position, which must be at the
+ * start of a line.
+ */
+static bool is_block_start(const char *data, size_t position, size_t size) {
+    size_t left = size - position;
+    return (left >= 7 && memcmp(data + position, "<list> ", 7) == 0)
+            || (left >= 9 && memcmp(data + position, "<bitmap> ", 9) == 0)
+            || (left >= 11 && memcmp(data + position, "<documents>", 11) == 0);
+}
+
+/*
+ * Moves a position of the file forward to the start of the next block, or
+ * to the end of the file if there is none.
+ */
+static size_t snap_to_block(const char *data, size_t position, size_t size) {
+    while (position < size) {
+        if ((position == 0 || data[position - 1] == '\n') && is_block_start(data, position, size)) {
+            return position;
+        }
+        const char *end = memchr(data + position, '\n', size - position);
+        if (end == NULL) {
+            return size;
+        }
+        position = (size_t) (end - data) + 1;
+    }
+    return size;
+}
+
+/*
+ * Finds every "<documents>" section of the file, so chunks know which ids
+ * their bitmaps start from without parsing the chunks before them. The
+ * returned array is allocated and its size is stored in the given count.
+ */
+static document_section_t *find_sections(const char *data, size_t size, int *count) {
+    document_section_t *sections = NULL;
+    int first_id = 0;
+    *count = 0;
+    size_t position = 0;
+    while (position < size) {
+        const char *found = memmem(data + position, size - position, "<documents> ", 12);
+        if (found == NULL) {
+            break;
+        }
+        position = (size_t) (found - data);
+        if (position == 0 || data[position - 1] == '\n') {
+            sections = realloc(sections, (*count + 1) * sizeof(document_section_t));
+            sections[*count].offset = position;
+            sections[*count].first_id = first_id;
+            (*count)++;
+            first_id += (int) strtol(found + 12, NULL, 10);
+        }
+        position += 12;
+    }
+    return sections;
+}
+
+/*
+ * Merges an entry parsed by a later chunk into the same term's entry from
+ * an earlier chunk, and destroys it. Counts of repeated paths are replaced,
+ * just like when a term is repeated within a chunk.
+ */
+static void merge_entry(indexer_entry_t *entry, indexer_entry_t *other) {
+    bool had_records = entry->records->head != NULL;
+    list_element_t *tail = get_tail(entry->records);
+    list_element_t *element = other->records->head;
+    while (element != NULL) {
+        list_element_t *next = element->next;
+        indexer_entry_record_t *record = element->value;
+        indexer_entry_record_t *existing = had_records ? get_indexer_entry_record(entry, record->file_path) : NULL;
+        if (existing != NULL) {
+            existing->count = record->count;
+            destroy_list_element(other->records, element);
         } else {
-            list_t *tokens = tokenize(line, ' ', false);
-            list_iterator_t *token_iterator = create_iterator(tokens);
-            char *file = get_item(token_iterator);
-            char *count = next_item(token_iterator);
-            while (file != NULL && count != NULL) {
-                indexer_entry_record_t *record;
-                if((record = get_indexer_entry_record(current_entry, file)) == NULL) {
-                    record = create_indexer_entry_record(file);
-                    insert_object(current_entry->records, record);
-                }
-                record->count = atoi(count);
-                file = next_item(token_iterator);
-                count = next_item(token_iterator);
-            }
-            destroy_iterator(token_iterator);
-            destroy_list(tokens);
-        }
-        line = next_item(iterator);
-    }
-
-    destroy_iterator(iterator);
-    destroy_list(lines);
+            /* we move the element itself over */
+            element->next = NULL;
+            if (tail == NULL) {
+                entry->records->head = element;
+            } else {
+                tail->next = element;
+            }
+            tail = element;
+        }
+        element = next;
+    }
+    other->records->head = NULL;
+    if (other->bitmap != NULL) {
+        add_entry_bitmap(entry, other->bitmap);
+        other->bitmap = NULL;
+    }
+    destroy_indexer_entry(other);
+}
+
+static int entry_compare_function(const void *first, const void *second) {
+    return strcmp((*(indexer_entry_t * const *) first)->token, (*(indexer_entry_t * const *) second)->token);
+}
+
+/*
+ * Merges the parsed chunks, in file order, into the indexer.
+ */
+static void merge_chunks(indexer_t *indexer, parse_chunk_t *chunks, int chunk_count) {
+    entry_table_t table;
+    init_entry_table(&table);
+    bool has_filter = false;
+    int i;
+    for (i = 0; i < chunk_count; i++) {
+        parse_chunk_t *chunk = &chunks[i];
+        if (chunk->has_filter && !has_filter) {
+            /* the filters the file was first written with apply to it all */
+            indexer->filter = chunk->filter;
+            has_filter = true;
+        }
+        int j;
+        for (j = 0; j < chunk->table.count; j++) {
+            indexer_entry_t *entry = chunk->table.entries[j];
+            indexer_entry_t *existing = chunk_count > 1 ? find_table_entry(&table, entry->token) : NULL;
+            if (existing != NULL) {
+                merge_entry(existing, entry);
+            } else if (chunk_count > 1) {
+                add_table_entry(&table, entry);
+            }
+        }
+        for (j = 0; j < chunk->documents->count; j++) {
+            add_pooled_string(indexer->documents, get_pooled_string(chunk->documents, j));
+        }
+        destroy_string_pool(chunk->documents);
+    }
+    /* a single chunk needs no merging, so we use its entries as they are */
+    entry_table_t *merged = chunk_count > 1 ? &table : &chunks[0].table;
+    /* the entries list is sorted by token, so we sort once and link the
+     * elements in order instead of inserting them one by one */
+    qsort(merged->entries, merged->count, sizeof(indexer_entry_t *), &entry_compare_function);
+    list_element_t *tail = NULL;
+    for (i = 0; i < merged->count; i++) {
+        tail = append_to_list(indexer->entries, tail, merged->entries[i]);
+    }
+    free_entry_table(&table);
+    for (i = 0; i < chunk_count; i++) {
+        free_entry_table(&chunks[i].table);
+    }
+}
+
+/*
+ * Parses and loads an indexer into memory, given the file path of the
+ * indexer file and the number of threads to parse it with. The file is
+ * mapped into memory and split into chunks that start at a block, which
+ * are parsed concurrently and then merged.
+ */
+indexer_t *parse_indexer_file(char *file_path, int thread_count) {
+    int file = open(file_path, O_RDONLY);
+    if (file == -1) {
+        return NULL;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0) {
+        close(file);
+        return NULL;
+    }
+    size_t size = (size_t) file_stat.st_size;
+    const char *data = "";
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            close(file);
+            return NULL;
+        }
+    }
+    close(file);
+
+    /* we never use more threads than there are chunks worth parsing apart */
+    int chunk_count = (int) (size / PARSER_CHUNK_SIZE);
+    if (chunk_count > thread_count) {
+        chunk_count = thread_count;
+    }
+    if (chunk_count < 1) {
+        chunk_count = 1;
+    }
+    int section_count;
+    document_section_t *sections = find_sections(data, size, &section_count);
+    parse_chunk_t *chunks = calloc(chunk_count, sizeof(parse_chunk_t));
+    int i;
+    for (i = 0; i < chunk_count; i++) {
+        chunks[i].data = data;
+        chunks[i].start = i == 0 ? 0 : snap_to_block(data, size / chunk_count * i, size);
+        chunks[i].sections = sections;
+        chunks[i].section_count = section_count;
+    }
+    for (i = 0; i < chunk_count; i++) {
+        chunks[i].end = i + 1 < chunk_count ? chunks[i + 1].start : size;
+    }
+
+    /* every chunk but the first gets its own thread */
+    pthread_t *threads = malloc(chunk_count * sizeof(pthread_t));
+    bool *started = calloc(chunk_count, sizeof(bool));
+    for (i = 1; i < chunk_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, &parse_chunk, &chunks[i]) == 0;
+    }
+    for (i = 0; i < chunk_count; i++) {
+        if (!started[i]) {
+            parse_chunk(&chunks[i]);
+        }
+    }
+    for (i = 1; i < chunk_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+
+    indexer_t *indexer = create_indexer();
+    merge_chunks(indexer, chunks, chunk_count);
+    free(chunks);
+    free(sections);
+    if (size > 0) {
+        munmap((void *) data, size);
+    }
     return indexer;
-}
\ No newline at end of file
+}
+/*
+ * Parses a line of "path count" records into the given postings list,
+ * looking up the id of every path. The counts are not needed.
+ */
+static void parse_postings_line(indexer_t *indexer, postings_t *postings, char *line) {
+    char *save = NULL;
+    char *token = strtok_r(line, " ", &save);
+    bool is_path = true;
+    while (token != NULL) {
+        if (is_path) {
+            int id = get_document_id(indexer, token);
+            if (id >= 0) {
+                append_posting(postings, (uint32_t) id);
+            }
+        }
+        is_path = !is_path;
+        token = strtok_r(NULL, " ", &save);
+    }
+}
+
+/*
+ * Parses a single "<list>" or "<bitmap>" block of an index file into a
+ * postings list.
+ */
+postings_t *parse_postings_block(indexer_t *indexer, char *block) {
+    char *end = strchr(block, '\n');
+    bool is_bitmap = strncmp(block, "<bitmap> ", 9) == 0;
+    if (end == NULL || (!is_bitmap && strncmp(block, "<list> ", 7) != 0)) {
+        return NULL;
+    }
+    roaring_t *bitmap = is_bitmap ? create_roaring() : NULL;
+    postings_t *postings = is_bitmap ? NULL : create_postings(16);
+    char *line = end + 1;
+    while (*line != '\0') {
+        end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+        if (strncmp(line, "</", 2) == 0) {
+            break;
+        } else if (is_bitmap) {
+            /* blocks with a directory always come from a single, unappended
+             * document section, so their ids need no shifting */
+            parse_bitmap_line(bitmap, line, 0);
+        } else {
+            parse_postings_line(indexer, postings, line);
+        }
+        if (end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+    if (is_bitmap) {
+        return create_bitmap_postings(bitmap, true);
+    }
+    sort_postings(postings);
+    return postings;
+}
+
+/*
+ * Reads the token filters an index file was built with, from its first line.
+ */
+bool read_index_filter(char *file_path, token_filter_t *filter) {
+    memset(filter, 0, sizeof(token_filter_t));
+    FILE *file = fopen(file_path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[TOKEN_FILTER_SPEC_SIZE + 16];
+    if (fgets(line, sizeof(line), file) != NULL && strncmp(line, "<filters> ", 10) == 0) {
+        line[strcspn(line, "\n")] = '\0';
+        parse_token_filter(filter, line + 10);
+    }
+    fclose(file);
+    return true;
+}
@@ -3,11 +3,29 @@
 
 #include "sorted_list.h"
 #include "indexer.h"
+#include "postings.h"
 
 /*
  * Parses and loads an indexer into memory, given the file path
- * of the indexer file.
+ * of the indexer file and the number of threads to parse it with.
+ * Returns NULL if the file can't be read.
  */
-indexer_t *parse_indexer_file(char *);
+indexer_t *parse_indexer_file(char *, int);
+
+/*
+ * Parses a single "<list>" or "<bitmap>" block of an index file into a
+ * postings list, given the indexer whose document table the ids refer to,
+ * and the text of the block (which is modified). Returns NULL if the text
+ * is not a block. The caller is responsible for freeing the postings list.
+ */
+postings_t *parse_postings_block(indexer_t *, char *);
+
+/*
+ * Reads the token filters an index file was built with, given the path of
+ * the file and the filter to fill in, which is left empty if the file has
+ * none. Only the start of the file is read, since the filters are written
+ * there. Returns false if the file can't be read.
+ */
+bool read_index_filter(char *, token_filter_t *);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "index_set.h"
+#include "index_parser.h"
+#include "index_directory.h"
+#include "packed_index.h"
+#include "postings.h"
+
+/*
+ * The number of bytes of decoded postings that are cached, for indexes that
+ * are loaded on demand. The cache is split evenly between shards.
+ */
+#ifndef POSTINGS_CACHE_SIZE
+#define POSTINGS_CACHE_SIZE (64 << 20)
+#endif
+
+/*
+ * The state of a single per-indexer task, run on its own thread.
+ */
+typedef struct index_task {
+    char *file_path;
+    size_t cache_size;
+    int thread_count;
+    indexer_t *indexer;
+    index_search_function_t *function;
+    void *argument;
+    list_t *results;
+} index_task_t;
+
+/*
+ * Loads a single index file, given its path, the size of its postings cache
+ * and the number of threads to parse it with. Returns NULL if it could not
+ * be loaded.
+ */
+static indexer_t *load_index_file(char *file_path, size_t cache_size, int thread_count) {
+    /* if the index has a term directory, only the directory is loaded and
+     * postings are read when a query needs them */
+    indexer_t *indexer = load_index_directory(file_path, cache_size);
+    if (indexer != NULL) {
+        return indexer;
+    }
+    indexer = parse_indexer_file(file_path, thread_count);
+    if (indexer != NULL) {
+        /* the query engine works with document ids, so we number the documents
+         * and turn the postings of high-frequency terms into bitmaps, then
+         * pack the entries, which are only ever read from now on */
+        index_documents(indexer);
+        compress_postings(indexer);
+        pack_indexer(indexer);
+    }
+    return indexer;
+}
+
+/*
+ * Destroys an indexer that was loaded by load_index_file.
+ */
+static void destroy_loaded_indexer(indexer_t *indexer) {
+    if (indexer->directory != NULL) {
+        destroy_index_directory(indexer->directory);
+    }
+    if (indexer->packed != NULL) {
+        destroy_packed_index(indexer->packed);
+    }
+    if (indexer->trigrams != NULL) {
+        destroy_loaded_indexer(indexer->trigrams);
+        indexer->trigrams = NULL;
+    }
+    destroy_indexer(indexer);
+}
+
+static void *load_task(void *argument) {
+    index_task_t *task = argument;
+    task->indexer = load_index_file(task->file_path, task->cache_size, task->thread_count);
+    if (task->indexer == NULL) {
+        return NULL;
+    }
+    /* the trigram index is optional, and only needed by pattern searches */
+    char *trigram_path = create_trigram_path(task->file_path);
+    if (access(trigram_path, F_OK) != -1) {
+        task->indexer->trigrams = load_index_file(trigram_path, task->cache_size, task->thread_count);
+        if (task->indexer->trigrams == NULL) {
+            fprintf(stderr, "Warning: Could not load the trigram index '%s'.\n", trigram_path);
+        }
+    }
+    free(trigram_path);
+    return NULL;
+}
+
+static void *search_task(void *argument) {
+    index_task_t *task = argument;
+    task->function(task->indexer, task->argument, task->results);
+    return NULL;
+}
+
+/*
+ * Runs the given task function for every task, each on its own thread.
+ * A single task is run on the calling thread.
+ */
+static void run_tasks(index_task_t *tasks, int count, void *(*function)(void *)) {
+    if (count == 1) {
+        function(&tasks[0]);
+        return;
+    }
+    pthread_t *threads = malloc(count * sizeof(pthread_t));
+    bool *started = malloc(count * sizeof(bool));
+    int i;
+    for (i = 0; i < count; i++) {
+        /* if we can't start a thread, we just run the task ourselves */
+        started[i] = pthread_create(&threads[i], NULL, function, &tasks[i]) == 0;
+        if (!started[i]) {
+            function(&tasks[i]);
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+}
+
+/*
+ * Loads an index set, given the path of an index file or of a sharded index.
+ */
+index_set_t *load_index_set(char *file_path) {
+    /* first we figure out which files make up the index */
+    int count = 0;
+    char **file_paths = NULL;
+    if (access(file_path, F_OK) != -1) {
+        file_paths = malloc(sizeof(char *));
+        file_paths[count++] = file_path;
+    } else {
+        while (true) {
+            char *shard_path = create_shard_path(file_path, count);
+            if (access(shard_path, F_OK) == -1) {
+                free(shard_path);
+                break;
+            }
+            file_paths = realloc(file_paths, (count + 1) * sizeof(char *));
+            file_paths[count++] = shard_path;
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "Error: Problem opening file.\n");
+        return NULL;
+    }
+
+    /* next, we load every file in parallel */
+    index_task_t *tasks = malloc(count * sizeof(index_task_t));
+    /* the cores are split between shards, since they're loaded in parallel too */
+    long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = core_count > count ? (int) (core_count / count) : 1;
+    int i;
+    for (i = 0; i < count; i++) {
+        tasks[i].file_path = file_paths[i];
+        tasks[i].cache_size = POSTINGS_CACHE_SIZE / count;
+        tasks[i].thread_count = thread_count;
+    }
+    run_tasks(tasks, count, &load_task);
+
+    index_set_t *set = malloc(sizeof(index_set_t));
+    set->indexers = malloc(count * sizeof(indexer_t *));
+    set->count = count;
+    set->disjoint = true;
+    set->references = 1;
+    bool success = true;
+    for (i = 0; i < count; i++) {
+        set->indexers[i] = tasks[i].indexer;
+        success = success && tasks[i].indexer != NULL;
+        if (file_paths[i] != file_path) {
+            free(file_paths[i]);
+        }
+    }
+    free(file_paths);
+    free(tasks);
+    if (!success) {
+        destroy_index_set(set);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Destroys an index set and every indexer in it.
+ */
+void destroy_index_set(index_set_t *set) {
+    int i;
+    for (i = 0; i < set->count; i++) {
+        if (set->indexers[i] != NULL) {
+            destroy_loaded_indexer(set->indexers[i]);
+        }
+    }
+    free(set->indexers);
+    free(set);
+}
+
+/*
+ * Merges the per-indexer result lists, which are each sorted, into the empty
+ * final result list, and destroys them. The first of their heads is moved
+ * over until they are all empty, and a result that is already the last one
+ * moved over (a document of several of the indexers) is dropped.
+ */
+static void merge_results(list_t *results, list_t **partial_results, int count) {
+    list_element_t *tail = NULL;
+    while (true) {
+        int first = -1;
+        int i;
+        for (i = 0; i < count; i++) {
+            if (partial_results[i]->head != NULL && (first == -1 || results->compare_function(
+                    partial_results[i]->head->value, partial_results[first]->head->value) > 0)) {
+                first = i;
+            }
+        }
+        if (first == -1) {
+            break;
+        }
+        list_element_t *element = partial_results[first]->head;
+        partial_results[first]->head = element->next;
+        if (tail != NULL && results->compare_function(tail->value, element->value) == 0) {
+            destroy_list_element(results, element);
+            continue;
+        }
+        element->next = NULL;
+        if (tail == NULL) {
+            results->head = element;
+        } else {
+            tail->next = element;
+        }
+        tail = element;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        free(partial_results[i]);
+    }
+}
+
+/*
+ * Runs a search over every indexer of the set in parallel, and merges the
+ * per-indexer results.
+ */
+void search_index_set(index_set_t *set, index_search_function_t *function,
+        void *argument, list_t *results) {
+    if (set->count == 1) {
+        function(set->indexers[0], argument, results);
+        return;
+    }
+    index_task_t *tasks = malloc(set->count * sizeof(index_task_t));
+    int i;
+    for (i = 0; i < set->count; i++) {
+        tasks[i].indexer = set->indexers[i];
+        tasks[i].function = function;
+        tasks[i].argument = argument;
+        tasks[i].results = create_list(results->compare_function, results->destroy_function);
+    }
+    run_tasks(tasks, set->count, &search_task);
+    list_t **partial_results = malloc(set->count * sizeof(list_t *));
+    for (i = 0; i < set->count; i++) {
+        partial_results[i] = tasks[i].results;
+    }
+    merge_results(results, partial_results, set->count);
+    free(partial_results);
+    free(tasks);
+}
@@ -0,0 +1,50 @@
+#ifndef _INDEX_SET_H_
+#define _INDEX_SET_H_
+
+#include "sorted_list.h"
+#include "indexer.h"
+
+/*
+ * A set of indexers that are searched together, such as the shards of
+ * a partitioned index, or several separately built indexes.
+ */
+typedef struct index_set {
+    indexer_t **indexers;
+    int count;
+    /* whether no document can be in more than one of the indexers, which
+     * holds for the shards of a single index */
+    bool disjoint;
+    /* the number of holders of the set, when it is shared through an
+     * index handle (see index_handle.h) */
+    int references;
+} index_set_t;
+
+/*
+ * Loads an index set, given the path of an index file. If there is no file
+ * at that path, its shards ("<path>.0", "<path>.1", ...) are loaded in
+ * parallel instead. The trigram index of every file ("<path>.tri") is
+ * loaded too, if it exists. Returns NULL if nothing could be loaded.
+ */
+index_set_t *load_index_set(char *);
+
+/*
+ * Destroys an index set and every indexer in it.
+ */
+void destroy_index_set(index_set_t *);
+
+/*
+ * A search over a single indexer, given the indexer, an argument, and the
+ * empty list to put the results into, in the order of the list. Implemented
+ * by the caller.
+ */
+typedef void index_search_function_t(indexer_t *, void *, list_t *);
+
+/*
+ * Runs a search over every indexer of the set in parallel, given the set,
+ * the search function, its argument, and the empty list to merge the
+ * results into. The sorted results of the indexers are merged in a single
+ * pass, and a document found in several indexes is only listed once.
+ */
+void search_index_set(index_set_t *, index_search_function_t *, void *, list_t *);
+
+#endif
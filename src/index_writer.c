@@ -0,0 +1,512 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "index_writer.h"
+#include "term_hash.h"
+
+/*
+ * Size of the output buffer the writer thread formats into.
+ */
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+/*
+ * Maximum number of ranges that may be queued before the producer blocks.
+ */
+#define WRITER_QUEUE_SIZE 16
+
+/*
+ * Number of entries handed to the writer thread at a time by write_indexer.
+ */
+#define WRITER_RANGE_SIZE 4096
+
+/*
+ * A finished range of entries, waiting to be serialized.
+ */
+typedef struct index_range {
+    indexer_entry_t **entries;
+    int count;
+} index_range_t;
+
+/*
+ * Where the block of an entry was written, for the term directory.
+ */
+typedef struct directory_record {
+    indexer_entry_t *entry;
+    long offset;
+    long length;
+} directory_record_t;
+
+struct index_writer {
+    FILE *file;
+    indexer_t *indexer;
+    /* set when high-frequency terms are written as bitmaps */
+    bool bitmaps;
+    /* set when the file already holds an index, whose filters apply to
+     * what is appended to it as well */
+    bool appending;
+    char *buffer;
+    size_t buffer_size;
+    /* the number of bytes written to the file so far */
+    long written;
+    bool failed;
+
+    /* the block of every entry that was written, in order */
+    directory_record_t *records;
+    int record_count;
+    int record_capacity;
+
+    /* the queue of ranges shared between the producer and the writer thread */
+    index_range_t queue[WRITER_QUEUE_SIZE];
+    int queue_head;
+    int queue_size;
+    bool closing;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t thread;
+};
+
+/*
+ * Writes the buffered output to the file and empties the buffer.
+ */
+static void flush_buffer(index_writer_t *writer) {
+    if (writer->buffer_size > 0 && !writer->failed) {
+        if (fwrite(writer->buffer, 1, writer->buffer_size, writer->file) != writer->buffer_size) {
+            writer->failed = true;
+        }
+    }
+    writer->written += writer->buffer_size;
+    writer->buffer_size = 0;
+}
+
+/*
+ * Appends the given bytes to the output buffer, flushing it as needed.
+ */
+static void append_bytes(index_writer_t *writer, const char *bytes, size_t size) {
+    if (writer->buffer_size + size > WRITER_BUFFER_SIZE) {
+        flush_buffer(writer);
+        if (size > WRITER_BUFFER_SIZE) {
+            /* too large to ever fit in the buffer, so we write it directly */
+            if (!writer->failed && fwrite(bytes, 1, size, writer->file) != size) {
+                writer->failed = true;
+            }
+            writer->written += size;
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->buffer_size, bytes, size);
+    writer->buffer_size += size;
+}
+
+static void append_string(index_writer_t *writer, const char *string) {
+    append_bytes(writer, string, strlen(string));
+}
+
+static void append_char(index_writer_t *writer, char c) {
+    if (writer->buffer_size == WRITER_BUFFER_SIZE) {
+        flush_buffer(writer);
+    }
+    writer->buffer[writer->buffer_size++] = c;
+}
+
+/*
+ * Appends the decimal representation of an integer, the same way "%li" would.
+ */
+static void append_int(index_writer_t *writer, long value) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    /* we work with an unsigned magnitude so LONG_MIN doesn't overflow */
+    unsigned long magnitude = value < 0 ? 0ul - (unsigned long) value : (unsigned long) value;
+    do {
+        *--start = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--start = '-';
+    }
+    append_bytes(writer, start, (size_t) (end - start));
+}
+
+/*
+ * Serializes a single entry in the "<list>" text format.
+ */
+static void append_entry(index_writer_t *writer, indexer_entry_t *entry) {
+    append_string(writer, "<list> ");
+    append_string(writer, entry->token);
+    append_char(writer, '\n');
+    list_element_t *element = entry->records->head;
+    int record_counter = 0;
+    while (element != NULL) {
+        indexer_entry_record_t *record = element->value;
+        /* we only want 5 records per line */
+        if (record_counter == 5) {
+            record_counter = 0;
+            append_char(writer, '\n');
+        }
+        append_string(writer, record->file_path);
+        append_char(writer, ' ');
+        append_int(writer, record->count);
+        element = element->next;
+        /* if we have another record, we print a space to prefix it */
+        if (element != NULL) append_char(writer, ' ');
+        record_counter++;
+    }
+    append_string(writer, "\n</list>\n");
+}
+
+/*
+ * Appends a number in hexadecimal.
+ */
+static void append_hex(index_writer_t *writer, uint64_t value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char digits[16];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    do {
+        *--start = hex_digits[value & 15];
+        value >>= 4;
+    } while (value != 0);
+    append_bytes(writer, start, (size_t) (end - start));
+}
+
+/*
+ * Serializes the document table, five paths per line.
+ */
+static void append_documents(index_writer_t *writer, indexer_t *indexer) {
+    append_string(writer, "<documents> ");
+    append_int(writer, indexer->documents->count);
+    append_char(writer, '\n');
+    int i;
+    for (i = 0; i < indexer->documents->count; i++) {
+        append_string(writer, get_pooled_string(indexer->documents, i));
+        append_char(writer, (i % 5 == 4 || i == indexer->documents->count - 1) ? '\n' : ' ');
+    }
+    append_string(writer, "</documents>\n");
+}
+
+/*
+ * Serializes the token filters the index was built with, so the same ones
+ * can be applied to query terms. Nothing is written if there are none.
+ */
+static void append_filters(index_writer_t *writer, indexer_t *indexer) {
+    char spec[TOKEN_FILTER_SPEC_SIZE];
+    format_token_filter(&indexer->filter, spec, sizeof(spec));
+    if (spec[0] != '\0') {
+        append_string(writer, "<filters> ");
+        append_string(writer, spec);
+        append_char(writer, '\n');
+    }
+}
+
+/*
+ * Serializes a container as a line starting with its type and key, followed
+ * by its values (array), its run starts and lengths (run), or its words in
+ * hexadecimal (bitmap).
+ */
+static void append_container(index_writer_t *writer, roaring_container_t *container) {
+    int i;
+    append_char(writer, container->type == ROARING_ARRAY ? 'a' :
+            (container->type == ROARING_RUN ? 'r' : 'b'));
+    append_char(writer, ' ');
+    append_int(writer, container->key);
+    if (container->type == ROARING_BITMAP) {
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            append_char(writer, ' ');
+            append_hex(writer, container->words[i]);
+        }
+    } else {
+        int count = container->type == ROARING_RUN ? 2 * container->size : container->size;
+        for (i = 0; i < count; i++) {
+            append_char(writer, ' ');
+            append_int(writer, container->values[i]);
+        }
+    }
+    append_char(writer, '\n');
+}
+
+static int id_compare_function(const void *first, const void *second) {
+    uint32_t first_id = *(const uint32_t *) first;
+    uint32_t second_id = *(const uint32_t *) second;
+    return first_id < second_id ? -1 : (first_id > second_id ? 1 : 0);
+}
+
+/*
+ * Serializes a high-frequency entry as a "<bitmap>" block. The counts of its
+ * records are not kept.
+ */
+static void append_bitmap_entry(index_writer_t *writer, indexer_entry_t *entry) {
+    int size = get_size(entry->records);
+    uint32_t *ids = malloc((size + 1) * sizeof(uint32_t));
+    int count = 0;
+    list_element_t *element = entry->records->head;
+    while (element != NULL) {
+        int id = get_document_id(writer->indexer, ((indexer_entry_record_t *) element->value)->file_path);
+        if (id >= 0) {
+            ids[count++] = (uint32_t) id;
+        }
+        element = element->next;
+    }
+    qsort(ids, count, sizeof(uint32_t), &id_compare_function);
+    roaring_t *bitmap = create_roaring();
+    int i;
+    for (i = 0; i < count; i++) {
+        append_roaring(bitmap, ids[i]);
+    }
+    optimize_roaring(bitmap);
+    append_string(writer, "<bitmap> ");
+    append_string(writer, entry->token);
+    append_char(writer, '\n');
+    for (i = 0; i < bitmap->count; i++) {
+        append_container(writer, &bitmap->containers[i]);
+    }
+    append_string(writer, "</bitmap>\n");
+    destroy_roaring(bitmap);
+    free(ids);
+}
+
+/*
+ * Gets the offset in the file of the next byte to be written.
+ */
+static long get_offset(index_writer_t *writer) {
+    return writer->written + (long) writer->buffer_size;
+}
+
+/*
+ * Remembers where the block of an entry was written.
+ */
+static void add_directory_record(index_writer_t *writer, indexer_entry_t *entry, long offset) {
+    if (writer->record_count == writer->record_capacity) {
+        writer->record_capacity = writer->record_capacity == 0 ? 1024 : writer->record_capacity * 2;
+        writer->records = realloc(writer->records, writer->record_capacity * sizeof(directory_record_t));
+    }
+    directory_record_t *record = &writer->records[writer->record_count++];
+    record->entry = entry;
+    record->offset = offset;
+    record->length = get_offset(writer) - offset;
+}
+
+/*
+ * Serializes a term hash over the tokens of the directory: the number of
+ * terms and buckets and the seed, then the pilot of every bucket and the
+ * fingerprint of every slot, so a reader doesn't have to search for the
+ * pilots again. Nothing is written if no hash could be built.
+ */
+static void append_hash(index_writer_t *writer) {
+    char **tokens = malloc((writer->record_count > 0 ? writer->record_count : 1) * sizeof(char *));
+    int i;
+    for (i = 0; i < writer->record_count; i++) {
+        tokens[i] = writer->records[i].entry->token;
+    }
+    term_hash_t *hash = create_term_hash(tokens, writer->record_count);
+    free(tokens);
+    if (hash == NULL) {
+        return;
+    }
+    append_string(writer, "<hash> ");
+    append_int(writer, hash->count);
+    append_char(writer, ' ');
+    append_int(writer, hash->bucket_count);
+    append_char(writer, ' ');
+    append_hex(writer, hash->seed);
+    append_char(writer, '\n');
+    /* both go sixteen to a line, in hexadecimal */
+    for (i = 0; i < hash->bucket_count; i++) {
+        append_hex(writer, hash->pilots[i]);
+        append_char(writer, i % 16 == 15 || i == hash->bucket_count - 1 ? '\n' : ' ');
+    }
+    for (i = 0; i < hash->count; i++) {
+        append_hex(writer, hash->slots[i].fingerprint);
+        append_char(writer, i % 16 == 15 || i == hash->count - 1 ? '\n' : ' ');
+    }
+    append_string(writer, "</hash>\n");
+    destroy_term_hash(hash);
+}
+
+/*
+ * Serializes the term directory: a line per entry with the offset and length
+ * of its block, its document frequency, and its token, followed by the
+ * document table that the ids of the blocks refer to and the term hash.
+ */
+static void append_directory(index_writer_t *writer, long index_size) {
+    append_filters(writer, writer->indexer);
+    append_string(writer, "<directory> ");
+    append_int(writer, index_size);
+    append_char(writer, ' ');
+    append_int(writer, writer->record_count);
+    append_char(writer, '\n');
+    int i;
+    for (i = 0; i < writer->record_count; i++) {
+        directory_record_t *record = &writer->records[i];
+        append_int(writer, record->offset);
+        append_char(writer, ' ');
+        append_int(writer, record->length);
+        append_char(writer, ' ');
+        append_int(writer, get_entry_frequency(record->entry));
+        append_char(writer, ' ');
+        append_string(writer, record->entry->token);
+        append_char(writer, '\n');
+    }
+    append_string(writer, "</directory>\n");
+    append_documents(writer, writer->indexer);
+    append_hash(writer);
+}
+
+/*
+ * The writer thread. Pops finished ranges off the queue and serializes them
+ * until the writer is closed and the queue is drained.
+ */
+static void *writer_thread(void *argument) {
+    index_writer_t *writer = argument;
+    if (!writer->appending) {
+        append_filters(writer, writer->indexer);
+    }
+    if (writer->bitmaps) {
+        append_documents(writer, writer->indexer);
+    }
+    while (true) {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->queue_size == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->queue_size == 0) {
+            /* we're closing and there's nothing left to write */
+            pthread_mutex_unlock(&writer->lock);
+            break;
+        }
+        index_range_t range = writer->queue[writer->queue_head];
+        writer->queue_head = (writer->queue_head + 1) % WRITER_QUEUE_SIZE;
+        writer->queue_size--;
+        pthread_cond_signal(&writer->not_full);
+        pthread_mutex_unlock(&writer->lock);
+
+        int i;
+        for (i = 0; i < range.count; i++) {
+            indexer_entry_t *entry = range.entries[i];
+            long offset = get_offset(writer);
+            if (writer->bitmaps && is_roaring_worthwhile(get_entry_frequency(entry),
+                    writer->indexer->documents->count)) {
+                append_bitmap_entry(writer, entry);
+            } else {
+                append_entry(writer, entry);
+            }
+            add_directory_record(writer, entry, offset);
+        }
+        free(range.entries);
+    }
+    flush_buffer(writer);
+    return NULL;
+}
+
+/*
+ * Creates an index writer for the given (already opened) file and starts
+ * its writer thread. Returns NULL if the writer could not be started.
+ */
+index_writer_t *create_index_writer(FILE *file, indexer_t *indexer, bool bitmaps) {
+    index_writer_t *writer = malloc(sizeof(index_writer_t));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->buffer = malloc(WRITER_BUFFER_SIZE);
+    if (writer->buffer == NULL) {
+        free(writer);
+        return NULL;
+    }
+    writer->file = file;
+    writer->indexer = indexer;
+    writer->bitmaps = bitmaps;
+    struct stat file_stat;
+    writer->appending = fstat(fileno(file), &file_stat) == 0 && file_stat.st_size > 0;
+    writer->buffer_size = 0;
+    writer->written = 0;
+    writer->failed = false;
+    writer->records = NULL;
+    writer->record_count = 0;
+    writer->record_capacity = 0;
+    writer->queue_head = 0;
+    writer->queue_size = 0;
+    writer->closing = false;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    if (pthread_create(&writer->thread, NULL, &writer_thread, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->not_empty);
+        pthread_cond_destroy(&writer->not_full);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/*
+ * Queues a finished range of entries to be written. Blocks while the queue
+ * is full, so the producer can't run arbitrarily far ahead of the writer.
+ */
+void write_index_entries(index_writer_t *writer, indexer_entry_t **entries, int count) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_size == WRITER_QUEUE_SIZE) {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    int tail = (writer->queue_head + writer->queue_size) % WRITER_QUEUE_SIZE;
+    writer->queue[tail].entries = entries;
+    writer->queue[tail].count = count;
+    writer->queue_size++;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/*
+ * Writes every remaining range, flushes the output, stops the writer
+ * thread, writes the term directory if a file was given for it, and
+ * destroys the writer. Returns false if any write failed.
+ */
+bool close_index_writer(index_writer_t *writer, FILE *directory_file) {
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = true;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    bool success = !writer->failed && fflush(writer->file) == 0;
+    if (success && directory_file != NULL) {
+        /* the directory goes through the same buffer, now that the index is done */
+        long index_size = writer->written;
+        writer->file = directory_file;
+        append_directory(writer, index_size);
+        flush_buffer(writer);
+        success = !writer->failed && fflush(directory_file) == 0;
+    }
+    free(writer->records);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_cond_destroy(&writer->not_full);
+    free(writer->buffer);
+    free(writer);
+    return success;
+}
+
+/*
+ * Writes every entry of an indexer, in order, through a pipelined writer.
+ */
+bool write_indexer(indexer_t *indexer, FILE *file, bool bitmaps, FILE *directory_file) {
+    index_writer_t *writer = create_index_writer(file, indexer, bitmaps);
+    if (writer == NULL) {
+        return false;
+    }
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        /* we hand the entries to the writer thread in fixed size ranges */
+        indexer_entry_t **range = malloc(WRITER_RANGE_SIZE * sizeof(indexer_entry_t *));
+        int count = 0;
+        while (element != NULL && count < WRITER_RANGE_SIZE) {
+            range[count++] = element->value;
+            element = element->next;
+        }
+        write_index_entries(writer, range, count);
+    }
+    return close_index_writer(writer, directory_file);
+}
@@ -0,0 +1,60 @@
+#ifndef _INDEX_WRITER_H_
+#define _INDEX_WRITER_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "indexer.h"
+
+/*
+ * A pipelined index writer. Finished ranges of indexer entries are handed
+ * to a writer thread, which serializes them into large output buffers
+ * while the caller keeps preparing the ranges that come after them.
+ */
+typedef struct index_writer index_writer_t;
+
+/*
+ * Creates an index writer for the given (already opened) file and starts
+ * its writer thread, given the file, the indexer whose entries will be
+ * written (its document table must have been built), and whether
+ * high-frequency terms should be written as bitmaps. The token filters of
+ * the indexer are only written to an empty file: a file that already holds
+ * an index is appended to under its own filters, which must be the same
+ * (see read_index_filter). With bitmaps, the document table is written
+ * first, and the postings of every dense enough term are written as a
+ * "<bitmap>" block of document ids instead of as a "<list>" of records.
+ * Returns NULL if the writer could not be started.
+ */
+index_writer_t *create_index_writer(FILE *, indexer_t *, bool);
+
+/*
+ * Queues a finished range of entries to be written, given the writer, an
+ * array of entries in output order, and the number of entries. The writer
+ * takes ownership of the array, but not of the entries themselves, which
+ * must stay alive until the writer is closed.
+ */
+void write_index_entries(index_writer_t *, indexer_entry_t **, int);
+
+/*
+ * Writes every remaining range, flushes the output, stops the writer
+ * thread and destroys the writer, given the writer and the file to write
+ * the term directory to, or NULL. The directory gives the offset, length
+ * and document frequency of every term's block in the index file, followed
+ * by the document table and a term hash over the tokens (see term_hash.h),
+ * so a reader can find a term and load its postings without parsing the
+ * whole index (see index_directory.h). Returns false
+ * if any write failed.
+ */
+bool close_index_writer(index_writer_t *, FILE *);
+
+/*
+ * Convenience function that writes every entry of an indexer, in order,
+ * through a pipelined writer, given the indexer, the file, whether
+ * high-frequency terms should be written as bitmaps, and the file to write
+ * the term directory to, or NULL. The indexer's document table must have
+ * been built, since bitmaps and the directory refer to document ids, and
+ * the indexer is only read, so it can be searched while it is written.
+ * Returns false if any write failed.
+ */
+bool write_indexer(indexer_t *, FILE *, bool, FILE *);
+
+#endif
@@ -1,11 +1,25 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "indexer.h"
 #include "tokenizer.h"
+#include "hash.h"
+#include "file_reader.h"
+#include "file_walker.h"
+#include "trigram.h"
+#include "radix_sort.h"
+
+/*
+ * The number of entries a thread takes at a time when the records of a
+ * finished run are sorted.
+ */
+#ifndef RECORD_SORT_BATCH
+#define RECORD_SORT_BATCH 256
+#endif
 
 /*
 * Creates an indexer entry record, given the file path. The caller is
@@ -70,6 +84,7 @@ indexer_entry_t *create_indexer_entry(char *token) {
             &record_destroy_function);
     entry->token = malloc(strlen(token) + sizeof(char));
     strcpy(entry->token, token);
+    entry->bitmap = NULL;
     return entry;
 }
 
@@ -78,14 +93,148 @@ indexer_entry_t *create_indexer_entry(char *token) {
 */
 void destroy_indexer_entry(indexer_entry_t *entry) {
     destroy_list(entry->records);
+    if (entry->bitmap != NULL) {
+        destroy_roaring(entry->bitmap);
+    }
     free(entry->token);
     free(entry);
 }
 
+/*
+* The entries of an indexer's terms, and an open addressing table of their
+* positions plus one (or 0), so a term is found without walking the sorted
+* list of entries.
+*/
+typedef struct term_table {
+    indexer_entry_t **entries;
+    int count;
+    int capacity;
+    int *slots;
+    int slot_count;
+} term_table_t;
+
+/*
+* Creates an empty term table.
+*/
+static void init_term_table(term_table_t *table) {
+    table->entries = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->slot_count = 1024;
+    table->slots = calloc(table->slot_count, sizeof(int));
+}
+
+/*
+* Finds the slot of a term table that holds a term, or the empty slot where it
+* belongs.
+*/
+static int find_term_slot(term_table_t *table, char *token) {
+    int mask = table->slot_count - 1;
+    int slot = (int) (hash_string(token) & (uint64_t) mask);
+    while (table->slots[slot] != 0 && strcmp(table->entries[table->slots[slot] - 1]->token, token) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/*
+* Adds an entry to a term table, given the slot find_term_slot found for it.
+*/
+static void add_term_entry(term_table_t *table, int slot, indexer_entry_t *entry) {
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity == 0 ? 1024 : table->capacity * 2;
+        table->entries = realloc(table->entries, table->capacity * sizeof(indexer_entry_t *));
+    }
+    table->entries[table->count++] = entry;
+    table->slots[slot] = table->count;
+    if (table->count * 2 > table->slot_count) {
+        /* we keep the table at most half full, so we grow and rehash it */
+        table->slot_count *= 2;
+        table->slots = realloc(table->slots, table->slot_count * sizeof(int));
+        memset(table->slots, 0, table->slot_count * sizeof(int));
+        int i;
+        for (i = 0; i < table->count; i++) {
+            table->slots[find_term_slot(table, table->entries[i]->token)] = i + 1;
+        }
+    }
+}
+
+/*
+* Gets the entry of a term from a term table, creating it if needed.
+*/
+static indexer_entry_t *get_term_entry(term_table_t *table, char *token) {
+    int slot = find_term_slot(table, token);
+    if (table->slots[slot] != 0) {
+        return table->entries[table->slots[slot] - 1];
+    }
+    indexer_entry_t *entry = create_indexer_entry(token);
+    add_term_entry(table, slot, entry);
+    return entry;
+}
+
+/*
+* Takes the entry at a position out of a term table. The last entry takes
+* its position, and the slots after its own are shifted back, so no slot is
+* left empty between a term and the slot it hashes to.
+*/
+static void remove_term_entry(term_table_t *table, int position) {
+    int mask = table->slot_count - 1;
+    int slot = find_term_slot(table, table->entries[position]->token);
+    table->slots[slot] = 0;
+    int next = (slot + 1) & mask;
+    while (table->slots[next] != 0) {
+        int home = (int) (hash_string(table->entries[table->slots[next] - 1]->token) & (uint64_t) mask);
+        /* a term can move back to the empty slot unless its own slot lies
+         * between the empty slot and where it is now */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            table->slots[slot] = table->slots[next];
+            table->slots[next] = 0;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    int last = --table->count;
+    if (position != last) {
+        table->entries[position] = table->entries[last];
+        table->slots[find_term_slot(table, table->entries[position]->token)] = position + 1;
+    }
+}
+
+/*
+* The records a document of a live indexer has, each with the entry it is
+* in, so the document is removed without looking through other documents.
+*/
+typedef struct live_document {
+    indexer_entry_t **entries;
+    indexer_entry_record_t **records;
+    int count;
+    int capacity;
+} live_document_t;
+
+/*
+* The entries of a live indexer, by term, with the number of live and of
+* removed records of each (by position in the term table), and the records
+* of every document (by document id).
+*/
+typedef struct live_index {
+    term_table_t terms;
+    int *record_counts;
+    int *removed_counts;
+    int count_capacity;
+    live_document_t *documents;
+    int document_capacity;
+} live_index_t;
+
 /*
 * Gets an index entry, given the token. Returns NULL if it does not exist.
+* The entries of a live indexer are looked up in its term table.
 */
 indexer_entry_t *get_indexer_entry(indexer_t *indexer, char *token) {
+    if (indexer->live != NULL) {
+        term_table_t *terms = &indexer->live->terms;
+        int slot = find_term_slot(terms, token);
+        return terms->slots[slot] != 0 ? terms->entries[terms->slots[slot] - 1] : NULL;
+    }
     list_iterator_t *iterator = create_iterator(indexer->entries);
     indexer_entry_t *entry = get_item(iterator);
     while (entry != NULL) {
@@ -99,6 +248,24 @@ indexer_entry_t *get_indexer_entry(indexer_t *indexer, char *token) {
     return NULL;
 }
 
+/*
+* Gets the number of documents an entry's token appears in. Records of
+* documents that were removed from a live indexer don't count.
+*/
+long get_entry_frequency(indexer_entry_t *entry) {
+    if (entry->bitmap != NULL) {
+        return entry->bitmap->cardinality;
+    }
+    long frequency = 0;
+    list_element_t *element = entry->records->head;
+    for (; element != NULL; element = element->next) {
+        if (((indexer_entry_record_t *) element->value)->file_path != NULL) {
+            frequency++;
+        }
+    }
+    return frequency;
+}
+
 /*
 * Comparison function for indexer entries that are inside a list.
 */
@@ -123,6 +290,12 @@ indexer_t *create_indexer() {
     indexer_t *indexer = malloc(sizeof(indexer_t));
     indexer->entries = create_list(&entry_compare_function,
             &entry_destroy_function);
+    indexer->documents = create_string_pool();
+    indexer->directory = NULL;
+    indexer->packed = NULL;
+    indexer->trigrams = NULL;
+    indexer->live = NULL;
+    memset(&indexer->filter, 0, sizeof(token_filter_t));
     return indexer;
 }
 
@@ -131,19 +304,184 @@ indexer_t *create_indexer() {
 */
 void destroy_indexer(indexer_t *indexer) {
     destroy_list(indexer->entries);
+    if (indexer->live != NULL) {
+        live_index_t *live = indexer->live;
+        int i;
+        for (i = 0; i < live->terms.count; i++) {
+            destroy_indexer_entry(live->terms.entries[i]);
+        }
+        for (i = 0; i < indexer->documents->count; i++) {
+            free(live->documents[i].entries);
+            free(live->documents[i].records);
+        }
+        free(live->terms.entries);
+        free(live->terms.slots);
+        free(live->record_counts);
+        free(live->removed_counts);
+        free(live->documents);
+        free(live);
+    }
+    destroy_string_pool(indexer->documents);
+    if (indexer->trigrams != NULL) {
+        destroy_indexer(indexer->trigrams);
+    }
     free(indexer);
 }
 
+/*
+* Comparison function for qsort over an array of strings.
+*/
+static int string_compare_function(const void *first, const void *second) {
+    return strcmp(*(char * const *) first, *(char * const *) second);
+}
 
 /*
- * Converts an uppercase letter character to its lowercase equivalent.
- */
-static int to_lower_case(int c) {
-    if (c >= 'A' && c <= 'Z') {
-        c -= 'A';
-        c += 'a';
+* Renumbers the bitmaps of an indexer, given the new id of every old id.
+*/
+static void renumber_bitmaps(indexer_t *indexer, int *new_ids) {
+    list_element_t *entry_element = indexer->entries->head;
+    while (entry_element != NULL) {
+        indexer_entry_t *entry = entry_element->value;
+        if (entry->bitmap != NULL) {
+            uint32_t *ids = malloc((entry->bitmap->cardinality + 1) * sizeof(uint32_t));
+            roaring_to_array(entry->bitmap, ids);
+            roaring_t *bitmap = create_roaring();
+            long i;
+            for (i = 0; i < entry->bitmap->cardinality; i++) {
+                append_roaring(bitmap, (uint32_t) new_ids[ids[i]]);
+            }
+            optimize_roaring(bitmap);
+            destroy_roaring(entry->bitmap);
+            entry->bitmap = bitmap;
+            free(ids);
+        }
+        entry_element = entry_element->next;
     }
-    return c;
+}
+
+/*
+* Builds the document table of an indexer. The paths are copied into a new
+* string pool owned by the indexer.
+*/
+void index_documents(indexer_t *indexer) {
+    /* first we collect the path of every record and every loaded document */
+    string_pool_t *old_documents = indexer->documents;
+    int capacity = old_documents->count + 64;
+    int count = 0;
+    char **paths = malloc(capacity * sizeof(char *));
+    int i;
+    for (i = 0; i < old_documents->count; i++) {
+        paths[count++] = get_pooled_string(old_documents, i);
+    }
+    list_element_t *entry_element = indexer->entries->head;
+    while (entry_element != NULL) {
+        indexer_entry_t *entry = entry_element->value;
+        list_element_t *record_element = entry->records->head;
+        while (record_element != NULL) {
+            if (count == capacity) {
+                capacity *= 2;
+                paths = realloc(paths, capacity * sizeof(char *));
+            }
+            paths[count++] = ((indexer_entry_record_t *) record_element->value)->file_path;
+            record_element = record_element->next;
+        }
+        entry_element = entry_element->next;
+    }
+    /* next, we sort them and drop the duplicates */
+    qsort(paths, count, sizeof(char *), &string_compare_function);
+    indexer->documents = create_string_pool();
+    for (i = 0; i < count; i++) {
+        if (i == 0 || strcmp(paths[i - 1], paths[i]) != 0) {
+            add_pooled_string(indexer->documents, paths[i]);
+        }
+    }
+    trim_string_pool(indexer->documents);
+    free(paths);
+    /* bitmaps loaded from the file still use the old ids, so we renumber them */
+    if (old_documents->count > 0) {
+        int *new_ids = malloc(old_documents->count * sizeof(int));
+        bool changed = false;
+        for (i = 0; i < old_documents->count; i++) {
+            new_ids[i] = get_document_id(indexer, get_pooled_string(old_documents, i));
+            changed = changed || new_ids[i] != i;
+        }
+        if (changed) {
+            renumber_bitmaps(indexer, new_ids);
+        }
+        free(new_ids);
+    }
+    destroy_string_pool(old_documents);
+}
+
+/*
+* Gets the id of a document, given its path, by binary searching the
+* document table. Returns -1 if it does not exist.
+*/
+int get_document_id(indexer_t *indexer, char *file_path) {
+    int low = 0;
+    int high = indexer->documents->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int result = strcmp(get_pooled_string(indexer->documents, middle), file_path);
+        if (result == 0) {
+            return middle;
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+/*
+* Adds a document to the document table of an indexer, keeping it sorted.
+* The records of the documents of a live indexer move along with their ids.
+*/
+int add_document(indexer_t *indexer, char *file_path) {
+    int low = 0;
+    int high = indexer->documents->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int result = strcmp(get_pooled_string(indexer->documents, middle), file_path);
+        if (result == 0) {
+            return middle;
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    live_index_t *live = indexer->live;
+    if (live != NULL) {
+        if (indexer->documents->count == live->document_capacity) {
+            live->document_capacity *= 2;
+            live->documents = realloc(live->documents, live->document_capacity * sizeof(live_document_t));
+        }
+        memmove(&live->documents[low + 1], &live->documents[low],
+                (indexer->documents->count - low) * sizeof(live_document_t));
+        memset(&live->documents[low], 0, sizeof(live_document_t));
+    }
+    return insert_pooled_string(indexer->documents, low, file_path);
+}
+
+/*
+* Removes a document from the document table of an indexer, keeping it
+* sorted.
+*/
+void drop_document(indexer_t *indexer, char *file_path) {
+    int id = get_document_id(indexer, file_path);
+    if (id == -1) {
+        return;
+    }
+    live_index_t *live = indexer->live;
+    if (live != NULL) {
+        free(live->documents[id].entries);
+        free(live->documents[id].records);
+        memmove(&live->documents[id], &live->documents[id + 1],
+                (indexer->documents->count - id - 1) * sizeof(live_document_t));
+    }
+    remove_pooled_string(indexer->documents, id);
 }
 
 /*
@@ -164,10 +502,10 @@ static char *read_file(char *file_path) {
                 char *current_index = data;
                 int current;
                 while ((current = fgetc(file)) != EOF) {
-                    sprintf(current_index, "%c", to_lower_case(current));
+                    sprintf(current_index, "%c", current);
                     current_index += sizeof(char);
                 }
-                sprintf(data + file_size, "%c", '\0');
+                data[file_size] = '\0';
                 /* once we've read the file's contents, we can close it */
                 fclose(file);
                 return data;
@@ -188,92 +526,927 @@ static char *read_file(char *file_path) {
     return NULL;
 }
 
-static void handle_token(indexer_t *indexer, char *file_path, char *token) {
-    /* we check for an instance of this entry already in the indexer */
-    indexer_entry_t *entry = get_indexer_entry(indexer, token);
-    if (entry == NULL) {
-        /* if not, we create a new entry */
-        entry = create_indexer_entry(token);
-        insert_object(indexer->entries, entry);
-    }
-    /* we check for an instance of this record already in the indexer */
-    indexer_entry_record_t *record = get_indexer_entry_record(entry, file_path);
-    if (record == NULL) {
-        /* if not, we create a new record */
-        record = create_indexer_entry_record(file_path);
-        insert_object(entry->records, record);
+/*
+* Appends an element to the end of a list, given the current tail of the list
+* (or NULL if it is empty). Returns the new tail.
+*/
+static list_element_t *append_element(list_t *list, list_element_t *tail, list_element_t *element) {
+    element->next = NULL;
+    if (tail == NULL) {
+        list->head = element;
+    } else {
+        tail->next = element;
     }
-    record->count++; //TODO: We need a way of resorting these after..
+    return element;
 }
 
 /*
-* Parses a file given the indexer and the file path. This function will
-* add and update indexer entries for the given indexer.
+* The distinct terms of a file, in the order they first appear, and the
+* number of times each of them appears.
 */
-static bool parse_file(indexer_t *indexer, char *file_path) {
-    char *file_data = read_file(file_path);
-    if (file_data == NULL) {
-        return false;
-    }
+typedef struct term_vector {
+    indexer_entry_t **entries;
+    int *counts;
+    int count;
+} term_vector_t;
+
+/*
+* The distinct trigrams of a file, as positions in the trigram table of the
+* run, and the number of times each of them appears.
+*/
+typedef struct trigram_vector {
+    int *trigrams;
+    int *counts;
+    int count;
+} trigram_vector_t;
+
+/*
+* A file that was indexed, remembered so that later files with the same
+* contents can reuse its terms. Files are grouped by size, and the contents
+* of a file are only hashed once another file of the same size shows up.
+*/
+typedef struct indexed_file {
+    char *file_path;
+    size_t size;
+    uint64_t hash;
+    bool hashed;
+    term_vector_t terms;
+    trigram_vector_t trigrams;
+    /* the next file of the same size, or -1 */
+    int next;
+} indexed_file_t;
+
+/*
+* The state of a run of the indexer over many files: the indexed files, and
+* an open addressing table of the first file of every size (plus one, or 0).
+*/
+typedef struct indexer_run {
+    indexer_t *indexer;
+    indexed_file_t *files;
+    int file_count;
+    int file_capacity;
+    int *slots;
+    int slot_count;
+
+    /* the entries of the terms. Records are added to the front of an
+     * entry's list, and the entries and their records are only sorted once
+     * the run is done */
+    term_table_t terms;
+
+    /* the entries of the trigram index, if one is built, by trigram, with
+     * the last record of each, so records are appended without walking the
+     * list, and an open addressing table of their positions plus one (or 0).
+     * They are only sorted into the trigram indexer once the run is done */
+    uint32_t *trigram_keys;
+    indexer_entry_t **trigram_entries;
+    list_element_t **trigram_tails;
+    int trigram_count;
+    int trigram_capacity;
+    int *trigram_slots;
+    int trigram_slot_count;
+} indexer_run_t;
+
+/*
+* Counts the distinct terms of a file's contents, given the indexer, the term
+* table of its entries and the contents. Every token goes through the
+* indexer's filters first, and every term gets an indexer entry, which is
+* created if needed.
+*/
+static void count_terms(indexer_t *indexer, term_table_t *terms, char *file_data, term_vector_t *vector) {
     list_t *token_list = tokenize(file_data);
-    list_iterator_t *iterator = create_iterator(token_list);
-    if (iterator != NULL) {
-        char *token = get_item(iterator);
-        while (token != NULL) {
-            handle_token(indexer, file_path, token);
-            token = next_item(iterator);
+    int capacity = 16;
+    char **tokens = malloc(capacity * sizeof(char *));
+    vector->counts = malloc(capacity * sizeof(int));
+    vector->count = 0;
+    /* the tokens are counted in a hash table of positions plus one, or 0 */
+    int slot_count = 64;
+    int *slots = calloc(slot_count, sizeof(int));
+    list_element_t *element = token_list->head;
+    for (; element != NULL; element = element->next) {
+        char *token = element->value;
+        if (!filter_token(&indexer->filter, token)) {
+            continue;
+        }
+        int slot = (int) (hash_string(token) & (uint64_t) (slot_count - 1));
+        while (slots[slot] != 0 && strcmp(tokens[slots[slot] - 1], token) != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        if (slots[slot] != 0) {
+            vector->counts[slots[slot] - 1]++;
+            continue;
+        }
+        if (vector->count == capacity) {
+            capacity *= 2;
+            tokens = realloc(tokens, capacity * sizeof(char *));
+            vector->counts = realloc(vector->counts, capacity * sizeof(int));
+        }
+        tokens[vector->count] = token;
+        vector->counts[vector->count++] = 1;
+        slots[slot] = vector->count;
+        if (vector->count * 2 > slot_count) {
+            /* we keep the table at most half full, so we grow and rehash it */
+            slot_count *= 2;
+            slots = realloc(slots, slot_count * sizeof(int));
+            memset(slots, 0, slot_count * sizeof(int));
+            int i;
+            for (i = 0; i < vector->count; i++) {
+                slot = (int) (hash_string(tokens[i]) & (uint64_t) (slot_count - 1));
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & (slot_count - 1);
+                }
+                slots[slot] = i + 1;
+            }
         }
-        destroy_iterator(iterator);
     }
+    /* each term is looked up in the indexer once, however often it appears */
+    vector->entries = malloc((vector->count > 0 ? vector->count : 1) * sizeof(indexer_entry_t *));
+    int i;
+    for (i = 0; i < vector->count; i++) {
+        vector->entries[i] = get_term_entry(terms, tokens[i]);
+    }
+    free(slots);
+    free(tokens);
     destroy_list(token_list);
-    free(file_data);
-    return true;
 }
 
 /*
-* Iterates through files in a directory, given the path, and recursively adds and updates
-* entries for the given indexer.
+* Adds a record for a file to the front of the entry of every term of a term
+* vector, since records are only sorted once they're written.
+*/
+static void add_term_vector(char *file_path, term_vector_t *vector) {
+    int i;
+    for (i = 0; i < vector->count; i++) {
+        indexer_entry_record_t *record = create_indexer_entry_record(file_path);
+        record->count = vector->counts[i];
+        list_t *records = vector->entries[i]->records;
+        records->head = create_list_element(record, records->head);
+    }
+}
+
+static void free_term_vector(term_vector_t *vector) {
+    free(vector->entries);
+    free(vector->counts);
+}
+
+/*
+* Gets the position of an entry in the term table of a live indexer.
+*/
+static int get_live_position(live_index_t *live, indexer_entry_t *entry) {
+    return live->terms.slots[find_term_slot(&live->terms, entry->token)] - 1;
+}
+
+/*
+* Makes room for the record counts of every entry of a live indexer's term
+* table, and zeroes those of the entries from a position on.
+*/
+static void grow_live_counts(live_index_t *live, int start) {
+    if (live->count_capacity < live->terms.capacity) {
+        live->count_capacity = live->terms.capacity;
+        live->record_counts = realloc(live->record_counts, live->count_capacity * sizeof(int));
+        live->removed_counts = realloc(live->removed_counts, live->count_capacity * sizeof(int));
+    }
+    int i;
+    for (i = start; i < live->terms.count; i++) {
+        live->record_counts[i] = 0;
+        live->removed_counts[i] = 0;
+    }
+}
+
+/*
+* Remembers that a document of a live indexer has a record in an entry.
+*/
+static void add_live_record(live_index_t *live, live_document_t *document, indexer_entry_t *entry,
+        indexer_entry_record_t *record) {
+    if (document->count == document->capacity) {
+        document->capacity = document->capacity == 0 ? 16 : document->capacity * 2;
+        document->entries = realloc(document->entries, document->capacity * sizeof(indexer_entry_t *));
+        document->records = realloc(document->records, document->capacity * sizeof(indexer_entry_record_t *));
+    }
+    document->entries[document->count] = entry;
+    document->records[document->count++] = record;
+    live->record_counts[get_live_position(live, entry)]++;
+}
+
+/*
+* Makes an indexer live. Its entries are moved into a term table, and the
+* records of every document are collected from them.
+*/
+void start_live_indexer(indexer_t *indexer) {
+    live_index_t *live = calloc(1, sizeof(live_index_t));
+    init_term_table(&live->terms);
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        list_element_t *next = element->next;
+        indexer_entry_t *entry = element->value;
+        add_term_entry(&live->terms, find_term_slot(&live->terms, entry->token), entry);
+        free(element);
+        element = next;
+    }
+    indexer->entries->head = NULL;
+    grow_live_counts(live, 0);
+    live->document_capacity = indexer->documents->count + 64;
+    live->documents = calloc(live->document_capacity, sizeof(live_document_t));
+    int i;
+    for (i = 0; i < live->terms.count; i++) {
+        indexer_entry_t *entry = live->terms.entries[i];
+        for (element = entry->records->head; element != NULL; element = element->next) {
+            indexer_entry_record_t *record = element->value;
+            int id = get_document_id(indexer, record->file_path);
+            if (id >= 0) {
+                add_live_record(live, &live->documents[id], entry, record);
+            }
+        }
+    }
+    indexer->live = live;
+}
+
+/*
+* Gets the entries of a live indexer and their number.
+*/
+indexer_entry_t **get_live_entries(indexer_t *indexer, int *count) {
+    *count = indexer->live->terms.count;
+    return indexer->live->terms.entries;
+}
+
+/*
+* Indexes the contents of a single document of a live indexer, adding it to
+* the document table if needed.
+*/
+void index_document(indexer_t *indexer, char *file_path, char *file_data) {
+    live_index_t *live = indexer->live;
+    int id = add_document(indexer, file_path);
+    int term_count = live->terms.count;
+    term_vector_t vector;
+    count_terms(indexer, &live->terms, file_data, &vector);
+    grow_live_counts(live, term_count);
+    add_term_vector(file_path, &vector);
+    int i;
+    for (i = 0; i < vector.count; i++) {
+        add_live_record(live, &live->documents[id], vector.entries[i], vector.entries[i]->records->head->value);
+    }
+    free_term_vector(&vector);
+}
+
+/*
+* Drops the records of removed documents from an entry's list.
+*/
+static void clean_records(list_t *records) {
+    list_element_t **link = &records->head;
+    while (*link != NULL) {
+        list_element_t *element = *link;
+        if (((indexer_entry_record_t *) element->value)->file_path == NULL) {
+            *link = element->next;
+            destroy_list_element(records, element);
+        } else {
+            link = &element->next;
+        }
+    }
+}
+
+/*
+* Removes the records of a document of a live indexer, given its id. Each of
+* them loses its path, which marks it as removed, and an entry's list is only
+* cleaned up once most of its records are marked, so removing a document
+* costs about as much as indexing it. Entries that are left without records
+* go away.
+*/
+static void remove_live_document(live_index_t *live, int id) {
+    live_document_t *document = &live->documents[id];
+    int i;
+    for (i = 0; i < document->count; i++) {
+        indexer_entry_t *entry = document->entries[i];
+        int position = get_live_position(live, entry);
+        free(document->records[i]->file_path);
+        document->records[i]->file_path = NULL;
+        live->record_counts[position]--;
+        live->removed_counts[position]++;
+        if (live->record_counts[position] == 0) {
+            /* the last entry takes the position, along with its counts */
+            int last = live->terms.count - 1;
+            live->record_counts[position] = live->record_counts[last];
+            live->removed_counts[position] = live->removed_counts[last];
+            remove_term_entry(&live->terms, position);
+            destroy_indexer_entry(entry);
+        } else if (live->removed_counts[position] > live->record_counts[position]) {
+            clean_records(entry->records);
+            live->removed_counts[position] = 0;
+        }
+    }
+    free(document->entries);
+    free(document->records);
+    memset(document, 0, sizeof(live_document_t));
+}
+
+/*
+* Removes every record of a document from an indexer.
+*/
+void remove_document(indexer_t *indexer, char *file_path) {
+    remove_documents(indexer, &file_path, 1);
+}
+
+/*
+* Removes every record of several documents from a live indexer, one
+* document at a time.
+*/
+void remove_documents(indexer_t *indexer, char **file_paths, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        int id = get_document_id(indexer, file_paths[i]);
+        if (id >= 0) {
+            remove_live_document(indexer->live, id);
+        }
+    }
+}
+
+/*
+* Finds the slot of the run's trigram table that holds a trigram, or the
+* empty slot where it belongs.
+*/
+static int find_trigram_slot(indexer_run_t *run, uint32_t trigram) {
+    int mask = run->trigram_slot_count - 1;
+    int slot = (int) (hash_bytes(&trigram, sizeof(uint32_t)) & (uint64_t) mask);
+    while (run->trigram_slots[slot] != 0 && run->trigram_keys[run->trigram_slots[slot] - 1] != trigram) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/*
+* Gets the position of a trigram's entry in the run's trigram table,
+* creating the entry if needed.
+*/
+static int get_trigram_entry(indexer_run_t *run, uint32_t trigram) {
+    int slot = find_trigram_slot(run, trigram);
+    if (run->trigram_slots[slot] != 0) {
+        return run->trigram_slots[slot] - 1;
+    }
+    if (run->trigram_count == run->trigram_capacity) {
+        run->trigram_capacity = run->trigram_capacity == 0 ? 1024 : run->trigram_capacity * 2;
+        run->trigram_keys = realloc(run->trigram_keys, run->trigram_capacity * sizeof(uint32_t));
+        run->trigram_entries = realloc(run->trigram_entries, run->trigram_capacity * sizeof(indexer_entry_t *));
+        run->trigram_tails = realloc(run->trigram_tails, run->trigram_capacity * sizeof(list_element_t *));
+    }
+    char token[TRIGRAM_TOKEN_SIZE];
+    format_trigram(trigram, token);
+    int position = run->trigram_count++;
+    run->trigram_keys[position] = trigram;
+    run->trigram_entries[position] = create_indexer_entry(token);
+    run->trigram_tails[position] = NULL;
+    run->trigram_slots[slot] = run->trigram_count;
+    if (run->trigram_count * 2 > run->trigram_slot_count) {
+        /* we keep the table at most half full, so we grow and rehash it */
+        run->trigram_slot_count *= 2;
+        run->trigram_slots = realloc(run->trigram_slots, run->trigram_slot_count * sizeof(int));
+        memset(run->trigram_slots, 0, run->trigram_slot_count * sizeof(int));
+        int i;
+        for (i = 0; i < run->trigram_count; i++) {
+            run->trigram_slots[find_trigram_slot(run, run->trigram_keys[i])] = i + 1;
+        }
+    }
+    return position;
+}
+
+/*
+* Counts the distinct trigrams of a file's contents, given the run, the
+* contents and their size. Trigrams that span a line break are left out,
+* since patterns are matched a line at a time.
+*/
+static void count_trigrams(indexer_run_t *run, char *file_data, size_t size, trigram_vector_t *vector) {
+    int capacity = 64;
+    uint32_t *trigrams = malloc(capacity * sizeof(uint32_t));
+    vector->counts = malloc(capacity * sizeof(int));
+    vector->count = 0;
+    /* the trigrams are counted in a hash table of positions plus one, or 0 */
+    int slot_count = 128;
+    int *slots = calloc(slot_count, sizeof(int));
+    size_t i;
+    for (i = 0; i + 2 < size; i++) {
+        if (file_data[i] == '\n' || file_data[i + 1] == '\n' || file_data[i + 2] == '\n') {
+            continue;
+        }
+        uint32_t trigram = get_trigram(file_data + i);
+        int slot = (int) (hash_bytes(&trigram, sizeof(uint32_t)) & (uint64_t) (slot_count - 1));
+        while (slots[slot] != 0 && trigrams[slots[slot] - 1] != trigram) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        if (slots[slot] != 0) {
+            vector->counts[slots[slot] - 1]++;
+            continue;
+        }
+        if (vector->count == capacity) {
+            capacity *= 2;
+            trigrams = realloc(trigrams, capacity * sizeof(uint32_t));
+            vector->counts = realloc(vector->counts, capacity * sizeof(int));
+        }
+        trigrams[vector->count] = trigram;
+        vector->counts[vector->count++] = 1;
+        slots[slot] = vector->count;
+        if (vector->count * 2 > slot_count) {
+            slot_count *= 2;
+            slots = realloc(slots, slot_count * sizeof(int));
+            memset(slots, 0, slot_count * sizeof(int));
+            int j;
+            for (j = 0; j < vector->count; j++) {
+                slot = (int) (hash_bytes(&trigrams[j], sizeof(uint32_t)) & (uint64_t) (slot_count - 1));
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & (slot_count - 1);
+                }
+                slots[slot] = j + 1;
+            }
+        }
+    }
+    vector->trigrams = malloc((vector->count > 0 ? vector->count : 1) * sizeof(int));
+    int j;
+    for (j = 0; j < vector->count; j++) {
+        vector->trigrams[j] = get_trigram_entry(run, trigrams[j]);
+    }
+    free(slots);
+    free(trigrams);
+}
+
+/*
+* Appends a record for a file to the entry of every trigram of a vector.
 */
-static bool traverse_directory(indexer_t *indexer, char *path) {
-    DIR *directory = opendir(path);
-    /* we recursively traverse the given directory and parse any files */
-    if (directory != NULL) {
-        struct dirent *current_file;
-        while ((current_file = readdir(directory)) != NULL) {
-            char *file_name = current_file->d_name;
-            if (strcmp(file_name, ".") == 0 || strcmp(file_name, "..") == 0) {
-                /* we skip local and parent directory file links */
+static void add_trigram_vector(indexer_run_t *run, char *file_path, trigram_vector_t *vector) {
+    int i;
+    for (i = 0; i < vector->count; i++) {
+        int position = vector->trigrams[i];
+        indexer_entry_record_t *record = create_indexer_entry_record(file_path);
+        record->count = vector->counts[i];
+        run->trigram_tails[position] = append_element(run->trigram_entries[position]->records,
+                run->trigram_tails[position], create_list_element(record, NULL));
+    }
+}
+
+static void free_trigram_vector(trigram_vector_t *vector) {
+    free(vector->trigrams);
+    free(vector->counts);
+}
+
+/*
+* Comparison function for qsort over an array of record list elements, by
+* path.
+*/
+static int record_element_compare_function(const void *first, const void *second) {
+    indexer_entry_record_t *first_record = (*(list_element_t * const *) first)->value;
+    indexer_entry_record_t *second_record = (*(list_element_t * const *) second)->value;
+    return strcmp(first_record->file_path, second_record->file_path);
+}
+
+/*
+* The entries whose records are sorted by a pool of threads, which take the
+* next few entries until there are none left.
+*/
+typedef struct record_sort_pool {
+    radix_item_t *items;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+} record_sort_pool_t;
+
+/*
+* Sorts the records of the pool's entries by path, which is the order of
+* their document ids, until there are none left.
+*/
+static void *sort_records(void *argument) {
+    record_sort_pool_t *pool = argument;
+    list_element_t **elements = NULL;
+    int capacity = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        int start = pool->next;
+        pool->next += RECORD_SORT_BATCH;
+        pthread_mutex_unlock(&pool->lock);
+        if (start >= pool->count) {
+            break;
+        }
+        int end = start + RECORD_SORT_BATCH < pool->count ? start + RECORD_SORT_BATCH : pool->count;
+        int i;
+        for (i = start; i < end; i++) {
+            list_t *records = ((indexer_entry_t *) pool->items[i].value)->records;
+            int count = 0;
+            list_element_t *element;
+            for (element = records->head; element != NULL; element = element->next) {
+                if (count == capacity) {
+                    capacity = capacity == 0 ? 64 : capacity * 2;
+                    elements = realloc(elements, capacity * sizeof(list_element_t *));
+                }
+                elements[count++] = element;
+            }
+            if (count < 2) {
                 continue;
             }
-            size_t file_path_size = strlen(path) + strlen(file_name) + (2 * sizeof(char));
-            char *file_path = malloc(file_path_size);
-            strcpy(file_path, path);
-            strcat(file_path, "/");
-            strcat(file_path, file_name);
-            if (current_file->d_type == DT_DIR) {
-                traverse_directory(indexer, file_path);
-            } else if (current_file->d_type == DT_REG) {
-                parse_file(indexer, file_path);
+            qsort(elements, count, sizeof(list_element_t *), &record_element_compare_function);
+            list_element_t *tail = NULL;
+            int j;
+            for (j = 0; j < count; j++) {
+                tail = append_element(records, tail, elements[j]);
             }
-            free(file_path);
         }
-        closedir(directory);
-        return true;
     }
-    else {
-        /* error opening directory */
-        return false;
+    free(elements);
+    return NULL;
+}
+
+/*
+* Moves the entries of a finished run into an indexer, given the indexer, the
+* entries, their number and how many threads to use. The entries are radix
+* sorted by token and their records sorted by path on many threads, so the
+* entries come out ready to be written.
+*/
+static void finish_entries(indexer_t *indexer, indexer_entry_t **entries, int count, int thread_count) {
+    if (count == 0) {
+        return;
+    }
+    radix_item_t *items = malloc(count * sizeof(radix_item_t));
+    int i;
+    for (i = 0; i < count; i++) {
+        items[i].key = entries[i]->token;
+        items[i].value = entries[i];
+    }
+    radix_sort(items, count, thread_count);
+    record_sort_pool_t pool;
+    pool.items = items;
+    pool.count = count;
+    pool.next = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    int worker_count = count / RECORD_SORT_BATCH < thread_count ? count / RECORD_SORT_BATCH : thread_count;
+    pthread_t *threads = malloc((worker_count > 1 ? worker_count - 1 : 1) * sizeof(pthread_t));
+    bool *started = calloc(worker_count > 1 ? worker_count - 1 : 1, sizeof(bool));
+    for (i = 0; i < worker_count - 1; i++) {
+        started[i] = pthread_create(&threads[i], NULL, &sort_records, &pool) == 0;
+    }
+    /* the calling thread sorts records too, so this works without threads */
+    sort_records(&pool);
+    for (i = 0; i < worker_count - 1; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+    pthread_mutex_destroy(&pool.lock);
+    list_element_t *tail = NULL;
+    for (i = 0; i < count; i++) {
+        tail = append_element(indexer->entries, tail, create_list_element(items[i].value, NULL));
     }
+    free(items);
+}
+
+/*
+* Gets the number of threads to sort entries with.
+*/
+static int get_thread_count() {
+    long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    return core_count > 0 ? (int) core_count : 1;
+}
+
+/*
+* Sorts the entries of an indexer by token, and their records by path.
+*/
+void sort_entries(indexer_t *indexer) {
+    int count = get_size(indexer->entries);
+    indexer_entry_t **entries = malloc((count > 0 ? count : 1) * sizeof(indexer_entry_t *));
+    int i = 0;
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        list_element_t *next = element->next;
+        entries[i++] = element->value;
+        free(element);
+        element = next;
+    }
+    indexer->entries->head = NULL;
+    finish_entries(indexer, entries, count, get_thread_count());
+    free(entries);
+}
+
+/*
+* Copies the documents and the live records of a live indexer into a new
+* indexer, without changing the live one.
+*/
+indexer_t *copy_live_indexer(indexer_t *indexer) {
+    indexer_t *copy = create_indexer();
+    copy->filter = indexer->filter;
+    int i;
+    for (i = 0; i < indexer->documents->count; i++) {
+        add_pooled_string(copy->documents, get_pooled_string(indexer->documents, i));
+    }
+    live_index_t *live = indexer->live;
+    list_element_t *tail = NULL;
+    for (i = 0; i < live->terms.count; i++) {
+        indexer_entry_t *entry = live->terms.entries[i];
+        indexer_entry_t *entry_copy = create_indexer_entry(entry->token);
+        list_element_t *record_tail = NULL;
+        list_element_t *element = entry->records->head;
+        for (; element != NULL; element = element->next) {
+            indexer_entry_record_t *record = element->value;
+            if (record->file_path != NULL) {
+                indexer_entry_record_t *record_copy = create_indexer_entry_record(record->file_path);
+                record_copy->count = record->count;
+                record_tail = append_element(entry_copy->records, record_tail, create_list_element(record_copy, NULL));
+            }
+        }
+        tail = append_element(copy->entries, tail, create_list_element(entry_copy, NULL));
+    }
+    return copy;
+}
+
+/*
+* Reads the contents of a file that was indexed earlier again. Returns NULL
+* if it can't be read, or has changed size since. Otherwise, the caller is
+* responsible for freeing the allocated memory.
+*/
+static char *read_indexed_file(indexed_file_t *file) {
+    int descriptor = open(file->file_path, O_RDONLY);
+    if (descriptor == -1) {
+        return NULL;
+    }
+    /* one byte more than the size is asked for, to notice a file that grew */
+    char *data = malloc(file->size + 1);
+    size_t done = 0;
+    ssize_t size = 1;
+    while (done <= file->size && (size = read(descriptor, data + done, file->size + 1 - done)) > 0) {
+        done += (size_t) size;
+    }
+    close(descriptor);
+    if (done != file->size) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/*
+* Hashes the contents of a file that was indexed earlier, reading it again.
+* If it can't be read, or has changed size since, it is given a hash that no
+* other file of its size is likely to have.
+*/
+static void hash_indexed_file(indexed_file_t *file) {
+    file->hashed = true;
+    file->hash = hash_string(file->file_path);
+    char *data = read_indexed_file(file);
+    if (data != NULL) {
+        file->hash = hash_bytes(data, file->size);
+        free(data);
+    }
+}
+
+/*
+* Finds the slot of the table of sizes that holds the files of a size, or
+* the empty slot where they would go.
+*/
+static int find_size_slot(indexer_run_t *run, size_t size) {
+    int slot = (int) (hash_bytes(&size, sizeof(size_t)) & (uint64_t) (run->slot_count - 1));
+    while (run->slots[slot] != 0 && run->files[run->slots[slot] - 1].size != size) {
+        slot = (slot + 1) & (run->slot_count - 1);
+    }
+    return slot;
+}
+
+/*
+* Finds an indexed file with the same contents as the given ones. Only
+* files of the same size are hashed, and a file whose hash matches is read
+* again and compared byte for byte, so a hash collision can't give a file
+* another file's terms.
+*/
+static indexed_file_t *find_duplicate(indexer_run_t *run, int slot, char *file_data, size_t size,
+        uint64_t *hash) {
+    *hash = hash_bytes(file_data, size);
+    int index = run->slots[slot] - 1;
+    while (index >= 0) {
+        indexed_file_t *file = &run->files[index];
+        if (!file->hashed) {
+            hash_indexed_file(file);
+        }
+        if (file->hash == *hash) {
+            char *data = read_indexed_file(file);
+            bool same = data != NULL && memcmp(data, file_data, size) == 0;
+            free(data);
+            if (same) {
+                return file;
+            }
+        }
+        index = file->next;
+    }
+    return NULL;
+}
+
+/*
+* Remembers an indexed file, along with its terms, as the first file of its
+* size.
+*/
+static void add_indexed_file(indexer_run_t *run, int slot, char *file_path, size_t size,
+        term_vector_t *vector, trigram_vector_t *trigrams, bool hashed, uint64_t hash) {
+    if (run->file_count == run->file_capacity) {
+        run->file_capacity = run->file_capacity == 0 ? 64 : run->file_capacity * 2;
+        run->files = realloc(run->files, run->file_capacity * sizeof(indexed_file_t));
+    }
+    indexed_file_t *file = &run->files[run->file_count];
+    file->file_path = strdup(file_path);
+    file->size = size;
+    file->hashed = hashed;
+    file->hash = hash;
+    file->terms = *vector;
+    file->trigrams = *trigrams;
+    file->next = run->slots[slot] - 1;
+    run->slots[slot] = ++run->file_count;
+    if (run->file_count * 2 > run->slot_count) {
+        /* we keep the table at most half full, so we grow it and add the
+         * first file of every size again */
+        run->slot_count *= 2;
+        run->slots = realloc(run->slots, run->slot_count * sizeof(int));
+        memset(run->slots, 0, run->slot_count * sizeof(int));
+        int i;
+        for (i = 0; i < run->file_count; i++) {
+            int size_slot = find_size_slot(run, run->files[i].size);
+            if (run->slots[size_slot] == 0 || run->slots[size_slot] < i + 1) {
+                run->slots[size_slot] = i + 1;
+            }
+        }
+    }
+}
+
+/*
+* Callback for the file reader, run as the contents of each file arrive. A
+* file with the same contents as one that was already indexed gets that
+* file's terms (and trigrams) without being tokenized again.
+*/
+static void handle_file_data(char *file_path, char *file_data, size_t size, void *argument) {
+    indexer_run_t *run = argument;
+    int slot = find_size_slot(run, size);
+    uint64_t hash = 0;
+    bool hashed = false;
+    if (run->slots[slot] != 0) {
+        indexed_file_t *duplicate = find_duplicate(run, slot, file_data, size, &hash);
+        if (duplicate != NULL) {
+            add_term_vector(file_path, &duplicate->terms);
+            add_trigram_vector(run, file_path, &duplicate->trigrams);
+            return;
+        }
+        hashed = true;
+    }
+    term_vector_t vector;
+    count_terms(run->indexer, &run->terms, file_data, &vector);
+    add_term_vector(file_path, &vector);
+    trigram_vector_t trigrams;
+    memset(&trigrams, 0, sizeof(trigram_vector_t));
+    if (run->indexer->trigrams != NULL) {
+        count_trigrams(run, file_data, size, &trigrams);
+        add_trigram_vector(run, file_path, &trigrams);
+    }
+    add_indexed_file(run, slot, file_path, size, &vector, &trigrams, hashed, hash);
 }
 
 /*
 * Runs the indexer, given the path to the directory to recursively
-* traverse through, or a file to parse.
+* traverse through, or a file to parse. The files of a directory are read
+* asynchronously, and each one is tokenized as soon as it has been read.
 */
 bool run_indexer(indexer_t *indexer, char *path) {
-    if (!traverse_directory(indexer, path) && !parse_file(indexer, path)) {
-        /* could not traverse given directory or could not parse given file */
-        return false;
+    file_list_t files;
+    memset(&files, 0, sizeof(file_list_t));
+    indexer_run_t run;
+    memset(&run, 0, sizeof(indexer_run_t));
+    run.indexer = indexer;
+    run.slot_count = 64;
+    run.slots = calloc(run.slot_count, sizeof(int));
+    init_term_table(&run.terms);
+    run.trigram_slot_count = 1024;
+    run.trigram_slots = calloc(run.trigram_slot_count, sizeof(int));
+    /* entries the indexer already has are moved into the term table, and
+     * sorted back in with the new ones */
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        list_element_t *next = element->next;
+        indexer_entry_t *entry = element->value;
+        add_term_entry(&run.terms, find_term_slot(&run.terms, entry->token), entry);
+        free(element);
+        element = next;
+    }
+    indexer->entries->head = NULL;
+    bool success = true;
+    if (walk_directory(path, &files)) {
+        read_files(files.paths, files.count, &handle_file_data, &run);
+    } else {
+        /* could not traverse given directory, so we try to parse it as a file */
+        char *file_data = read_file(path);
+        success = file_data != NULL;
+        if (success) {
+            handle_file_data(path, file_data, strlen(file_data), &run);
+            free(file_data);
+        }
+    }
+    int thread_count = get_thread_count();
+    finish_entries(indexer, run.terms.entries, run.terms.count, thread_count);
+    if (indexer->trigrams != NULL) {
+        finish_entries(indexer->trigrams, run.trigram_entries, run.trigram_count, thread_count);
+    }
+    int i;
+    for (i = 0; i < run.file_count; i++) {
+        free(run.files[i].file_path);
+        free_term_vector(&run.files[i].terms);
+        free_trigram_vector(&run.files[i].trigrams);
+    }
+    free(run.files);
+    free(run.slots);
+    free(run.terms.entries);
+    free(run.terms.slots);
+    free(run.trigram_keys);
+    free(run.trigram_entries);
+    free(run.trigram_tails);
+    free(run.trigram_slots);
+    clear_file_list(&files);
+    return success;
+}
+
+/*
+* Creates the file path of a shard of an index file, given the index file
+* path and the shard number. The caller is responsible for freeing the
+* allocated memory.
+*/
+char *create_shard_path(char *file_path, int shard) {
+    size_t size = strlen(file_path) + 13;
+    char *shard_path = malloc(size);
+    snprintf(shard_path, size, "%s.%d", file_path, shard);
+    return shard_path;
+}
+
+/*
+* Creates the file path of the term directory of an index file, given the
+* index file path. The caller is responsible for freeing the allocated memory.
+*/
+char *create_directory_path(char *file_path) {
+    size_t size = strlen(file_path) + 5;
+    char *directory_path = malloc(size);
+    snprintf(directory_path, size, "%s.dir", file_path);
+    return directory_path;
+}
+
+/*
+* Creates the file path of the trigram index of an index file, given the
+* index file path. The caller is responsible for freeing the allocated memory.
+*/
+char *create_trigram_path(char *file_path) {
+    size_t size = strlen(file_path) + 5;
+    char *trigram_path = malloc(size);
+    snprintf(trigram_path, size, "%s.tri", file_path);
+    return trigram_path;
+}
+
+/*
+* Partitions an indexer into the given number of shards, with documents
+* assigned to shards by the hash of their path. Entries and records keep
+* their relative order, so each shard is still sorted.
+*/
+indexer_t **partition_indexer(indexer_t *indexer, int shard_count) {
+    indexer_t **shards = malloc(shard_count * sizeof(indexer_t *));
+    list_element_t **entry_tails = calloc(shard_count, sizeof(list_element_t *));
+    indexer_entry_t **shard_entries = malloc(shard_count * sizeof(indexer_entry_t *));
+    list_element_t **record_tails = malloc(shard_count * sizeof(list_element_t *));
+    int shard;
+    for (shard = 0; shard < shard_count; shard++) {
+        shards[shard] = create_indexer();
+        shards[shard]->filter = indexer->filter;
+    }
+    list_element_t *entry_element = indexer->entries->head;
+    while (entry_element != NULL) {
+        indexer_entry_t *entry = entry_element->value;
+        for (shard = 0; shard < shard_count; shard++) {
+            shard_entries[shard] = NULL;
+            record_tails[shard] = NULL;
+        }
+        /* we move every record element over to the entry of its shard */
+        list_element_t *record_element = entry->records->head;
+        while (record_element != NULL) {
+            list_element_t *next = record_element->next;
+            indexer_entry_record_t *record = record_element->value;
+            shard = (int) (hash_string(record->file_path) % (uint64_t) shard_count);
+            if (shard_entries[shard] == NULL) {
+                /* this is the first record of this token in the shard */
+                shard_entries[shard] = create_indexer_entry(entry->token);
+                entry_tails[shard] = append_element(shards[shard]->entries, entry_tails[shard],
+                        create_list_element(shard_entries[shard], NULL));
+            }
+            record_tails[shard] = append_element(shard_entries[shard]->records, record_tails[shard],
+                    record_element);
+            record_element = next;
+        }
+        entry->records->head = NULL;
+        entry_element = entry_element->next;
+    }
+    /* the original indexer no longer has any records, so we empty it */
+    destroy_list(indexer->entries);
+    indexer->entries = create_list(&entry_compare_function, &entry_destroy_function);
+    free(entry_tails);
+    free(shard_entries);
+    free(record_tails);
+    if (indexer->trigrams != NULL) {
+        /* documents hash to the same shard in both, since it is by path */
+        indexer_t **trigram_shards = partition_indexer(indexer->trigrams, shard_count);
+        for (shard = 0; shard < shard_count; shard++) {
+            shards[shard]->trigrams = trigram_shards[shard];
+        }
+        free(trigram_shards);
     }
-    return true;
+    return shards;
 }
\ No newline at end of file
@@ -2,9 +2,37 @@
 #define _INDEXER_H_
 
 #include "sorted_list.h"
+#include "roaring.h"
+#include "token_filter.h"
+#include "string_pool.h"
 
 typedef struct indexer {
     list_t *entries;
+    /* the distinct document paths in sorted order, see index_documents. The
+     * paths of a "<documents>" section of an index file are loaded here too,
+     * in file order, until index_documents is called */
+    string_pool_t *documents;
+    /* set when the postings are loaded on demand, see index_directory.h; the
+     * entries are then left empty, and the directory is owned by whoever
+     * loaded it */
+    struct index_directory *directory;
+    /* set when the entries of a fully loaded index are packed for searching,
+     * see packed_index.h; the entries are then left empty, and the packed
+     * index is owned by whoever packed it */
+    struct packed_index *packed;
+    /* the trigram index of the same documents, which is built alongside
+     * the terms by run_indexer if it is set, or NULL. Its tokens are the
+     * trigrams of the documents' bytes, see trigram.h. It is owned by the
+     * indexer */
+    struct indexer *trigrams;
+    /* set once the indexer is kept up to date document by document, see
+     * start_live_indexer; the entries are then held in a term table rather
+     * than the entries list, along with the records of every document, or
+     * NULL. It is owned by the indexer */
+    struct live_index *live;
+    /* the filters tokens go through before they are indexed, which query
+     * terms have to go through too */
+    token_filter_t filter;
 } indexer_t;
 
 /*
@@ -20,13 +48,124 @@ void destroy_indexer(indexer_t *);
 
 /*
  * Runs the indexer, given the path to the directory to recursively
- * traverse through.
+ * traverse through. The indexer's trigram index is filled in too, if it
+ * has one. Terms are looked up in a hash table while the files are
+ * indexed, and the entries are only sorted by token, and their records by
+ * path, once every file is done.
  */
 bool run_indexer(indexer_t *, char *);
 
+/*
+ * Builds the document table of an indexer: every distinct file path of its
+ * records and of its loaded "<documents>" sections, in sorted order. A
+ * document's position in the table is its id, so ordering ids is the same
+ * as ordering paths. Bitmaps loaded from the index file are renumbered to
+ * match the table.
+ */
+void index_documents(indexer_t *);
+
+/*
+ * Gets the id of a document, given its path. Returns -1 if the document
+ * is not in the indexer's document table.
+ */
+int get_document_id(indexer_t *, char *);
+
+/*
+ * Adds a document to the built document table of an indexer, given its
+ * path, keeping the table sorted, and returns its id. The ids of the
+ * documents after it move up by one, so the indexer must have no bitmaps.
+ * A document that is already in the table keeps its id.
+ */
+int add_document(indexer_t *, char *);
+
+/*
+ * Makes an indexer live, so documents can be indexed and removed one at a
+ * time, each in time proportional to its own number of terms. Terms are
+ * then found through a hash table rather than the sorted entries list,
+ * which is left empty, and every document remembers its records. The
+ * indexer must have a built document table and no bitmaps.
+ */
+void start_live_indexer(indexer_t *);
+
+/*
+ * Copies the documents and entries of a live indexer into a new indexer,
+ * leaving out the records of removed documents. The copy is not live, and
+ * its entries are not sorted (see sort_entries). The live indexer is only
+ * read. The caller is responsible for freeing the copy.
+ */
+indexer_t *copy_live_indexer(indexer_t *);
+
+/*
+ * Sorts the entries of an indexer by token, and their records by path, so
+ * the indexer can be written.
+ */
+void sort_entries(indexer_t *);
+
+/*
+ * Indexes the contents of a single document, given the live indexer, the
+ * path the document is indexed under, and its contents. Every token goes
+ * through the indexer's filters first. The document is added to the
+ * document table if needed.
+ */
+void index_document(indexer_t *, char *, char *);
+
+/*
+ * Removes every record of a document from a live indexer, given its path,
+ * along with the entries that are left without any. The document stays in
+ * the document table.
+ */
+void remove_document(indexer_t *, char *);
+
+/*
+ * Removes every record of several documents from a live indexer, like
+ * remove_document, given the paths and their number.
+ */
+void remove_documents(indexer_t *, char **, int);
+
+/*
+ * Removes a document from the document table of an indexer, given its path,
+ * once its records are gone (see remove_document). The ids of the documents
+ * after it move down by one, so the indexer must have no bitmaps. Nothing
+ * happens if the document is not in the table.
+ */
+void drop_document(indexer_t *, char *);
+
+/*
+ * Partitions an indexer into the given number of shards, with documents
+ * assigned to shards by the hash of their path. Every record is moved out
+ * of the given indexer, which is left empty. A trigram index is partitioned
+ * the same way, into the trigram indexes of the shards. The caller is
+ * responsible for freeing the returned array and each of the shard indexers.
+ */
+indexer_t **partition_indexer(indexer_t *, int);
+
+/*
+ * Creates the file path of a shard of an index file, given the index file
+ * path and the shard number. The caller is responsible for freeing the
+ * allocated memory.
+ */
+char *create_shard_path(char *, int);
+
+/*
+ * Creates the file path of the term directory of an index file ("<path>.dir"),
+ * given the index file path. The caller is responsible for freeing the
+ * allocated memory.
+ */
+char *create_directory_path(char *);
+
+/*
+ * Creates the file path of the trigram index of an index file
+ * ("<path>.tri"), given the index file path. The caller is responsible for
+ * freeing the allocated memory.
+ */
+char *create_trigram_path(char *);
+
 typedef struct indexer_entry {
     char *token;
     list_t *records;
+    /* the document ids of a high-frequency term, if its postings are stored
+     * as a bitmap instead of as records */
+    roaring_t *bitmap;
 } indexer_entry_t;
 
 /*
@@ -45,7 +184,21 @@ void destroy_indexer_entry(indexer_entry_t *);
 */
 indexer_entry_t *get_indexer_entry(indexer_t *, char *);
 
+/*
+ * Gets the number of documents an entry's token appears in.
+ */
+long get_entry_frequency(indexer_entry_t *);
+
+/*
+ * Gets the entries of a live indexer, in no particular order, given the
+ * indexer and where to store their number. The array belongs to the
+ * indexer, and changes as documents are indexed and removed.
+ */
+indexer_entry_t **get_live_entries(indexer_t *, int *);
+
 typedef struct indexer_entry_record {
+    /* NULL once the document is removed from a live indexer, until the
+     * record is cleaned up */
     char *file_path;
     int count;
 } indexer_entry_record_t;
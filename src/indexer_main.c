@@ -3,74 +3,531 @@
 #include <string.h>
 #include <unistd.h>
 #include "indexer.h"
+#include "index_writer.h"
+#include "index_parser.h"
+#include "postings.h"
+#include "ingest.h"
+#include "watch.h"
+#include "token_filter.h"
+
+/*
+ * The largest number of shards an index can be split into.
+ */
+#define MAX_SHARDS 1024
+
+/*
+ * The default number of milliseconds between flushes of an ingested or
+ * watched index.
+ */
+#define DEFAULT_FLUSH_INTERVAL 1000
+
+static void print_usage() {
+    fprintf(stderr, "Usage: indexer [-s <shard count>] [-b] [-t] [-f <filters>] <inverted-index file name> "
+            "<directory or file name>\n"
+            "  -s  split the index into shards, partitioned by document path\n"
+            "  -b  store the postings of high-frequency terms as bitmaps\n"
+            "  -t  also build a trigram index, for substring and pattern searches\n"
+            "  -f  filter tokens before indexing them, given a comma separated list of\n"
+            "      'stop' (drop stop words), 'stem' (stem English words),\n"
+            "      'min=<length>' and 'max=<length>' (drop tokens of other lengths)\n"
+            "       indexer --ingest [-b] [-f <filters>] [-i <milliseconds>] <inverted-index file name>\n"
+            "  --ingest  index JSON records ({\"id\": ..., \"body\": ...}, one per line) read\n"
+            "            from standard input, serving searches on <file name>.sock meanwhile\n"
+            "       indexer --watch [-b] [-f <filters>] [-i <milliseconds>] <inverted-index file name> "
+            "<directory name>\n"
+            "  --watch   index the directory, then keep the index up to date as its files\n"
+            "            change, until interrupted\n"
+            "  -i  flush the index to disk at most this often (default %d)\n", DEFAULT_FLUSH_INTERVAL);
+}
+
+/*
+ * Creates the path of the temporary file a new version of a file is
+ * written to. The caller is responsible for freeing the allocated memory.
+ */
+static char *create_temporary_path(char *file_path) {
+    size_t size = strlen(file_path) + 5;
+    char *temporary_path = malloc(size);
+    snprintf(temporary_path, size, "%s.tmp", file_path);
+    return temporary_path;
+}
+
+/*
+ * Asks the user what to do with an existing index, given its path, before
+ * anything is indexed: 1 overwrites it, 3 cancels, and anything else
+ * appends to it. An index exists if the file itself or its first shard
+ * does, whatever the number of shards of the new one. Returns 0 if there is
+ * no index yet.
+ */
+static int ask_existing_index(char *file_path) {
+    char *shard_path = create_shard_path(file_path, 0);
+    bool exists = access(file_path, F_OK) != -1 || access(shard_path, F_OK) != -1;
+    free(shard_path);
+    if (!exists) {
+        return 0;
+    }
+    /* since it does, we give the user a few options */
+    printf("File already exists. Type '1' to overwrite, "
+            "'2' to append, or '3' to cancel.\n");
+    fflush(stdout);
+    int option = 0;
+    scanf("%d", &option);
+    return option == 1 || option == 3 ? option : 2;
+}
+
+/*
+ * Checks that the files of an existing index that will be appended to were
+ * built with the same token filters as the new documents, given the path of
+ * the index, the number of shards of the new one and the filters. The whole
+ * of a file is searched with the filters it was first written with, so
+ * documents filtered differently would never be found. Returns false and
+ * prints an error if the filters differ.
+ */
+static bool check_existing_filters(char *file_path, int shard_count, token_filter_t *filter) {
+    char spec[TOKEN_FILTER_SPEC_SIZE];
+    format_token_filter(filter, spec, sizeof(spec));
+    bool success = true;
+    int shard;
+    for (shard = 0; shard < shard_count && success; shard++) {
+        char *path = shard_count == 1 ? strdup(file_path) : create_shard_path(file_path, shard);
+        token_filter_t existing;
+        if (read_index_filter(path, &existing)) {
+            char existing_spec[TOKEN_FILTER_SPEC_SIZE];
+            format_token_filter(&existing, existing_spec, sizeof(existing_spec));
+            if (strcmp(spec, existing_spec) != 0) {
+                fprintf(stderr, "Error: Can't append to '%s', which was built with other token filters ('%s').\n",
+                        path, existing_spec[0] != '\0' ? existing_spec : "none");
+                success = false;
+            }
+        }
+        free(path);
+    }
+    return success;
+}
+
+/*
+ * Opens the given index file for writing, given the option the user picked
+ * for an existing index (see ask_existing_index). A new or overwritten
+ * index is written to the given temporary path, to be renamed over the old
+ * one once it is complete, so a search process that reloads it never sees
+ * a partial index. Whether the index file is appended to in place instead
+ * is set in the given appending pointer. Returns NULL if the file can't be
+ * opened.
+ */
+static FILE *open_index_file(char *file_path, char *temporary_path, int option, bool *appending) {
+    *appending = option == 2 && access(file_path, F_OK) != -1;
+    return fopen(*appending ? file_path : temporary_path, *appending ? "a" : "w");
+}
+
+/*
+ * Writes a single index file through the pipelined index writer, along with
+ * its term directory.
+ */
+static bool write_index_file(indexer_t *indexer, char *file_path, bool bitmaps, int option) {
+    char *temporary_path = create_temporary_path(file_path);
+    bool appending;
+    FILE *new_file = open_index_file(file_path, temporary_path, option, &appending);
+    if (new_file == NULL) {
+        fprintf(stderr, "Error: Could not write the inverted-index file.\n");
+        free(temporary_path);
+        return false;
+    }
+    char *directory_path = create_directory_path(file_path);
+    char *temporary_directory_path = create_temporary_path(directory_path);
+    FILE *directory_file = NULL;
+    if (appending) {
+        /* the directory can't describe an appended file, so we remove the old
+         * one and the index will be parsed in full when it's loaded */
+        unlink(directory_path);
+    } else if ((directory_file = fopen(temporary_directory_path, "w")) == NULL) {
+        fprintf(stderr, "Warning: Could not create the term directory file.\n");
+    }
+    bool success = write_indexer(indexer, new_file, bitmaps, directory_file);
+    success = fclose(new_file) == 0 && success;
+    bool directory_written = directory_file != NULL && fclose(directory_file) == 0;
+    if (success && !appending) {
+        /* the old directory goes first, so it is never paired with the new index */
+        unlink(directory_path);
+        success = rename(temporary_path, file_path) == 0;
+        if (success && directory_written && rename(temporary_directory_path, directory_path) != 0) {
+            fprintf(stderr, "Warning: Could not create the term directory file.\n");
+        }
+    }
+    if (!success) {
+        fprintf(stderr, "Error: Could not write the inverted-index file.\n");
+        unlink(temporary_path);
+    }
+    if (!appending) {
+        /* whatever wasn't renamed into place is left over */
+        unlink(temporary_directory_path);
+    }
+    free(temporary_directory_path);
+    free(directory_path);
+    free(temporary_path);
+    return success;
+}
+
+/*
+ * Writes the trigram index of an index file next to it, the same way the
+ * index file was written, or removes the old one if the indexer has none,
+ * since it would no longer match the index. A search process watching the
+ * index reloads it again once this is renamed into place.
+ */
+static bool write_trigram_file(indexer_t *indexer, char *file_path, bool bitmaps, int option) {
+    char *trigram_path = create_trigram_path(file_path);
+    bool success = true;
+    if (indexer->trigrams != NULL) {
+        success = write_index_file(indexer->trigrams, trigram_path, bitmaps, option);
+    } else {
+        char *directory_path = create_directory_path(trigram_path);
+        unlink(directory_path);
+        unlink(trigram_path);
+        free(directory_path);
+    }
+    free(trigram_path);
+    return success;
+}
+
+/*
+ * Builds the document tables of an indexer and of its trigram index, which
+ * the index files refer to.
+ */
+static void index_all_documents(indexer_t *indexer) {
+    index_documents(indexer);
+    if (indexer->trigrams != NULL) {
+        index_documents(indexer->trigrams);
+    }
+}
+
+/*
+ * Writes the indexer as the given number of shards, with documents
+ * partitioned by the hash of their path.
+ */
+static bool write_shards(indexer_t *indexer, char *file_path, int shard_count, bool bitmaps, int option) {
+    indexer_t **shards = partition_indexer(indexer, shard_count);
+    bool success = true;
+    int shard;
+    for (shard = 0; shard < shard_count; shard++) {
+        if (success) {
+            char *shard_path = create_shard_path(file_path, shard);
+            index_all_documents(shards[shard]);
+            success = write_index_file(shards[shard], shard_path, bitmaps, option)
+                    && write_trigram_file(shards[shard], shard_path, bitmaps, option);
+            free(shard_path);
+        }
+        destroy_indexer(shards[shard]);
+    }
+    free(shards);
+    return success;
+}
+
+/*
+ * Removes an index file along with its term directory and its trigram
+ * index, if they exist.
+ */
+static void remove_index_file(char *file_path) {
+    char *directory_path = create_directory_path(file_path);
+    char *trigram_path = create_trigram_path(file_path);
+    char *trigram_directory_path = create_directory_path(trigram_path);
+    unlink(file_path);
+    unlink(directory_path);
+    unlink(trigram_path);
+    unlink(trigram_directory_path);
+    free(trigram_directory_path);
+    free(trigram_path);
+    free(directory_path);
+}
+
+/*
+ * Removes the files of an older index at the same path that a new one
+ * didn't overwrite, given the path and the number of shards written: the
+ * shards past the new ones, and the unsharded index, which searches would
+ * load instead of the shards. An unsharded index leaves no shard behind.
+ */
+static void remove_stale_files(char *file_path, int shard_count) {
+    int shard;
+    for (shard = shard_count == 1 ? 0 : shard_count; ; shard++) {
+        char *shard_path = create_shard_path(file_path, shard);
+        bool exists = access(shard_path, F_OK) != -1;
+        if (exists) {
+            remove_index_file(shard_path);
+        }
+        free(shard_path);
+        if (!exists) {
+            break;
+        }
+    }
+    if (shard_count > 1) {
+        remove_index_file(file_path);
+    }
+}
+
+/*
+ * Where and how an ingested or watched index is flushed.
+ */
+typedef struct ingest_file {
+    char *file_path;
+    bool bitmaps;
+} ingest_file_t;
+
+/*
+ * Flushes an ingested or watched index by writing it in full over the old
+ * one, which is only replaced once the new one is complete.
+ */
+static bool flush_ingest_file(indexer_t *indexer, void *argument) {
+    ingest_file_t *file = argument;
+    return write_index_file(indexer, file->file_path, file->bitmaps, 1)
+            && write_trigram_file(indexer, file->file_path, file->bitmaps, 1);
+}
+
+/*
+ * Creates the indexer documents are ingested into. If the index file already
+ * exists, it is loaded so the new documents are added to the old ones, and
+ * its filters are kept. Returns NULL if it can't be loaded.
+ */
+static indexer_t *create_ingest_indexer(char *file_path, token_filter_t filter) {
+    if (access(file_path, F_OK) == -1) {
+        indexer_t *indexer = create_indexer();
+        indexer->filter = filter;
+        return indexer;
+    }
+    long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    indexer_t *indexer = parse_indexer_file(file_path, core_count > 0 ? (int) core_count : 1);
+    if (indexer == NULL) {
+        fprintf(stderr, "Error: Could not load the inverted-index file '%s'.\n", file_path);
+        return NULL;
+    }
+    /* documents can only be added to records, so bitmaps are expanded */
+    index_documents(indexer);
+    decompress_postings(indexer);
+    return indexer;
+}
+
+/*
+ * Ingests the records read from standard input into an index file until the
+ * input ends, serving searches over them in the meantime.
+ */
+static bool run_ingest(char *file_path, bool bitmaps, token_filter_t filter, int flush_interval) {
+    indexer_t *indexer = create_ingest_indexer(file_path, filter);
+    if (indexer == NULL) {
+        return false;
+    }
+    size_t size = strlen(file_path) + 6;
+    char *socket_path = malloc(size);
+    snprintf(socket_path, size, "%s.sock", file_path);
+    ingest_file_t file = {file_path, bitmaps};
+    ingest_t *ingest = create_ingest(indexer, socket_path, &flush_ingest_file, &file, flush_interval);
+    free(socket_path);
+    if (ingest == NULL) {
+        destroy_indexer(indexer);
+        return false;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    long line_number = 0;
+    while (getline(&line, &capacity, stdin) != -1) {
+        line_number++;
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (!ingest_record(ingest, line)) {
+            fprintf(stderr, "Warning: Skipping invalid record on line %ld.\n", line_number);
+        }
+    }
+    free(line);
+    bool success = finish_ingest(ingest);
+    destroy_indexer(indexer);
+    return success;
+}
+
+/*
+ * Checks whether a file would be written inside a directory, so a watched
+ * directory doesn't get its own index written into it.
+ */
+static bool is_inside_directory(char *file_path, char *directory_path) {
+    char *directory = realpath(directory_path, NULL);
+    char *file_directory = strdup(file_path);
+    char *slash = strrchr(file_directory, '/');
+    if (slash == NULL) {
+        strcpy(file_directory, ".");
+    } else {
+        slash[slash == file_directory ? 1 : 0] = '\0';
+    }
+    char *parent = realpath(file_directory, NULL);
+    bool inside = false;
+    if (directory != NULL && parent != NULL) {
+        size_t length = strlen(directory);
+        inside = strncmp(parent, directory, length) == 0
+                && (parent[length] == '\0' || parent[length] == '/' || strcmp(directory, "/") == 0);
+    }
+    free(parent);
+    free(file_directory);
+    free(directory);
+    return inside;
+}
+
+/*
+ * Indexes a directory into an index file, then keeps the index file up to
+ * date as the directory's files change, until the process is interrupted.
+ */
+static bool run_watch_indexer(char *file_path, char *directory_path, bool bitmaps, token_filter_t filter,
+        int flush_interval) {
+    if (is_inside_directory(file_path, directory_path)) {
+        fprintf(stderr, "Error: The index file can't be inside the watched directory.\n");
+        return false;
+    }
+    /* the directory is watched first, so changes made while it is indexed
+     * aren't missed */
+    watch_t *watch = create_watch(directory_path);
+    if (watch == NULL) {
+        return false;
+    }
+    indexer_t *indexer = create_indexer();
+    indexer->filter = filter;
+    bool success = run_indexer(indexer, directory_path);
+    ingest_file_t file = {file_path, bitmaps};
+    if (success) {
+        index_documents(indexer);
+        success = flush_ingest_file(indexer, &file);
+    } else {
+        fprintf(stderr, "Error parsing input file(s). Does the given file or directory exist?\n");
+    }
+    if (success) {
+        fprintf(stderr, "Watching '%s' for changes.\n", directory_path);
+        success = run_watch(watch, indexer, &flush_ingest_file, &file, flush_interval);
+    }
+    destroy_watch(watch);
+    destroy_indexer(indexer);
+    return success;
+}
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Error: Invalid number of arguments.\n"
-                "Usage: indexer <inverted-index file name> "
-                "<directory or file name>\n");
+    int shard_count = 1;
+    bool bitmaps = false;
+    bool trigrams = false;
+    bool ingesting = false;
+    bool watching = false;
+    int flush_interval = DEFAULT_FLUSH_INTERVAL;
+    token_filter_t filter;
+    memset(&filter, 0, sizeof(token_filter_t));
+    int argument = 1;
+    /* we handle the options, which all come before the file names */
+    while (argument < argc && argv[argument][0] == '-') {
+        if (strcmp(argv[argument], "-s") == 0 && argument + 1 < argc) {
+            shard_count = atoi(argv[argument + 1]);
+            argument += 2;
+            if (shard_count < 1 || shard_count > MAX_SHARDS) {
+                fprintf(stderr, "Error: Invalid shard count.\n");
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[argument], "--ingest") == 0) {
+            ingesting = true;
+            argument++;
+        } else if (strcmp(argv[argument], "--watch") == 0) {
+            watching = true;
+            argument++;
+        } else if (strcmp(argv[argument], "-i") == 0 && argument + 1 < argc) {
+            flush_interval = atoi(argv[argument + 1]);
+            argument += 2;
+            if (flush_interval < 1) {
+                fprintf(stderr, "Error: Invalid flush interval.\n");
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[argument], "-b") == 0) {
+            bitmaps = true;
+            argument++;
+        } else if (strcmp(argv[argument], "-t") == 0) {
+            trigrams = true;
+            argument++;
+        } else if (strcmp(argv[argument], "-f") == 0 && argument + 1 < argc) {
+            if (!parse_token_filter(&filter, argv[argument + 1])) {
+                fprintf(stderr, "Error: Invalid token filters '%s'.\n", argv[argument + 1]);
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            argument += 2;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'.\n", argv[argument]);
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (ingesting && watching) {
+        fprintf(stderr, "Error: An index can't be ingested into and watched at once.\n");
+        print_usage();
         return EXIT_FAILURE;
-    } else if (strcmp(argv[1], argv[2]) == 0) {
+    }
+    if (ingesting) {
+        /* ingested documents have no files to split by or take trigrams of */
+        if (shard_count != 1 || trigrams) {
+            fprintf(stderr, "Error: Shards and trigrams can't be built while ingesting.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        } else if (argc - argument != 1) {
+            fprintf(stderr, "Error: Invalid number of arguments.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        return run_ingest(argv[argument], bitmaps, filter, flush_interval) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (watching) {
+        /* changed files are indexed one by one, which shards and trigrams
+         * don't support */
+        if (shard_count != 1 || trigrams) {
+            fprintf(stderr, "Error: Shards and trigrams can't be built while watching.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        } else if (argc - argument != 2) {
+            fprintf(stderr, "Error: Invalid number of arguments.\n");
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        return run_watch_indexer(argv[argument], argv[argument + 1], bitmaps, filter, flush_interval)
+                ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc - argument != 2) {
+        fprintf(stderr, "Error: Invalid number of arguments.\n");
+        print_usage();
+        return EXIT_FAILURE;
+    } else if (strcmp(argv[argument], argv[argument + 1]) == 0) {
         fprintf(stderr, "Error: Target index file and file to be "
                 "indexed are the same.\n");
         return EXIT_FAILURE;
     }
-    char *new_file_path = argv[1];
-    char *input_path = argv[2];
-
-    FILE *new_file;
-    /* first we check if the new indexer file already exists */
-    if (access(new_file_path, F_OK) != -1) {
-        /* if it does, we give the user a few options */
-        printf("File already exists. Type '1' to overwrite, "
-                "'2' to append, or '3' to cancel.\n");
-        fflush(stdout);
-        int option;
-        scanf("%d", &option);
-        /* if the user wants to quit, we do so */
-        if (option == 3) return EXIT_SUCCESS;
-        /* we choose our write mode depending on what the user wants */
-        new_file = fopen(new_file_path, option == 1 ? "w" : "a");
-    } else {
-        /* if not, we create a new file */
-        new_file = fopen(new_file_path, "a+");
+    char *new_file_path = argv[argument];
+    char *input_path = argv[argument + 1];
+
+    /* the user is asked what to do with an existing index before indexing */
+    int option = ask_existing_index(new_file_path);
+    /* if the user wants to quit, we do so */
+    if (option == 3) return EXIT_SUCCESS;
+    if (option == 2 && !check_existing_filters(new_file_path, shard_count, &filter)) {
+        return EXIT_FAILURE;
     }
 
     /* time to create and run our indexer */
     indexer_t *indexer = create_indexer();
+    indexer->filter = filter;
+    if (trigrams) {
+        indexer->trigrams = create_indexer();
+    }
     bool success = run_indexer(indexer, input_path);
     if (success) {
-        /* first we create an iterator for the indexer entries */
-        list_iterator_t *entries = create_iterator(indexer->entries);
-        /* next, we iterate through every entry */
-        indexer_entry_t *entry = get_item(entries);
-        while (entry != NULL) {
-            fprintf(new_file, "<list> %s\n", entry->token);
-            /* when we get an entry, we iterate through each record */
-            list_iterator_t *records = create_iterator(entry->records);
-            indexer_entry_record_t *record = get_item(records);
-            int record_counter = 0;
-            while (record != NULL) {
-                /* time to print the record data - we only want 5 records per line */
-                if (record_counter == 5) {
-                    record_counter = 0;
-                    fprintf(new_file, "\n");
-                }
-                fprintf(new_file, "%s %i", record->file_path, record->count);
-                record = next_item(records);
-                /* if we have another record, we print a space to prefix it */
-                if (record != NULL) fprintf(new_file, " ");
-                record_counter++;
-            }
-            destroy_iterator(records);
-            entry = next_item(entries);
-            fprintf(new_file, "\n</list>\n");
+        if (shard_count == 1) {
+            index_all_documents(indexer);
+            success = write_index_file(indexer, new_file_path, bitmaps, option)
+                    && write_trigram_file(indexer, new_file_path, bitmaps, option);
+        } else {
+            success = write_shards(indexer, new_file_path, shard_count, bitmaps, option);
+        }
+        if (success && option != 2) {
+            /* an index that was overwritten may have had other files */
+            remove_stale_files(new_file_path, shard_count);
         }
-        destroy_iterator(entries);
     } else {
         fprintf(stderr, "Error parsing input file(s). Does the given file or directory exist?\n");
     }
-    fclose(new_file);
     destroy_indexer(indexer);
     return success ? EXIT_SUCCESS : EXIT_FAILURE;
-}
\ No newline at end of file
+}
@@ -0,0 +1,598 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ingest.h"
+#include "index_set.h"
+#include "search_command.h"
+
+/*
+ * The most queries that can be waiting for their connection to be accepted.
+ */
+#define INGEST_BACKLOG 16
+
+struct ingest {
+    indexer_t *indexer;
+    /* documents are added under the write lock and searched under the read
+     * lock. Writers are preferred, so a steady stream of queries can't hold
+     * off new documents */
+    pthread_rwlock_t lock;
+    /* the number of documents added so far, and how many of them had been
+     * added at the last flush */
+    long version;
+    long flushed_version;
+    ingest_flush_function_t *flush;
+    void *argument;
+    int flush_interval;
+
+    /* the background thread, which accepts connections on the socket and
+     * flushes the indexer, and stops when it gets a 'q' request on a pipe */
+    pthread_t thread;
+    char *socket_path;
+    int server;
+    int requests[2];
+
+    /* the sockets of the open connections, each served on its own thread */
+    pthread_mutex_t connections_lock;
+    pthread_cond_t connections_closed;
+    int *connections;
+    int connection_count;
+    int connection_capacity;
+};
+
+/*
+ * A connection to the socket, and the ingest it queries.
+ */
+typedef struct ingest_connection {
+    ingest_t *ingest;
+    int socket;
+} ingest_connection_t;
+
+/*
+ * Gets the time of a monotonic clock, in milliseconds.
+ */
+static long long get_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (long long) time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+/*
+ * Runs a search command against the indexer as it is right now, and sends
+ * back its line of results. Documents that were ingested have no files to
+ * match patterns against, so pattern searches have no results.
+ */
+static void handle_query(ingest_t *ingest, char *input, FILE *output) {
+    char *command = strncmp(input, "explain ", 8) == 0 ? input + 8 : input;
+    if (strncmp(command, "sr ", 3) == 0 || strncmp(command, "ss ", 3) == 0) {
+        fprintf(output, "\n");
+        return;
+    }
+    pthread_rwlock_rdlock(&ingest->lock);
+    index_set_t set;
+    set.indexers = &ingest->indexer;
+    set.count = 1;
+    set.disjoint = true;
+    set.references = 1;
+    if (!handle_search_command(&set, input, output)) {
+        fprintf(stderr, "Error: Invalid command.\n");
+    }
+    pthread_rwlock_unlock(&ingest->lock);
+}
+
+/*
+ * Forgets a connection once it is closed, and lets finish_ingest know when
+ * the last one is.
+ */
+static void remove_connection(ingest_t *ingest, int socket) {
+    pthread_mutex_lock(&ingest->connections_lock);
+    int i;
+    for (i = 0; i < ingest->connection_count; i++) {
+        if (ingest->connections[i] == socket) {
+            ingest->connections[i] = ingest->connections[--ingest->connection_count];
+            break;
+        }
+    }
+    pthread_cond_broadcast(&ingest->connections_closed);
+    pthread_mutex_unlock(&ingest->connections_lock);
+}
+
+/*
+ * The thread of a connection, which answers its commands one line at a time
+ * until it sends 'q' or hangs up.
+ */
+static void *connection_thread(void *argument) {
+    ingest_connection_t *connection = argument;
+    ingest_t *ingest = connection->ingest;
+    int output_socket = dup(connection->socket);
+    FILE *input = fdopen(connection->socket, "r");
+    FILE *output = output_socket != -1 ? fdopen(output_socket, "w") : NULL;
+    if (input != NULL && output != NULL) {
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        while ((length = getline(&line, &capacity, input)) > 0) {
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+                line[--length] = '\0';
+            }
+            if (strcmp(line, "q") == 0) {
+                break;
+            }
+            handle_query(ingest, line, output);
+            if (fflush(output) != 0) {
+                break;
+            }
+        }
+        free(line);
+    }
+    /* the socket is forgotten before it is closed, so its number can't be
+     * reused by another connection while it is still listed */
+    remove_connection(ingest, connection->socket);
+    if (input != NULL) {
+        fclose(input);
+    } else {
+        close(connection->socket);
+    }
+    if (output != NULL) {
+        fclose(output);
+    } else if (output_socket != -1) {
+        close(output_socket);
+    }
+    free(connection);
+    return NULL;
+}
+
+/*
+ * Accepts a connection to the socket, and starts its thread.
+ */
+static void accept_connection(ingest_t *ingest) {
+    int socket = accept4(ingest->server, NULL, NULL, SOCK_CLOEXEC);
+    if (socket == -1) {
+        return;
+    }
+    ingest_connection_t *connection = malloc(sizeof(ingest_connection_t));
+    connection->ingest = ingest;
+    connection->socket = socket;
+    pthread_mutex_lock(&ingest->connections_lock);
+    if (ingest->connection_count == ingest->connection_capacity) {
+        ingest->connection_capacity = ingest->connection_capacity == 0 ? 8 : ingest->connection_capacity * 2;
+        ingest->connections = realloc(ingest->connections, ingest->connection_capacity * sizeof(int));
+    }
+    ingest->connections[ingest->connection_count++] = socket;
+    pthread_mutex_unlock(&ingest->connections_lock);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &connection_thread, connection) == 0) {
+        pthread_detach(thread);
+    } else {
+        fprintf(stderr, "Warning: Could not serve a connection.\n");
+        remove_connection(ingest, socket);
+        close(socket);
+        free(connection);
+    }
+}
+
+/*
+ * Flushes the indexer if documents were added since the last flush. Only
+ * copying it takes the read lock: the copy is sorted and written once the
+ * lock is released, so documents keep coming in while it is written. Only
+ * the background thread flushes, until it is stopped.
+ */
+static bool flush_ingest(ingest_t *ingest) {
+    pthread_rwlock_rdlock(&ingest->lock);
+    long version = ingest->version;
+    indexer_t *copy = version != ingest->flushed_version ? copy_live_indexer(ingest->indexer) : NULL;
+    pthread_rwlock_unlock(&ingest->lock);
+    if (copy == NULL) {
+        return true;
+    }
+    sort_entries(copy);
+    bool success = ingest->flush(copy, ingest->argument);
+    destroy_indexer(copy);
+    if (success) {
+        ingest->flushed_version = version;
+    }
+    return success;
+}
+
+/*
+ * The background thread. It accepts connections as they come, and flushes
+ * the indexer every flush interval.
+ */
+static void *ingest_thread(void *argument) {
+    ingest_t *ingest = argument;
+    struct pollfd descriptors[2];
+    descriptors[0].fd = ingest->requests[0];
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = ingest->server;
+    descriptors[1].events = POLLIN;
+    long long deadline = get_milliseconds() + ingest->flush_interval;
+    while (true) {
+        long long left = deadline - get_milliseconds();
+        int ready = poll(descriptors, 2, left > 0 ? (int) left : 0);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        } else if (ready == 0) {
+            flush_ingest(ingest);
+            deadline = get_milliseconds() + ingest->flush_interval;
+            continue;
+        }
+        if ((descriptors[0].revents & POLLIN) != 0) {
+            char request;
+            if (read(ingest->requests[0], &request, 1) != 1 || request == 'q') {
+                break;
+            }
+        }
+        if ((descriptors[1].revents & POLLIN) != 0) {
+            accept_connection(ingest);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Creates the socket queries are served on. Returns -1 and prints an error
+ * if it can't be created.
+ */
+static int create_server(char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(struct sockaddr_un));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: The socket path '%s' is too long.\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server == -1) {
+        fprintf(stderr, "Error: Could not create the socket.\n");
+        return -1;
+    }
+    /* a socket left over from an earlier ingest is replaced */
+    unlink(socket_path);
+    if (bind(server, (struct sockaddr *) &address, sizeof(struct sockaddr_un)) == -1
+            || listen(server, INGEST_BACKLOG) == -1) {
+        fprintf(stderr, "Error: Could not listen on the socket '%s'.\n", socket_path);
+        close(server);
+        return -1;
+    }
+    return server;
+}
+
+/*
+ * Starts an ingest into an indexer.
+ */
+ingest_t *create_ingest(indexer_t *indexer, char *socket_path, ingest_flush_function_t *flush, void *argument,
+        int flush_interval) {
+    int server = create_server(socket_path);
+    if (server == -1) {
+        return NULL;
+    }
+    ingest_t *ingest = malloc(sizeof(ingest_t));
+    start_live_indexer(indexer);
+    ingest->indexer = indexer;
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&ingest->lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    ingest->version = 0;
+    ingest->flushed_version = 0;
+    ingest->flush = flush;
+    ingest->argument = argument;
+    ingest->flush_interval = flush_interval;
+    ingest->socket_path = strdup(socket_path);
+    ingest->server = server;
+    pthread_mutex_init(&ingest->connections_lock, NULL);
+    pthread_cond_init(&ingest->connections_closed, NULL);
+    ingest->connections = NULL;
+    ingest->connection_count = 0;
+    ingest->connection_capacity = 0;
+    /* a client that hangs up before its results are sent shouldn't stop the ingest */
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe(ingest->requests) == -1 || pthread_create(&ingest->thread, NULL, &ingest_thread, ingest) != 0) {
+        fprintf(stderr, "Error: Could not start serving queries.\n");
+        close(server);
+        unlink(socket_path);
+        pthread_rwlock_destroy(&ingest->lock);
+        pthread_mutex_destroy(&ingest->connections_lock);
+        pthread_cond_destroy(&ingest->connections_closed);
+        free(ingest->socket_path);
+        free(ingest);
+        return NULL;
+    }
+    return ingest;
+}
+
+/*
+ * Skips the white space of a JSON text.
+ */
+static char *skip_json_space(char *position) {
+    while (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r') {
+        position++;
+    }
+    return position;
+}
+
+/*
+ * Reads the four hex digits of a "\u" escape. Returns -1 if they aren't.
+ */
+static long read_json_hex(char *position) {
+    long value = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        if (!isxdigit((unsigned char) position[i])) {
+            return -1;
+        }
+        value = value * 16 + (isdigit((unsigned char) position[i]) ? position[i] - '0'
+                : tolower((unsigned char) position[i]) - 'a' + 10);
+    }
+    return value;
+}
+
+/*
+ * Writes a code point as UTF-8. Returns the position after it.
+ */
+static char *write_utf8(char *position, long code_point) {
+    if (code_point < 0x80) {
+        *position++ = (char) code_point;
+    } else if (code_point < 0x800) {
+        *position++ = (char) (0xc0 | code_point >> 6);
+        *position++ = (char) (0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        *position++ = (char) (0xe0 | code_point >> 12);
+        *position++ = (char) (0x80 | (code_point >> 6 & 0x3f));
+        *position++ = (char) (0x80 | (code_point & 0x3f));
+    } else {
+        *position++ = (char) (0xf0 | code_point >> 18);
+        *position++ = (char) (0x80 | (code_point >> 12 & 0x3f));
+        *position++ = (char) (0x80 | (code_point >> 6 & 0x3f));
+        *position++ = (char) (0x80 | (code_point & 0x3f));
+    }
+    return position;
+}
+
+/*
+ * Reads a JSON string, given the position of its opening quote, and sets
+ * the given pointer to its decoded value (unless it is NULL). An escaped
+ * null character becomes a space. Returns the position after the closing
+ * quote, or NULL if the string is invalid.
+ */
+static char *read_json_string(char *position, char **value) {
+    if (*position++ != '"') {
+        return NULL;
+    }
+    /* a decoded string is never longer than its escaped form */
+    char *end = position;
+    while (*end != '"') {
+        if (*end == '\0' || (*end == '\\' && *++end == '\0')) {
+            return NULL;
+        }
+        end++;
+    }
+    char *string = malloc(end - position + 1);
+    char *output = string;
+    while (*position != '"') {
+        if (*position != '\\') {
+            *output++ = *position++;
+            continue;
+        }
+        position++;
+        char escape = *position++;
+        const char *escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+        const char *match = strchr(escapes, escape);
+        if (escape != 'u' && match != NULL && (match - escapes) % 2 == 0) {
+            *output++ = match[1];
+            continue;
+        }
+        long code_point = escape == 'u' ? read_json_hex(position) : -1;
+        if (code_point == -1) {
+            free(string);
+            return NULL;
+        }
+        position += 4;
+        if (code_point >= 0xd800 && code_point < 0xdc00 && position[0] == '\\' && position[1] == 'u') {
+            /* a surrogate pair */
+            long low = read_json_hex(position + 2);
+            if (low >= 0xdc00 && low < 0xe000) {
+                code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                position += 6;
+            }
+        }
+        output = write_utf8(output, code_point == 0 ? ' ' : code_point);
+    }
+    *output = '\0';
+    if (value != NULL) {
+        *value = string;
+    } else {
+        free(string);
+    }
+    return position + 1;
+}
+
+/*
+ * Skips a JSON value of any type. Returns the position after it, or NULL if
+ * it is invalid.
+ */
+static char *skip_json_value(char *position) {
+    if (*position == '"') {
+        return read_json_string(position, NULL);
+    } else if (*position == '{' || *position == '[') {
+        char close = *position == '{' ? '}' : ']';
+        position = skip_json_space(position + 1);
+        if (*position == close) {
+            return position + 1;
+        }
+        while (position != NULL) {
+            if (close == '}') {
+                position = read_json_string(position, NULL);
+                if (position == NULL || *(position = skip_json_space(position)) != ':') {
+                    return NULL;
+                }
+                position = skip_json_space(position + 1);
+            }
+            position = skip_json_value(position);
+            if (position == NULL) {
+                return NULL;
+            }
+            position = skip_json_space(position);
+            if (*position == close) {
+                return position + 1;
+            } else if (*position != ',') {
+                return NULL;
+            }
+            position = skip_json_space(position + 1);
+        }
+        return NULL;
+    }
+    /* numbers, true, false and null */
+    char *start = position;
+    while (isalnum((unsigned char) *position) || *position == '-' || *position == '+' || *position == '.') {
+        position++;
+    }
+    return position != start ? position : NULL;
+}
+
+/*
+ * Reads the id and the body of a record. Returns false if the record is
+ * invalid, or doesn't have both.
+ */
+static bool read_record(char *record, char **id, char **body) {
+    *id = NULL;
+    *body = NULL;
+    char *position = skip_json_space(record);
+    if (*position++ != '{') {
+        return false;
+    }
+    position = skip_json_space(position);
+    bool valid = true;
+    while (valid && *position != '}') {
+        char *key = NULL;
+        position = read_json_string(position, &key);
+        valid = position != NULL && *(position = skip_json_space(position)) == ':';
+        if (valid) {
+            position = skip_json_space(position + 1);
+            char **value = strcmp(key, "id") == 0 ? id : (strcmp(key, "body") == 0 ? body : NULL);
+            if (value != NULL && *value == NULL && *position == '"') {
+                position = read_json_string(position, value);
+            } else if (value == id && *id == NULL && (*position == '-' || isdigit((unsigned char) *position))) {
+                /* a numeric id is kept as it is written */
+                char *start = position;
+                position = skip_json_value(position);
+                if (position != NULL) {
+                    *id = strndup(start, position - start);
+                }
+            } else if (value != NULL) {
+                valid = false;
+            } else {
+                position = skip_json_value(position);
+            }
+        }
+        free(key);
+        valid = valid && position != NULL;
+        if (valid) {
+            position = skip_json_space(position);
+            if (*position == ',') {
+                position = skip_json_space(position + 1);
+                valid = *position != '}';
+            } else {
+                valid = *position == '}';
+            }
+        }
+    }
+    valid = valid && *skip_json_space(position + 1) == '\0' && *id != NULL && *body != NULL;
+    if (!valid) {
+        free(*id);
+        free(*body);
+    }
+    return valid;
+}
+
+/*
+ * Checks whether an id can be used as the path of a document. Paths are
+ * separated by spaces in an index file, and lines that start with '<' are
+ * section tags.
+ */
+static bool is_valid_id(char *id) {
+    if (*id == '\0' || *id == '<') {
+        return false;
+    }
+    for (; *id != '\0'; id++) {
+        if (isspace((unsigned char) *id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Adds a document to an ingest.
+ */
+bool ingest_record(ingest_t *ingest, char *record) {
+    char *id;
+    char *body;
+    if (!read_record(record, &id, &body)) {
+        return false;
+    }
+    if (!is_valid_id(id)) {
+        free(id);
+        free(body);
+        return false;
+    }
+    pthread_rwlock_wrlock(&ingest->lock);
+    if (get_document_id(ingest->indexer, id) >= 0) {
+        /* the new version of a document replaces the old one */
+        remove_document(ingest->indexer, id);
+    }
+    index_document(ingest->indexer, id, body);
+    ingest->version++;
+    pthread_rwlock_unlock(&ingest->lock);
+    free(id);
+    free(body);
+    return true;
+}
+
+/*
+ * Stops an ingest, and flushes it one last time.
+ */
+bool finish_ingest(ingest_t *ingest) {
+    char request = 'q';
+    if (write(ingest->requests[1], &request, 1) == 1) {
+        pthread_join(ingest->thread, NULL);
+    } else {
+        pthread_detach(ingest->thread);
+    }
+    close(ingest->server);
+    unlink(ingest->socket_path);
+    /* the connections are hung up on, and we wait for their threads to let go */
+    pthread_mutex_lock(&ingest->connections_lock);
+    int i;
+    for (i = 0; i < ingest->connection_count; i++) {
+        shutdown(ingest->connections[i], SHUT_RDWR);
+    }
+    while (ingest->connection_count > 0) {
+        pthread_cond_wait(&ingest->connections_closed, &ingest->connections_lock);
+    }
+    pthread_mutex_unlock(&ingest->connections_lock);
+    bool success = flush_ingest(ingest);
+    close(ingest->requests[0]);
+    close(ingest->requests[1]);
+    pthread_rwlock_destroy(&ingest->lock);
+    pthread_mutex_destroy(&ingest->connections_lock);
+    pthread_cond_destroy(&ingest->connections_closed);
+    free(ingest->connections);
+    free(ingest->socket_path);
+    free(ingest);
+    return success;
+}
@@ -0,0 +1,54 @@
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+#include <stdbool.h>
+#include "indexer.h"
+
+/*
+ * A streaming ingest into an in-memory indexer. Documents are added to the
+ * indexer one record at a time as they arrive, and every one of them can be
+ * searched as soon as it is added: queries are served over a Unix socket,
+ * on their own threads, while more documents come in. The indexer is
+ * flushed to disk periodically, but only if it changed.
+ */
+typedef struct ingest ingest_t;
+
+/*
+ * Writes an ingested indexer to disk, given a sorted copy of the indexer
+ * (see copy_live_indexer) and the argument passed to create_ingest. Returns
+ * false if it could not be
+ * written. Implemented by the caller.
+ */
+typedef bool ingest_flush_function_t(indexer_t *, void *);
+
+/*
+ * Starts an ingest into an indexer, given the indexer, whose document table
+ * must have been built and which must have no bitmaps (see
+ * decompress_postings), and which is made live, the path of the socket to serve queries on, the
+ * flush function, its argument, and the number of milliseconds between
+ * flushes. Every connection to the socket can send search commands, one per
+ * line, and gets one line of results back for each, as from the search
+ * program, until it sends "q" or hangs up. Returns NULL and prints an error
+ * if the socket can't be created. The ingest is stopped and freed using
+ * finish_ingest.
+ */
+ingest_t *create_ingest(indexer_t *, char *, ingest_flush_function_t *, void *, int);
+
+/*
+ * Adds a document to an ingest, given the ingest and a record: a JSON
+ * object with an "id" (a string or a number without spaces) and a "body"
+ * string, on a single line. Other fields are ignored. The document is
+ * indexed under its id, and a document with an id that was already
+ * ingested replaces the earlier one. Returns false if the record is
+ * invalid.
+ */
+bool ingest_record(ingest_t *, char *);
+
+/*
+ * Stops serving queries, waits for the queries in progress, flushes the
+ * indexer one last time if it changed, and frees the ingest. The indexer
+ * is left to the caller. Returns false if the last flush failed.
+ */
+bool finish_ingest(ingest_t *);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "levenshtein.h"
+
+struct levenshtein_automaton {
+    /* the characters of the term */
+    uint32_t *pattern;
+    int length;
+    int distance;
+    /* the state after every prefix of the last term matched: the row of the
+     * edit distance table after level characters, its minimum, the
+     * character read to get there and the byte offset just past it */
+    int *rows;
+    int *minimums;
+    uint32_t *characters;
+    size_t *ends;
+    int level_capacity;
+    /* the levels that are valid for the last term */
+    int level_count;
+    char *last_term;
+    size_t last_capacity;
+};
+
+/*
+ * Decodes a UTF-8 character. Bytes that don't start a valid sequence are
+ * read as characters of their own. Returns the number of bytes read.
+ */
+static int decode_character(const unsigned char *position, uint32_t *character) {
+    int size = *position >= 0xf0 ? 4 : (*position >= 0xe0 ? 3 : (*position >= 0xc0 ? 2 : 1));
+    if (*position >= 0xf8 || (*position >= 0x80 && *position < 0xc0)) {
+        size = 1;
+    }
+    uint32_t value = size == 1 ? *position : *position & (0x7f >> size);
+    int i;
+    for (i = 1; i < size; i++) {
+        if ((position[i] & 0xc0) != 0x80) {
+            *character = *position;
+            return 1;
+        }
+        value = value << 6 | (position[i] & 0x3f);
+    }
+    *character = value;
+    return size;
+}
+
+/*
+ * Encodes a character as UTF-8. Returns the number of bytes written.
+ */
+static int encode_character(uint32_t character, char *position) {
+    if (character < 0x80) {
+        position[0] = (char) character;
+        return 1;
+    } else if (character < 0x800) {
+        position[0] = (char) (0xc0 | character >> 6);
+        position[1] = (char) (0x80 | (character & 0x3f));
+        return 2;
+    } else if (character < 0x10000) {
+        position[0] = (char) (0xe0 | character >> 12);
+        position[1] = (char) (0x80 | (character >> 6 & 0x3f));
+        position[2] = (char) (0x80 | (character & 0x3f));
+        return 3;
+    }
+    position[0] = (char) (0xf0 | character >> 18);
+    position[1] = (char) (0x80 | (character >> 12 & 0x3f));
+    position[2] = (char) (0x80 | (character >> 6 & 0x3f));
+    position[3] = (char) (0x80 | (character & 0x3f));
+    return 4;
+}
+
+/*
+ * Creates an automaton for a term. Its first row is the distance of every
+ * prefix of the term from the empty string.
+ */
+levenshtein_automaton_t *create_levenshtein_automaton(const char *term, int distance) {
+    levenshtein_automaton_t *automaton = malloc(sizeof(levenshtein_automaton_t));
+    size_t size = strlen(term);
+    automaton->pattern = malloc((size > 0 ? size : 1) * sizeof(uint32_t));
+    automaton->length = 0;
+    const unsigned char *position = (const unsigned char *) term;
+    while (*position != '\0') {
+        position += decode_character(position, &automaton->pattern[automaton->length++]);
+    }
+    automaton->distance = distance;
+    automaton->level_capacity = 16;
+    automaton->rows = malloc(automaton->level_capacity * (automaton->length + 1) * sizeof(int));
+    automaton->minimums = malloc(automaton->level_capacity * sizeof(int));
+    automaton->characters = malloc(automaton->level_capacity * sizeof(uint32_t));
+    automaton->ends = malloc(automaton->level_capacity * sizeof(size_t));
+    int j;
+    for (j = 0; j <= automaton->length; j++) {
+        automaton->rows[j] = j;
+    }
+    automaton->minimums[0] = 0;
+    automaton->characters[0] = 0;
+    automaton->ends[0] = 0;
+    automaton->level_count = 1;
+    automaton->last_capacity = 64;
+    automaton->last_term = malloc(automaton->last_capacity);
+    automaton->last_term[0] = '\0';
+    return automaton;
+}
+
+/*
+ * Destroys an automaton.
+ */
+void destroy_levenshtein_automaton(levenshtein_automaton_t *automaton) {
+    free(automaton->pattern);
+    free(automaton->rows);
+    free(automaton->minimums);
+    free(automaton->characters);
+    free(automaton->ends);
+    free(automaton->last_term);
+    free(automaton);
+}
+
+/*
+ * Computes the row after reading a character at the given level from the
+ * row before it.
+ */
+static void step_automaton(levenshtein_automaton_t *automaton, int level, uint32_t character, size_t end) {
+    if (level == automaton->level_capacity) {
+        automaton->level_capacity *= 2;
+        automaton->rows = realloc(automaton->rows,
+                automaton->level_capacity * (automaton->length + 1) * sizeof(int));
+        automaton->minimums = realloc(automaton->minimums, automaton->level_capacity * sizeof(int));
+        automaton->characters = realloc(automaton->characters, automaton->level_capacity * sizeof(uint32_t));
+        automaton->ends = realloc(automaton->ends, automaton->level_capacity * sizeof(size_t));
+    }
+    int *previous = automaton->rows + (level - 1) * (automaton->length + 1);
+    int *row = previous + automaton->length + 1;
+    row[0] = previous[0] + 1;
+    int minimum = row[0];
+    int j;
+    for (j = 1; j <= automaton->length; j++) {
+        int cost = previous[j - 1] + (automaton->pattern[j - 1] != character);
+        if (previous[j] + 1 < cost) {
+            cost = previous[j] + 1;
+        }
+        if (row[j - 1] + 1 < cost) {
+            cost = row[j - 1] + 1;
+        }
+        row[j] = cost;
+        if (cost < minimum) {
+            minimum = cost;
+        }
+    }
+    automaton->minimums[level] = minimum;
+    automaton->characters[level] = character;
+    automaton->ends[level] = end;
+}
+
+/*
+ * Works out where to skip to once the term can't match past the given
+ * level. The row before a character rules it out only if none of its
+ * entries are below the distance, and then only the characters of the term
+ * that continue an entry at the distance keep it alive. So we look for the
+ * smallest such character after the one that was read, going back a level
+ * every time there is none. Returns LEVENSHTEIN_SKIP with the string in
+ * the buffer, or LEVENSHTEIN_DONE if no later string can match.
+ */
+static int find_next_string(levenshtein_automaton_t *automaton, const char *term, int level, char *next) {
+    int level_before;
+    for (level_before = level - 1; level_before >= 0; level_before--) {
+        int *row = automaton->rows + level_before * (automaton->length + 1);
+        uint32_t read = automaton->characters[level_before + 1];
+        size_t start = automaton->ends[level_before];
+        if (automaton->minimums[level_before] < automaton->distance) {
+            /* every character keeps this prefix alive, so we skip to the
+             * first string after those that start with the one that was read */
+            size_t end = automaton->ends[level_before + 1];
+            memcpy(next, term, end);
+            while (end > start && (unsigned char) next[end - 1] == 0xff) {
+                end--;
+            }
+            if (end > start) {
+                next[end - 1]++;
+                next[end] = '\0';
+                return LEVENSHTEIN_SKIP;
+            }
+            continue;
+        }
+        bool found = false;
+        uint32_t best = 0;
+        int j;
+        for (j = 1; j <= automaton->length; j++) {
+            uint32_t character = automaton->pattern[j - 1];
+            if (row[j - 1] == automaton->distance && character > read && (!found || character < best)) {
+                best = character;
+                found = true;
+            }
+        }
+        if (found) {
+            memcpy(next, term, start);
+            next[start + encode_character(best, next + start)] = '\0';
+            return LEVENSHTEIN_SKIP;
+        }
+    }
+    return LEVENSHTEIN_DONE;
+}
+
+/*
+ * Matches a term, reusing the levels of the prefix it shares with the last
+ * term that was matched.
+ */
+int match_levenshtein_term(levenshtein_automaton_t *automaton, const char *term, char *next) {
+    size_t common = 0;
+    while (term[common] != '\0' && term[common] == automaton->last_term[common]) {
+        common++;
+    }
+    int level = 0;
+    while (level + 1 < automaton->level_count && automaton->ends[level + 1] <= common) {
+        level++;
+    }
+    size_t size = strlen(term);
+    if (size + 1 > automaton->last_capacity) {
+        automaton->last_capacity = size + 1;
+        automaton->last_term = realloc(automaton->last_term, automaton->last_capacity);
+    }
+    memcpy(automaton->last_term, term, size + 1);
+    size_t position = automaton->ends[level];
+    while (automaton->minimums[level] <= automaton->distance && term[position] != '\0') {
+        uint32_t character;
+        position += decode_character((const unsigned char *) term + position, &character);
+        level++;
+        step_automaton(automaton, level, character, position);
+    }
+    automaton->level_count = level + 1;
+    if (automaton->minimums[level] > automaton->distance) {
+        return find_next_string(automaton, term, level, next);
+    }
+    int distance = automaton->rows[level * (automaton->length + 1) + automaton->length];
+    return distance <= automaton->distance ? distance : LEVENSHTEIN_NO_MATCH;
+}
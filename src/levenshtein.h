@@ -0,0 +1,49 @@
+#ifndef _LEVENSHTEIN_H_
+#define _LEVENSHTEIN_H_
+
+/*
+ * A Levenshtein automaton: it accepts the strings that are at most a given
+ * number of edits (inserted, deleted or substituted characters) away from a
+ * term. It reads UTF-8, one character at a time, and its state after a
+ * prefix is a row of the edit distance table, so the terms of a sorted
+ * dictionary are matched by reusing the rows of the prefix each one shares
+ * with the term before it. Once a prefix can't lead to a match, it tells
+ * the caller the first string after it that could, so whole ranges of the
+ * dictionary are skipped rather than compared.
+ */
+typedef struct levenshtein_automaton levenshtein_automaton_t;
+
+/*
+ * What match_levenshtein_term found, besides the edit distance of a match.
+ */
+typedef enum levenshtein_result {
+    /* the term doesn't match, but the term after it might */
+    LEVENSHTEIN_NO_MATCH = -1,
+    /* the term doesn't match, nor does any term before the string given back */
+    LEVENSHTEIN_SKIP = -2,
+    /* neither the term nor any term after it matches */
+    LEVENSHTEIN_DONE = -3
+} levenshtein_result_t;
+
+/*
+ * Creates an automaton, given the term and the largest edit distance it
+ * accepts. The caller is responsible for freeing the automaton using
+ * destroy_levenshtein_automaton.
+ */
+levenshtein_automaton_t *create_levenshtein_automaton(const char *, int);
+
+/*
+ * Destroys an automaton.
+ */
+void destroy_levenshtein_automaton(levenshtein_automaton_t *);
+
+/*
+ * Matches a term, given the automaton, the term, and a buffer of at least
+ * the term's length plus five bytes. Terms are meant to be matched in
+ * ascending order. Returns the edit distance of the term if it matches, or
+ * a levenshtein_result_t. With LEVENSHTEIN_SKIP, the buffer holds the
+ * string to skip ahead to, which is always greater than the term.
+ */
+int match_levenshtein_term(levenshtein_automaton_t *, const char *, char *);
+
+#endif
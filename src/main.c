@@ -1,157 +1,74 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include "index_parser.h"
-#include "util.h"
+#include "index_set.h"
+#include "index_handle.h"
+#include "search_command.h"
 
 /*
- * Handles a logical 'or' search.
+ * Acquires the current index sets of the given handles, and combines them
+ * into a single set that searches all of their indexers at once. The
+ * combined set only borrows the indexers, so it is freed with
+ * release_index_sets rather than destroy_index_set.
  */
-static void handle_or_search(indexer_t *indexer, list_iterator_t *token_iterator, list_t *results) {
-    /* we iterate through every token */
-    char *token = next_item(token_iterator);
-    while (token != NULL) {
-        /* we attempt to find an indexer entry for our token */
-        indexer_entry_t *entry = get_indexer_entry(indexer, token);
-        if (entry != NULL) {
-            /* if we have one, we iterate through every record in the entry */
-            list_iterator_t *entry_record_iterator = create_iterator(entry->records);
-            indexer_entry_record_t *record = get_item(entry_record_iterator);
-            while (record != NULL) {
-                /* if the record isn't already in our result list, we insert it */
-                if (!contains_object(results, record->file_path)) {
-                    insert_object(results, strdup(record->file_path));
-                }
-                record = next_item(entry_record_iterator);
-            }
-            destroy_iterator(entry_record_iterator);
-        }
-        token = next_item(token_iterator);
+static index_set_t *acquire_index_sets(index_handle_t **handles, int count, index_set_t **sets) {
+    if (count == 1) {
+        sets[0] = acquire_index_set(handles[0]);
+        return sets[0];
     }
-}
-
-/*
- * Checks to see whether or not the given record is mapped
- * to every token in the given list for the given indexer.
- */
-static bool check_record(indexer_t *indexer, list_t *tokens, indexer_entry_record_t *record) {
-    bool success = true;
-    list_iterator_t *token_iterator = create_iterator(tokens);
-    /* we skip the first token, it's the command */
-    char *token = next_item(token_iterator);
-    while (token != NULL) {
-        indexer_entry_t *token_entry = get_indexer_entry(indexer, token);
-        if (token_entry == NULL) {
-            /* we don't have an entry for this token */
-            success = false;
-            break;
-        }
-        if(get_indexer_entry_record(token_entry, record->file_path) == NULL) {
-            /* the entry for this token doesn't contain our record */
-            success = false;
-            break;
-        }
-        token = next_item(token_iterator);
+    index_set_t *combined = malloc(sizeof(index_set_t));
+    combined->indexers = NULL;
+    combined->count = 0;
+    combined->disjoint = false;
+    combined->references = 1;
+    int i;
+    for (i = 0; i < count; i++) {
+        sets[i] = acquire_index_set(handles[i]);
+        combined->indexers = realloc(combined->indexers, (combined->count + sets[i]->count) * sizeof(indexer_t *));
+        memcpy(combined->indexers + combined->count, sets[i]->indexers, sets[i]->count * sizeof(indexer_t *));
+        combined->count += sets[i]->count;
     }
-    destroy_iterator(token_iterator);
-    return success;
+    return combined;
 }
 
 /*
- * Handles an 'and' search.
+ * Releases the index sets acquired with acquire_index_sets, and frees the
+ * set that combined them.
  */
-static void handle_and_search(indexer_t *indexer, list_t *tokens, list_t *results) {
-    /* we iterate through every entry in the indexer */
-    list_iterator_t *entry_iterator = create_iterator(indexer->entries);
-    indexer_entry_t *entry = get_item(entry_iterator);
-    while (entry != NULL) {
-        /* if this entry's token is one of ours, we want to work with it */
-        if (contains_object(tokens, entry->token)) {
-            /* we iterate through every record in the entry */
-            list_iterator_t *record_iterator = create_iterator(entry->records);
-            indexer_entry_record_t *record = get_item(record_iterator);
-            while (record != NULL) {
-                /* we check to see if the record is mapped to every token and isn't already a result */
-                if(check_record(indexer, tokens, record) && !contains_object(results, record->file_path)) {
-                    insert_object(results, strdup(record->file_path));
-                }
-                record = next_item(record_iterator);
-            }
-            destroy_iterator(record_iterator);
-        }
-        entry = next_item(entry_iterator);
+static void release_index_sets(index_set_t *combined, index_set_t **sets, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        release_index_set(sets[i]);
     }
-    destroy_iterator(entry_iterator);
-}
-
-/*
- * Prints the given search results to the standard out.
- */
-static void print_results(list_t *results) {
-    list_iterator_t *results_iterator = create_iterator(results);
-    char *result = get_item(results_iterator);
-    while (result != NULL) {
-        printf("[%s]", result);
-        result = next_item(results_iterator);
-        if (result != NULL) printf(", ");
+    if (count > 1) {
+        free(combined->indexers);
+        free(combined);
     }
-    printf("\n");
-    destroy_iterator(results_iterator);
-}
-
-static int compare_function(void *first_object, void *second_object) {
-    char *first = first_object;
-    char *second = second_object;
-    int result = strcmp(first, second);
-    return result == 0 ? 0 : (result > 0 ? 1 : -1);
-}
-
-static void destroy_function(void *object) {
-    free(object);
-}
-
-/*
- * Parses and handles user input, given the indexer.
- */
-static bool handle_input(indexer_t *indexer, char *input) {
-    /* first, we tokenize the input */
-    list_t *tokens = tokenize(input, ' ', true);
-    list_iterator_t *token_iterator = create_iterator(tokens);
-    char *command = get_item(token_iterator);
-
-    list_t *results = create_list(&compare_function, &destroy_function);
-    bool success = true;
-    /* next, we check to see which command the user entered */
-    if (strcmp(command, "sa") == 0) {
-        /* time to do an 'and' search */
-        handle_and_search(indexer, tokens, results);
-    } else if (strcmp(command, "so") == 0) {
-        /* time to do an 'or' search */
-        handle_or_search(indexer, token_iterator, results);
-    } else {
-        /* invalid command, we need to tell the user */
-        success = false;
-    }
-    /* if we have any results, we should print them */
-    print_results(results);
-    destroy_list(results);
-
-    destroy_iterator(token_iterator);
-    destroy_list(tokens);
-    return success;
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
+    if (argc < 2) {
         fprintf(stderr, "Error: Invalid number of arguments.\n"
-                "Usage: search <inverted-index file name>\n");
+                "Usage: search <inverted-index file name> [<inverted-index file name> ...]\n");
         return EXIT_FAILURE;
     }
-    /* first, we parse the indexer file and load it into memory */
-    indexer_t *indexer = parse_indexer_file(argv[1]);
-    if(indexer == NULL) {
-        /* we couldn't parse/load the indexer */
-        return EXIT_FAILURE;
+    /* first, we parse every indexer file (or all of its shards) and load it into memory.
+     * each index is reloaded in the background, on its own, whenever it is rewritten */
+    int handle_count = argc - 1;
+    index_handle_t **handles = malloc(handle_count * sizeof(index_handle_t *));
+    index_set_t **index_sets = malloc(handle_count * sizeof(index_set_t *));
+    int i;
+    for (i = 0; i < handle_count; i++) {
+        handles[i] = create_index_handle(argv[i + 1]);
+        if (handles[i] == NULL) {
+            /* we couldn't parse/load the indexer */
+            while (i-- > 0) {
+                destroy_index_handle(handles[i]);
+            }
+            free(handles);
+            free(index_sets);
+            return EXIT_FAILURE;
+        }
     }
     /* we poll the user for commands, waiting for the 'quit' command to exit */
     char input[300];
@@ -159,15 +76,30 @@ int main(int argc, char **argv) {
     fgets(input, 300, stdin);
     input[strlen(input) - 1] = '\0';
     while (strcmp(input, "q") != 0) {
-        if (!handle_input(indexer, input)) {
-            /* user entered an invalid command */
-            fprintf(stderr, "Error: Invalid command.\n");
+        if (strcmp(input, "r") == 0) {
+            /* the user wants the indexes reloaded now, which happens in the background */
+            for (i = 0; i < handle_count; i++) {
+                request_index_reload(handles[i]);
+            }
+        } else {
+            /* every command runs on the versions of the indexes that are current when it starts,
+             * and searches all of them concurrently */
+            index_set_t *index_set = acquire_index_sets(handles, handle_count, index_sets);
+            if (!handle_search_command(index_set, input, stdout)) {
+                /* user entered an invalid command */
+                fprintf(stderr, "Error: Invalid command.\n");
+            }
+            release_index_sets(index_set, index_sets, handle_count);
         }
         fflush(stdout);
         *input = '\0';
         fgets(input, 300, stdin);
         input[strlen(input) - 1] = '\0';
     }
-    destroy_indexer(indexer);
+    for (i = 0; i < handle_count; i++) {
+        destroy_index_handle(handles[i]);
+    }
+    free(handles);
+    free(index_sets);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
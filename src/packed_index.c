@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include "packed_index.h"
+
+struct packed_index {
+    term_dictionary_t *terms;
+    /* the ids of every term without a bitmap, back to back: those of the
+     * term with id i go from starts[i] up to starts[i + 1] */
+    uint32_t *ids;
+    uint32_t *starts;
+    /* the terms with a bitmap, by ascending term id */
+    int *bitmap_terms;
+    roaring_t **bitmaps;
+    int bitmap_count;
+};
+
+/*
+ * Packs the entries of an indexer. Entries are sorted by token, so the
+ * position of an entry in the list is its term id.
+ */
+void pack_indexer(indexer_t *indexer) {
+    int count = get_size(indexer->entries);
+    char **tokens = malloc((count > 0 ? count : 1) * sizeof(char *));
+    packed_index_t *packed = malloc(sizeof(packed_index_t));
+    packed->starts = malloc((count + 1) * sizeof(uint32_t));
+    packed->bitmap_terms = NULL;
+    packed->bitmaps = NULL;
+    packed->bitmap_count = 0;
+
+    /* first we count the ids, so they can go in an array of the right size */
+    size_t id_count = 0;
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        indexer_entry_t *entry = element->value;
+        if (entry->bitmap == NULL) {
+            id_count += get_size(entry->records);
+        } else {
+            packed->bitmap_count++;
+        }
+        element = element->next;
+    }
+    packed->ids = malloc((id_count > 0 ? id_count : 1) * sizeof(uint32_t));
+    if (packed->bitmap_count > 0) {
+        packed->bitmap_terms = malloc(packed->bitmap_count * sizeof(int));
+        packed->bitmaps = malloc(packed->bitmap_count * sizeof(roaring_t *));
+    }
+
+    /* next, we copy every entry's postings over, taking its bitmap */
+    uint32_t position = 0;
+    int bitmap_count = 0;
+    int i = 0;
+    element = indexer->entries->head;
+    while (element != NULL) {
+        indexer_entry_t *entry = element->value;
+        tokens[i] = entry->token;
+        packed->starts[i] = position;
+        if (entry->bitmap != NULL) {
+            trim_roaring(entry->bitmap);
+            packed->bitmap_terms[bitmap_count] = i;
+            packed->bitmaps[bitmap_count++] = entry->bitmap;
+            entry->bitmap = NULL;
+        } else {
+            /* paths that appear twice in an appended file come out once, so
+             * this never takes more than was counted */
+            postings_t *postings = create_entry_postings(indexer, entry);
+            memcpy(packed->ids + position, postings->ids, postings->size * sizeof(uint32_t));
+            position += (uint32_t) postings->size;
+            destroy_postings(postings);
+        }
+        i++;
+        element = element->next;
+    }
+    packed->starts[count] = position;
+    packed->ids = realloc(packed->ids, (position > 0 ? position : 1) * sizeof(uint32_t));
+    packed->terms = create_term_dictionary(tokens, count);
+    set_dictionary_hash(packed->terms, create_term_hash(tokens, count));
+    free(tokens);
+
+    /* the entries aren't needed to answer queries anymore */
+    list_t *entries = indexer->entries;
+    indexer->entries = create_list(entries->compare_function, entries->destroy_function);
+    destroy_list(entries);
+    indexer->packed = packed;
+}
+
+/*
+ * Destroys a packed index.
+ */
+void destroy_packed_index(packed_index_t *packed) {
+    int i;
+    for (i = 0; i < packed->bitmap_count; i++) {
+        destroy_roaring(packed->bitmaps[i]);
+    }
+    destroy_term_dictionary(packed->terms);
+    free(packed->ids);
+    free(packed->starts);
+    free(packed->bitmap_terms);
+    free(packed->bitmaps);
+    free(packed);
+}
+
+/*
+ * Finds the bitmap of a term by binary search. Returns NULL if the term
+ * has no bitmap.
+ */
+static roaring_t *find_bitmap(packed_index_t *packed, int term) {
+    int low = 0;
+    int high = packed->bitmap_count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (packed->bitmap_terms[middle] == term) {
+            return packed->bitmaps[middle];
+        } else if (packed->bitmap_terms[middle] < term) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Gets the document frequency of a term.
+ */
+long get_packed_frequency(indexer_t *indexer, char *token) {
+    packed_index_t *packed = indexer->packed;
+    int term = find_dictionary_term(packed->terms, token);
+    if (term < 0) {
+        return 0;
+    }
+    roaring_t *bitmap = find_bitmap(packed, term);
+    return bitmap != NULL ? bitmap->cardinality : (long) (packed->starts[term + 1] - packed->starts[term]);
+}
+
+/*
+ * Gets the terms of a packed indexer.
+ */
+term_dictionary_t *get_packed_terms(indexer_t *indexer) {
+    return indexer->packed->terms;
+}
+
+/*
+ * Gets the postings list of a term. Bitmaps are shared with the packed
+ * index rather than copied, just like those of entries.
+ */
+postings_t *get_packed_postings(indexer_t *indexer, char *token) {
+    packed_index_t *packed = indexer->packed;
+    int term = find_dictionary_term(packed->terms, token);
+    if (term < 0) {
+        return create_postings(0);
+    }
+    roaring_t *bitmap = find_bitmap(packed, term);
+    if (bitmap != NULL) {
+        return create_bitmap_postings(bitmap, false);
+    }
+    int size = (int) (packed->starts[term + 1] - packed->starts[term]);
+    postings_t *postings = create_postings(size);
+    memcpy(postings->ids, packed->ids + packed->starts[term], size * sizeof(uint32_t));
+    postings->size = size;
+    return postings;
+}
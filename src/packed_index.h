@@ -0,0 +1,50 @@
+#ifndef _PACKED_INDEX_H_
+#define _PACKED_INDEX_H_
+
+#include "indexer.h"
+#include "postings.h"
+#include "term_dictionary.h"
+
+/*
+ * The read-only form a fully loaded index is searched in. Its terms are
+ * kept in a front-coded term dictionary, which finds them through a term
+ * hash built when the index is packed, and the postings of every term
+ * are kept back to back in a single array of document ids, except for the
+ * high-frequency terms, which keep their bitmaps. This takes a fraction of
+ * the memory of the entries and records the index was parsed into.
+ */
+typedef struct packed_index packed_index_t;
+
+/*
+ * Packs the entries of an indexer, whose document table must have been
+ * built, and whose high-frequency terms may have been compressed already.
+ * The entries are freed, and the indexer's packed index is set. The packed
+ * index is owned by whoever packed it, and is freed using
+ * destroy_packed_index.
+ */
+void pack_indexer(indexer_t *);
+
+/*
+ * Destroys a packed index, along with its bitmaps.
+ */
+void destroy_packed_index(packed_index_t *);
+
+/*
+ * Gets the document frequency of a term, given a packed indexer and the
+ * term.
+ */
+long get_packed_frequency(indexer_t *, char *);
+
+/*
+ * Gets the terms of a packed indexer. The dictionary belongs to the packed
+ * index.
+ */
+term_dictionary_t *get_packed_terms(indexer_t *);
+
+/*
+ * Gets the postings list of a term, given a packed indexer and the term.
+ * The caller is responsible for freeing the returned postings list.
+ */
+postings_t *get_packed_postings(indexer_t *, char *);
+
+#endif
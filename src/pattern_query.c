@@ -0,0 +1,674 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "pattern_query.h"
+#include "trigram.h"
+
+/*
+ * The most strings a set of strings is allowed to hold before its strings
+ * are shortened to keep it small.
+ */
+#ifndef MAX_PATTERN_STRINGS
+#define MAX_PATTERN_STRINGS 16
+#endif
+
+/*
+ * The most characters of a bracket expression that are tracked one by one;
+ * larger ones are treated like '.'.
+ */
+#define MAX_PATTERN_CLASS 8
+
+/*
+ * A set of distinct strings.
+ */
+typedef struct string_set {
+    char **strings;
+    int count;
+} string_set_t;
+
+/*
+ * What is known about the strings a part of an expression matches: whether
+ * it can match the empty string, the exact set of strings it matches when
+ * that set is small, or else the sets of their prefixes and suffixes, and a
+ * query every document containing one of the strings satisfies (NULL when
+ * nothing is known). Strings are case-folded, and prefixes and suffixes are
+ * kept to at most two characters, since their trigrams are added to the
+ * query before they are shortened.
+ */
+typedef struct pattern_info {
+    bool empty;
+    bool exact_known;
+    string_set_t exact;
+    string_set_t prefix;
+    string_set_t suffix;
+    query_node_t *match;
+} pattern_info_t;
+
+/*
+ * The state of the parser: the expression, and the current position in it.
+ */
+typedef struct pattern_scanner {
+    const char *position;
+} pattern_scanner_t;
+
+/*
+ * Adds a copy of the first given number of bytes of a string to a set,
+ * unless the set already holds it.
+ */
+static void add_set_string(string_set_t *set, const char *string, size_t length) {
+    int i;
+    for (i = 0; i < set->count; i++) {
+        if (strlen(set->strings[i]) == length && strncmp(set->strings[i], string, length) == 0) {
+            return;
+        }
+    }
+    set->strings = realloc(set->strings, (set->count + 1) * sizeof(char *));
+    set->strings[set->count] = strndup(string, length);
+    set->count++;
+}
+
+static void clear_set(string_set_t *set) {
+    int i;
+    for (i = 0; i < set->count; i++) {
+        free(set->strings[i]);
+    }
+    free(set->strings);
+    set->strings = NULL;
+    set->count = 0;
+}
+
+/*
+ * Adds every string of a set to another set.
+ */
+static void add_set(string_set_t *set, string_set_t *other) {
+    int i;
+    for (i = 0; i < other->count; i++) {
+        add_set_string(set, other->strings[i], strlen(other->strings[i]));
+    }
+}
+
+/*
+ * Sets a set to every concatenation of a string of the first set with a
+ * string of the second set.
+ */
+static void cross_sets(string_set_t *set, string_set_t *first, string_set_t *second) {
+    memset(set, 0, sizeof(string_set_t));
+    int i;
+    int j;
+    for (i = 0; i < first->count; i++) {
+        size_t first_length = strlen(first->strings[i]);
+        for (j = 0; j < second->count; j++) {
+            size_t length = first_length + strlen(second->strings[j]);
+            char *string = malloc(length + 1);
+            memcpy(string, first->strings[i], first_length);
+            strcpy(string + first_length, second->strings[j]);
+            add_set_string(set, string, length);
+            free(string);
+        }
+    }
+}
+
+/*
+ * Shortens every string of a set to its first (or last) given number of
+ * characters.
+ */
+static void shorten_set(string_set_t *set, bool from_start, size_t length) {
+    string_set_t shortened;
+    memset(&shortened, 0, sizeof(string_set_t));
+    int i;
+    for (i = 0; i < set->count; i++) {
+        size_t string_length = strlen(set->strings[i]);
+        if (string_length <= length) {
+            add_set_string(&shortened, set->strings[i], string_length);
+        } else if (from_start) {
+            add_set_string(&shortened, set->strings[i], length);
+        } else {
+            add_set_string(&shortened, set->strings[i] + string_length - length, length);
+        }
+    }
+    clear_set(set);
+    *set = shortened;
+}
+
+/*
+ * Checks whether two queries are the same.
+ */
+static bool same_queries(query_node_t *first, query_node_t *second) {
+    if (first->type != second->type || first->child_count != second->child_count) {
+        return false;
+    } else if (first->type == QUERY_TERM) {
+        return strcmp(first->term, second->term) == 0;
+    }
+    int i;
+    for (i = 0; i < first->child_count; i++) {
+        if (!same_queries(first->children[i], second->children[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Adds an operand to an 'and', unless the 'and' already has it, since the
+ * same strings often end up in the query through several parts.
+ */
+static void add_and_operand(query_node_t *node, query_node_t *operand) {
+    int i;
+    for (i = 0; i < node->child_count; i++) {
+        if (same_queries(node->children[i], operand)) {
+            destroy_query_node(operand);
+            return;
+        }
+    }
+    add_query_child(node, operand);
+}
+
+/*
+ * Combines two queries with an 'and', either of which may be NULL for a
+ * query that holds for everything.
+ */
+static query_node_t *and_queries(query_node_t *first, query_node_t *second) {
+    if (first == NULL || second == NULL) {
+        return first != NULL ? first : second;
+    }
+    query_node_t *node = first;
+    if (first->type != QUERY_AND) {
+        node = create_query_node(QUERY_AND, NULL);
+        add_query_child(node, first);
+    }
+    if (second->type == QUERY_AND) {
+        int i;
+        for (i = 0; i < second->child_count; i++) {
+            add_and_operand(node, second->children[i]);
+        }
+        second->child_count = 0;
+        destroy_query_node(second);
+    } else {
+        add_and_operand(node, second);
+    }
+    return node;
+}
+
+/*
+ * Combines two queries with an 'or'. If either of them holds for
+ * everything, so does the 'or'.
+ */
+static query_node_t *or_queries(query_node_t *first, query_node_t *second) {
+    if (first == NULL || second == NULL) {
+        if (first != NULL) {
+            destroy_query_node(first);
+        }
+        if (second != NULL) {
+            destroy_query_node(second);
+        }
+        return NULL;
+    }
+    query_node_t *node = create_query_node(QUERY_OR, NULL);
+    add_query_child(node, first);
+    add_query_child(node, second);
+    return node;
+}
+
+/*
+ * Creates the query of a set of strings: a document that contains one of
+ * the strings has all the trigrams of one of them. A string too short to
+ * have any trigrams is in every document.
+ */
+static query_node_t *create_set_query(string_set_t *set) {
+    if (set->count == 0) {
+        return NULL;
+    }
+    query_node_t *query = create_query_node(QUERY_OR, NULL);
+    int i;
+    for (i = 0; i < set->count; i++) {
+        size_t length = strlen(set->strings[i]);
+        if (length < 3) {
+            destroy_query_node(query);
+            return NULL;
+        }
+        query_node_t *string_query = NULL;
+        size_t j;
+        for (j = 0; j + 2 < length; j++) {
+            char token[TRIGRAM_TOKEN_SIZE];
+            format_trigram(get_trigram(set->strings[i] + j), token);
+            string_query = and_queries(string_query, create_query_node(QUERY_TERM, token));
+        }
+        add_query_child(query, string_query);
+    }
+    if (query->child_count == 1) {
+        query_node_t *child = query->children[0];
+        query->child_count = 0;
+        destroy_query_node(query);
+        return child;
+    }
+    return query;
+}
+
+/*
+ * Shortens the prefixes (or suffixes) of an info to two characters, adding
+ * the trigrams of the longer ones to its query first, then to fewer
+ * characters still if there are too many of them.
+ */
+static void reduce_set(pattern_info_t *info, string_set_t *set, bool from_start) {
+    bool shorten = false;
+    int i;
+    for (i = 0; i < set->count; i++) {
+        shorten = shorten || strlen(set->strings[i]) > 2;
+    }
+    if (shorten) {
+        info->match = and_queries(info->match, create_set_query(set));
+        shorten_set(set, from_start, 2);
+    }
+    size_t length = 2;
+    while (set->count > MAX_PATTERN_STRINGS) {
+        shorten_set(set, from_start, --length);
+    }
+}
+
+/*
+ * Turns the exact set of an info into its prefixes and suffixes, adding the
+ * trigrams of its strings to its query.
+ */
+static void make_inexact(pattern_info_t *info) {
+    if (!info->exact_known) {
+        return;
+    }
+    info->match = and_queries(info->match, create_set_query(&info->exact));
+    add_set(&info->prefix, &info->exact);
+    add_set(&info->suffix, &info->exact);
+    clear_set(&info->exact);
+    info->exact_known = false;
+    shorten_set(&info->prefix, true, 2);
+    shorten_set(&info->suffix, false, 2);
+    reduce_set(info, &info->prefix, true);
+    reduce_set(info, &info->suffix, false);
+}
+
+/*
+ * Sets an info to what is known about an expression that matches exactly
+ * the given set of strings, which it takes.
+ */
+static void init_exact_info(pattern_info_t *info, string_set_t *set) {
+    memset(info, 0, sizeof(pattern_info_t));
+    info->exact_known = true;
+    info->exact = *set;
+    int i;
+    for (i = 0; i < set->count; i++) {
+        if (set->strings[i][0] == '\0') {
+            info->empty = true;
+        }
+    }
+}
+
+/*
+ * Sets an info to what is known about an expression that matches the
+ * empty string only, such as an anchor.
+ */
+static void init_empty_info(pattern_info_t *info) {
+    string_set_t set;
+    memset(&set, 0, sizeof(string_set_t));
+    add_set_string(&set, "", 0);
+    init_exact_info(info, &set);
+}
+
+/*
+ * Sets an info to what is known about an expression that matches strings
+ * nothing is known about, which may be empty if the given flag is set.
+ */
+static void init_unknown_info(pattern_info_t *info, bool empty) {
+    memset(info, 0, sizeof(pattern_info_t));
+    info->empty = empty;
+    add_set_string(&info->prefix, "", 0);
+    add_set_string(&info->suffix, "", 0);
+}
+
+static void clear_info(pattern_info_t *info) {
+    clear_set(&info->exact);
+    clear_set(&info->prefix);
+    clear_set(&info->suffix);
+    if (info->match != NULL) {
+        destroy_query_node(info->match);
+    }
+    memset(info, 0, sizeof(pattern_info_t));
+}
+
+/*
+ * Sets an info to what is known about an expression followed by another,
+ * given the infos of both, which it takes.
+ */
+static void concatenate_infos(pattern_info_t *info, pattern_info_t *first, pattern_info_t *second) {
+    memset(info, 0, sizeof(pattern_info_t));
+    info->empty = first->empty && second->empty;
+    info->match = and_queries(first->match, second->match);
+    first->match = NULL;
+    second->match = NULL;
+    if (first->exact_known && second->exact_known) {
+        info->exact_known = true;
+        cross_sets(&info->exact, &first->exact, &second->exact);
+        if (info->exact.count > MAX_PATTERN_STRINGS) {
+            make_inexact(info);
+        }
+    } else {
+        string_set_t *first_end = first->exact_known ? &first->exact : &first->suffix;
+        string_set_t *second_start = second->exact_known ? &second->exact : &second->prefix;
+        /* a match contains the end of the first part right before the start
+         * of the second one */
+        string_set_t middle;
+        cross_sets(&middle, first_end, second_start);
+        info->match = and_queries(info->match, create_set_query(&middle));
+        clear_set(&middle);
+        if (first->exact_known) {
+            cross_sets(&info->prefix, &first->exact, &second->prefix);
+            if (second->empty) {
+                add_set(&info->prefix, &first->exact);
+            }
+        } else {
+            add_set(&info->prefix, &first->prefix);
+            if (first->empty) {
+                add_set(&info->prefix, second_start);
+            }
+        }
+        if (second->exact_known) {
+            cross_sets(&info->suffix, &first->suffix, &second->exact);
+            if (first->empty) {
+                add_set(&info->suffix, &second->exact);
+            }
+        } else {
+            add_set(&info->suffix, &second->suffix);
+            if (second->empty) {
+                add_set(&info->suffix, first_end);
+            }
+        }
+        reduce_set(info, &info->prefix, true);
+        reduce_set(info, &info->suffix, false);
+    }
+    clear_info(first);
+    clear_info(second);
+}
+
+/*
+ * Sets an info to what is known about either of two expressions, given the
+ * infos of both, which it takes.
+ */
+static void alternate_infos(pattern_info_t *info, pattern_info_t *first, pattern_info_t *second) {
+    memset(info, 0, sizeof(pattern_info_t));
+    info->empty = first->empty || second->empty;
+    if (first->exact_known && second->exact_known) {
+        info->exact_known = true;
+        add_set(&info->exact, &first->exact);
+        add_set(&info->exact, &second->exact);
+        info->match = or_queries(first->match, second->match);
+        first->match = NULL;
+        second->match = NULL;
+        if (info->exact.count > MAX_PATTERN_STRINGS) {
+            make_inexact(info);
+        }
+    } else {
+        /* the trigrams of each side have to go in its own query before
+         * their prefixes and suffixes are mixed */
+        make_inexact(first);
+        make_inexact(second);
+        info->match = or_queries(first->match, second->match);
+        first->match = NULL;
+        second->match = NULL;
+        add_set(&info->prefix, &first->prefix);
+        add_set(&info->prefix, &second->prefix);
+        add_set(&info->suffix, &first->suffix);
+        add_set(&info->suffix, &second->suffix);
+        reduce_set(info, &info->prefix, true);
+        reduce_set(info, &info->suffix, false);
+    }
+    clear_info(first);
+    clear_info(second);
+}
+
+/*
+ * Sets an info to what is known about a bracket expression, which the
+ * scanner is right after the '[' of.
+ */
+static void parse_bracket(pattern_scanner_t *scanner, pattern_info_t *info) {
+    bool characters[256];
+    memset(characters, 0, sizeof(characters));
+    bool known = true;
+    const char *position = scanner->position;
+    if (*position == '^') {
+        known = false;
+        position++;
+    }
+    bool first = true;
+    while (*position != '\0' && (first || *position != ']')) {
+        first = false;
+        if (*position == '[' && (position[1] == ':' || position[1] == '.' || position[1] == '=')) {
+            /* character classes, collating symbols and equivalence classes */
+            char end = position[1];
+            known = false;
+            position += 2;
+            while (*position != '\0' && !(position[0] == end && position[1] == ']')) {
+                position++;
+            }
+            position += *position != '\0' ? 2 : 0;
+            continue;
+        }
+        unsigned char low = (unsigned char) *position++;
+        unsigned char high = low;
+        if (position[0] == '-' && position[1] != ']' && position[1] != '\0') {
+            high = (unsigned char) position[1];
+            position += 2;
+        }
+        if (high - low >= MAX_PATTERN_CLASS) {
+            known = false;
+        }
+        int character;
+        for (character = low; known && character <= high; character++) {
+            characters[tolower(character)] = true;
+        }
+    }
+    scanner->position = *position == ']' ? position + 1 : position;
+
+    string_set_t set;
+    memset(&set, 0, sizeof(string_set_t));
+    int character;
+    for (character = 1; known && character < 256; character++) {
+        if (characters[character]) {
+            char string = (char) character;
+            add_set_string(&set, &string, 1);
+        }
+    }
+    if (!known || set.count == 0 || set.count > MAX_PATTERN_CLASS) {
+        clear_set(&set);
+        init_unknown_info(info, false);
+    } else {
+        init_exact_info(info, &set);
+    }
+}
+
+static void parse_alternation(pattern_scanner_t *, pattern_info_t *, int);
+
+/*
+ * Sets an info to what is known about a single atom of an expression: a
+ * character, a bracket expression, an anchor, or a group.
+ */
+static void parse_atom(pattern_scanner_t *scanner, pattern_info_t *info, int depth) {
+    char character = *scanner->position++;
+    string_set_t set;
+    memset(&set, 0, sizeof(string_set_t));
+    if (character == '(') {
+        parse_alternation(scanner, info, depth + 1);
+        if (*scanner->position == ')') {
+            scanner->position++;
+        }
+    } else if (character == '[') {
+        parse_bracket(scanner, info);
+    } else if (character == '.') {
+        init_unknown_info(info, false);
+    } else if (character == '^' || character == '$') {
+        init_empty_info(info);
+    } else if (character == '*' || character == '+' || character == '?' || character == '{') {
+        /* a repetition with nothing to repeat */
+        init_unknown_info(info, true);
+    } else if (character == '\\') {
+        character = *scanner->position;
+        if (character == '\0' || strchr("<>`'", character) != NULL) {
+            /* word and buffer boundaries */
+            scanner->position += character != '\0' ? 1 : 0;
+            init_empty_info(info);
+        } else if (isalnum((unsigned char) character)) {
+            /* back references and the GNU escapes, such as "\w" or "\b" */
+            scanner->position++;
+            init_unknown_info(info, true);
+        } else {
+            scanner->position++;
+            character = (char) tolower((unsigned char) character);
+            add_set_string(&set, &character, 1);
+            init_exact_info(info, &set);
+        }
+    } else {
+        character = (char) tolower((unsigned char) character);
+        add_set_string(&set, &character, 1);
+        init_exact_info(info, &set);
+    }
+}
+
+/*
+ * Reads the bounds of an interval, which the scanner is right after the '{'
+ * of. Returns false, without moving the scanner, if it isn't an interval.
+ */
+static bool parse_interval(pattern_scanner_t *scanner, int *minimum, int *maximum) {
+    const char *position = scanner->position;
+    if (!isdigit((unsigned char) *position)) {
+        return false;
+    }
+    *minimum = (int) strtol(position, (char **) &position, 10);
+    *maximum = *minimum;
+    if (*position == ',') {
+        position++;
+        *maximum = isdigit((unsigned char) *position) ? (int) strtol(position, (char **) &position, 10) : -1;
+    }
+    if (*position != '}') {
+        return false;
+    }
+    scanner->position = position + 1;
+    return true;
+}
+
+/*
+ * Sets an info to what is known about an atom and the repetitions that
+ * follow it. A part that may be repeated is only known to start and end
+ * like a single repetition of it, and one that may not be there at all is
+ * known to match either the empty string or a single repetition.
+ */
+static void parse_repetition(pattern_scanner_t *scanner, pattern_info_t *info, int depth) {
+    parse_atom(scanner, info, depth);
+    while (true) {
+        int minimum;
+        int maximum;
+        char character = *scanner->position;
+        if (character == '*') {
+            minimum = 0;
+            maximum = -1;
+        } else if (character == '+') {
+            minimum = 1;
+            maximum = -1;
+        } else if (character == '?') {
+            minimum = 0;
+            maximum = 1;
+        } else if (character != '{') {
+            return;
+        }
+        scanner->position++;
+        if (character == '{' && !parse_interval(scanner, &minimum, &maximum)) {
+            /* a brace that doesn't start an interval is just a brace */
+            pattern_info_t brace;
+            string_set_t set;
+            memset(&set, 0, sizeof(string_set_t));
+            add_set_string(&set, "{", 1);
+            init_exact_info(&brace, &set);
+            pattern_info_t repeated = *info;
+            concatenate_infos(info, &repeated, &brace);
+            return;
+        }
+        if (minimum == 0 && maximum == 1) {
+            pattern_info_t repeated = *info;
+            pattern_info_t empty;
+            init_empty_info(&empty);
+            alternate_infos(info, &repeated, &empty);
+        } else if (minimum == 0) {
+            clear_info(info);
+            init_unknown_info(info, true);
+        } else if (minimum != 1 || maximum != 1) {
+            make_inexact(info);
+        }
+    }
+}
+
+/*
+ * Sets an info to what is known about a sequence of atoms, up to the end of
+ * the expression, a '|', or the ')' of the group it is in.
+ */
+static void parse_concatenation(pattern_scanner_t *scanner, pattern_info_t *info, int depth) {
+    init_empty_info(info);
+    while (*scanner->position != '\0' && *scanner->position != '|'
+            && (*scanner->position != ')' || depth == 0)) {
+        pattern_info_t sequence = *info;
+        pattern_info_t atom;
+        if (*scanner->position == ')') {
+            /* an unmatched ')' is just a character */
+            string_set_t set;
+            memset(&set, 0, sizeof(string_set_t));
+            add_set_string(&set, ")", 1);
+            init_exact_info(&atom, &set);
+            scanner->position++;
+        } else {
+            parse_repetition(scanner, &atom, depth);
+        }
+        concatenate_infos(info, &sequence, &atom);
+    }
+}
+
+/*
+ * Sets an info to what is known about the alternatives of an expression
+ * or of a group.
+ */
+static void parse_alternation(pattern_scanner_t *scanner, pattern_info_t *info, int depth) {
+    parse_concatenation(scanner, info, depth);
+    while (*scanner->position == '|') {
+        scanner->position++;
+        pattern_info_t first = *info;
+        pattern_info_t second;
+        parse_concatenation(scanner, &second, depth);
+        alternate_infos(info, &first, &second);
+    }
+}
+
+/*
+ * Creates the trigram query of an extended regular expression.
+ */
+query_node_t *create_pattern_query(const char *pattern) {
+    pattern_scanner_t scanner;
+    scanner.position = pattern;
+    pattern_info_t info;
+    parse_alternation(&scanner, &info, 0);
+    make_inexact(&info);
+    /* the prefixes and suffixes are too short to have trigrams by now */
+    query_node_t *query = info.match;
+    info.match = NULL;
+    clear_info(&info);
+    return query;
+}
+
+/*
+ * Creates an extended regular expression that matches the given text.
+ */
+char *escape_pattern(const char *text) {
+    char *pattern = malloc(2 * strlen(text) + 1);
+    char *position = pattern;
+    while (*text != '\0') {
+        if (strchr("\\^$.[]|()*+?{}", *text) != NULL) {
+            *position++ = '\\';
+        }
+        *position++ = *text++;
+    }
+    *position = '\0';
+    return pattern;
+}
@@ -0,0 +1,26 @@
+#ifndef _PATTERN_QUERY_H_
+#define _PATTERN_QUERY_H_
+
+#include "query_parser.h"
+
+/*
+ * Creates the trigram query of an extended regular expression: a boolean
+ * query over the tokens of a trigram index (see trigram.h) that every
+ * document with a line matching the expression satisfies, so only the
+ * documents it matches have to be checked against the expression itself.
+ * Trigrams are case-folded, so the query holds for case-insensitive
+ * matching too. Returns NULL if no trigram is required, in which case every
+ * document has to be checked. The expression should have compiled with
+ * regcomp. The caller is responsible for freeing the returned query using
+ * destroy_query_node.
+ */
+query_node_t *create_pattern_query(const char *);
+
+/*
+ * Creates an extended regular expression that matches the given text
+ * literally, by escaping its special characters. The caller is responsible
+ * for freeing the allocated memory.
+ */
+char *escape_pattern(const char *);
+
+#endif
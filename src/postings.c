@@ -0,0 +1,422 @@
+#include <stdlib.h>
+#include <string.h>
+#include "postings.h"
+
+/*
+ * Creates an empty postings list, given its initial capacity.
+ */
+postings_t *create_postings(int capacity) {
+    postings_t *postings = malloc(sizeof(postings_t));
+    postings->capacity = capacity > 0 ? capacity : 1;
+    postings->ids = malloc(postings->capacity * sizeof(uint32_t));
+    postings->size = 0;
+    postings->bitmap = NULL;
+    postings->owns_bitmap = false;
+    return postings;
+}
+
+/*
+ * Creates a postings list backed by a bitmap.
+ */
+postings_t *create_bitmap_postings(roaring_t *bitmap, bool owns_bitmap) {
+    postings_t *postings = malloc(sizeof(postings_t));
+    postings->ids = NULL;
+    postings->size = (int) bitmap->cardinality;
+    postings->capacity = 0;
+    postings->bitmap = bitmap;
+    postings->owns_bitmap = owns_bitmap;
+    return postings;
+}
+
+/*
+ * Destroys a postings list.
+ */
+void destroy_postings(postings_t *postings) {
+    if (postings->bitmap != NULL && postings->owns_bitmap) {
+        destroy_roaring(postings->bitmap);
+    }
+    free(postings->ids);
+    free(postings);
+}
+
+/*
+ * Makes sure a postings list has an array of ids.
+ */
+void expand_postings(postings_t *postings) {
+    if (postings->bitmap == NULL) {
+        return;
+    }
+    postings->capacity = postings->size > 0 ? postings->size : 1;
+    postings->ids = malloc(postings->capacity * sizeof(uint32_t));
+    roaring_to_array(postings->bitmap, postings->ids);
+    if (postings->owns_bitmap) {
+        destroy_roaring(postings->bitmap);
+    }
+    postings->bitmap = NULL;
+}
+
+/*
+ * Checks whether a postings list contains a document id, by binary search
+ * if it is an array of ids.
+ */
+bool postings_contains(postings_t *postings, uint32_t id) {
+    if (postings->bitmap != NULL) {
+        return roaring_contains(postings->bitmap, id);
+    }
+    int low = 0;
+    int high = postings->size - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (postings->ids[middle] == id) {
+            return true;
+        } else if (postings->ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return false;
+}
+
+/*
+ * Keeps only the given number of highest ids of a postings list.
+ */
+void keep_highest_postings(postings_t *postings, int count) {
+    if (postings->size <= count) {
+        return;
+    }
+    expand_postings(postings);
+    memmove(postings->ids, postings->ids + postings->size - count, count * sizeof(uint32_t));
+    postings->size = count;
+}
+
+/*
+ * Appends a document id to a postings list.
+ */
+void append_posting(postings_t *postings, uint32_t id) {
+    if (postings->size == postings->capacity) {
+        postings->capacity *= 2;
+        postings->ids = realloc(postings->ids, postings->capacity * sizeof(uint32_t));
+    }
+    postings->ids[postings->size++] = id;
+}
+
+static int id_compare_function(const void *first, const void *second) {
+    uint32_t first_id = *(const uint32_t *) first;
+    uint32_t second_id = *(const uint32_t *) second;
+    return first_id < second_id ? -1 : (first_id > second_id ? 1 : 0);
+}
+
+/*
+ * Sorts the ids of a postings list that were appended out of order, and
+ * removes duplicates.
+ */
+void sort_postings(postings_t *postings) {
+    qsort(postings->ids, postings->size, sizeof(uint32_t), &id_compare_function);
+    /* the same path can show up twice in an appended index file */
+    int unique_size = 0;
+    int i;
+    for (i = 0; i < postings->size; i++) {
+        if (unique_size == 0 || postings->ids[unique_size - 1] != postings->ids[i]) {
+            postings->ids[unique_size++] = postings->ids[i];
+        }
+    }
+    postings->size = unique_size;
+}
+
+/*
+ * Creates a copy of a postings list, which always owns its bitmap.
+ */
+postings_t *copy_postings(postings_t *postings) {
+    if (postings->bitmap != NULL) {
+        return create_bitmap_postings(copy_roaring(postings->bitmap), true);
+    }
+    postings_t *copy = create_postings(postings->size);
+    memcpy(copy->ids, postings->ids, postings->size * sizeof(uint32_t));
+    copy->size = postings->size;
+    return copy;
+}
+
+/*
+ * Gets the number of bytes a postings list takes up.
+ */
+size_t get_postings_memory_size(postings_t *postings) {
+    size_t size = sizeof(postings_t) + postings->capacity * sizeof(uint32_t);
+    if (postings->bitmap != NULL) {
+        size += sizeof(roaring_t) + get_roaring_memory_size(postings->bitmap);
+    }
+    return size;
+}
+
+/*
+ * Creates the postings list of the records of an indexer entry. Records are
+ * kept in count order, so we look up each record's id and sort them.
+ * Records of documents removed from a live indexer have no path, and are
+ * passed over.
+ */
+static postings_t *create_record_postings(indexer_t *indexer, indexer_entry_t *entry) {
+    postings_t *postings = create_postings(16);
+    list_element_t *element = entry->records->head;
+    while (element != NULL) {
+        indexer_entry_record_t *record = element->value;
+        int id = record->file_path != NULL ? get_document_id(indexer, record->file_path) : -1;
+        if (id >= 0) {
+            append_posting(postings, (uint32_t) id);
+        }
+        element = element->next;
+    }
+    sort_postings(postings);
+    return postings;
+}
+
+/*
+ * Creates the postings list of an indexer entry. An entry loaded from an
+ * index file that was appended to can have both a bitmap and records, in
+ * which case the records' ids are added to a copy of the bitmap.
+ */
+postings_t *create_entry_postings(indexer_t *indexer, indexer_entry_t *entry) {
+    if (entry->bitmap != NULL && entry->records->head == NULL) {
+        /* bitmaps are shared with the entry rather than copied */
+        return create_bitmap_postings(entry->bitmap, false);
+    }
+    postings_t *postings = create_record_postings(indexer, entry);
+    if (entry->bitmap != NULL) {
+        postings_t *records = postings;
+        postings = create_bitmap_postings(roaring_or_array(entry->bitmap, records->ids, records->size), true);
+        destroy_postings(records);
+    }
+    return postings;
+}
+
+/*
+ * Converts the postings of every high-frequency entry to a bitmap. The
+ * records of an entry that already has a bitmap are added to it, however
+ * few they are.
+ */
+void compress_postings(indexer_t *indexer) {
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        indexer_entry_t *entry = element->value;
+        bool compress = entry->bitmap != NULL ? entry->records->head != NULL
+                : is_roaring_worthwhile(get_size(entry->records), indexer->documents->count);
+        if (compress) {
+            postings_t *postings = create_record_postings(indexer, entry);
+            roaring_t *bitmap;
+            if (entry->bitmap != NULL) {
+                bitmap = roaring_or_array(entry->bitmap, postings->ids, postings->size);
+                destroy_roaring(entry->bitmap);
+            } else {
+                bitmap = create_roaring();
+                int i;
+                for (i = 0; i < postings->size; i++) {
+                    append_roaring(bitmap, postings->ids[i]);
+                }
+            }
+            optimize_roaring(bitmap);
+            destroy_postings(postings);
+            /* the counts aren't needed to answer queries, so the records can go */
+            list_t *records = entry->records;
+            entry->records = create_list(records->compare_function, records->destroy_function);
+            destroy_list(records);
+            entry->bitmap = bitmap;
+        }
+        element = element->next;
+    }
+}
+
+/*
+ * Converts the bitmaps of an indexer back to records, in document order.
+ * The records are put in front of the ones an entry already has, leaving
+ * out the documents that already have one.
+ */
+void decompress_postings(indexer_t *indexer) {
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        indexer_entry_t *entry = element->value;
+        if (entry->bitmap != NULL) {
+            postings_t *existing = create_record_postings(indexer, entry);
+            uint32_t *ids = malloc((entry->bitmap->cardinality + 1) * sizeof(uint32_t));
+            roaring_to_array(entry->bitmap, ids);
+            list_element_t *head = entry->records->head;
+            list_element_t *tail = NULL;
+            long i;
+            int j = 0;
+            for (i = 0; i < entry->bitmap->cardinality; i++) {
+                while (j < existing->size && existing->ids[j] < ids[i]) {
+                    j++;
+                }
+                if (j < existing->size && existing->ids[j] == ids[i]) {
+                    continue;
+                }
+                indexer_entry_record_t *record = create_indexer_entry_record(get_pooled_string(indexer->documents, ids[i]));
+                record->count = 1;
+                list_element_t *record_element = create_list_element(record, head);
+                if (tail == NULL) {
+                    entry->records->head = record_element;
+                } else {
+                    tail->next = record_element;
+                }
+                tail = record_element;
+            }
+            free(ids);
+            destroy_postings(existing);
+            destroy_roaring(entry->bitmap);
+            entry->bitmap = NULL;
+        }
+        element = element->next;
+    }
+}
+
+/*
+ * Creates a postings list containing every document of an indexer.
+ */
+postings_t *create_all_postings(indexer_t *indexer) {
+    postings_t *postings = create_postings(indexer->documents->count);
+    uint32_t id;
+    for (id = 0; id < (uint32_t) indexer->documents->count; id++) {
+        postings->ids[id] = id;
+    }
+    postings->size = indexer->documents->count;
+    return postings;
+}
+
+/*
+ * Finds the first position at or after the given start whose id is not
+ * less than the target, by galloping forward and then binary searching.
+ */
+static int gallop(postings_t *postings, int start, uint32_t target) {
+    int step = 1;
+    int low = start;
+    int high = start;
+    while (high < postings->size && postings->ids[high] < target) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    if (high > postings->size) {
+        high = postings->size;
+    }
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (postings->ids[middle] < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*
+ * Intersects two arrays of ids. We walk the smaller array
+ * and gallop through the larger one, so intersecting a rare term with a
+ * common one costs about as much as the rare term's postings.
+ */
+static postings_t *intersect_arrays(postings_t *first, postings_t *second) {
+    if (first->size > second->size) {
+        postings_t *tmp = first;
+        first = second;
+        second = tmp;
+    }
+    postings_t *result = create_postings(first->size);
+    int position = 0;
+    int i;
+    for (i = 0; i < first->size && position < second->size; i++) {
+        position = gallop(second, position, first->ids[i]);
+        if (position < second->size && second->ids[position] == first->ids[i]) {
+            append_posting(result, first->ids[i]);
+        }
+    }
+    return result;
+}
+
+/*
+ * Unions two arrays of ids by merging them.
+ */
+static postings_t *union_arrays(postings_t *first, postings_t *second) {
+    postings_t *result = create_postings(first->size + second->size);
+    int i = 0;
+    int j = 0;
+    while (i < first->size && j < second->size) {
+        if (first->ids[i] < second->ids[j]) {
+            append_posting(result, first->ids[i++]);
+        } else if (first->ids[i] > second->ids[j]) {
+            append_posting(result, second->ids[j++]);
+        } else {
+            append_posting(result, first->ids[i++]);
+            j++;
+        }
+    }
+    while (i < first->size) append_posting(result, first->ids[i++]);
+    while (j < second->size) append_posting(result, second->ids[j++]);
+    return result;
+}
+
+/*
+ * Subtracts one array of ids from another, streaming through the first
+ * and galloping through the second.
+ */
+static postings_t *difference_arrays(postings_t *first, postings_t *second) {
+    postings_t *result = create_postings(first->size);
+    int position = 0;
+    int i;
+    for (i = 0; i < first->size; i++) {
+        position = gallop(second, position, first->ids[i]);
+        if (position == second->size || second->ids[position] != first->ids[i]) {
+            append_posting(result, first->ids[i]);
+        }
+    }
+    return result;
+}
+
+/*
+ * Filters an array postings list by membership in a bitmap postings list.
+ */
+static postings_t *filter_array(postings_t *array, postings_t *bitmap, bool keep_present) {
+    postings_t *result = create_postings(array->size);
+    result->size = roaring_filter_array(bitmap->bitmap, array->ids, array->size,
+            result->ids, keep_present);
+    return result;
+}
+
+/*
+ * Creates the intersection of two postings lists.
+ */
+postings_t *intersect_postings(postings_t *first, postings_t *second) {
+    if (first->bitmap != NULL && second->bitmap != NULL) {
+        return create_bitmap_postings(roaring_and(first->bitmap, second->bitmap), true);
+    } else if (first->bitmap != NULL) {
+        return filter_array(second, first, true);
+    } else if (second->bitmap != NULL) {
+        return filter_array(first, second, true);
+    }
+    return intersect_arrays(first, second);
+}
+
+/*
+ * Creates the union of two postings lists.
+ */
+postings_t *union_postings(postings_t *first, postings_t *second) {
+    if (first->bitmap != NULL && second->bitmap != NULL) {
+        return create_bitmap_postings(roaring_or(first->bitmap, second->bitmap), true);
+    } else if (first->bitmap != NULL) {
+        return create_bitmap_postings(roaring_or_array(first->bitmap, second->ids, second->size), true);
+    } else if (second->bitmap != NULL) {
+        return create_bitmap_postings(roaring_or_array(second->bitmap, first->ids, first->size), true);
+    }
+    return union_arrays(first, second);
+}
+
+/*
+ * Creates the difference of two postings lists.
+ */
+postings_t *difference_postings(postings_t *first, postings_t *second) {
+    if (first->bitmap != NULL && second->bitmap != NULL) {
+        return create_bitmap_postings(roaring_andnot(first->bitmap, second->bitmap), true);
+    } else if (first->bitmap != NULL) {
+        return create_bitmap_postings(roaring_andnot_array(first->bitmap, second->ids, second->size), true);
+    } else if (second->bitmap != NULL) {
+        return filter_array(first, second, false);
+    }
+    return difference_arrays(first, second);
+}
@@ -0,0 +1,125 @@
+#ifndef _POSTINGS_H_
+#define _POSTINGS_H_
+
+#include <stdint.h>
+#include "indexer.h"
+#include "roaring.h"
+
+/*
+ * A postings list: the ids of the documents a term appears in, sorted in
+ * ascending order (which is also ascending path order). Dense postings are
+ * kept as a bitmap instead of as an array of ids; either way, size is the
+ * number of documents.
+ */
+typedef struct postings {
+    uint32_t *ids;
+    int size;
+    int capacity;
+    roaring_t *bitmap;
+    /* false when the bitmap belongs to an indexer entry */
+    bool owns_bitmap;
+} postings_t;
+
+/*
+ * Creates an empty postings list, given its initial capacity. The caller
+ * is responsible for freeing the allocated memory.
+ */
+postings_t *create_postings(int);
+
+/*
+ * Creates a postings list backed by a bitmap, given the bitmap and whether
+ * the postings list takes ownership of it. The caller is responsible for
+ * freeing the allocated memory.
+ */
+postings_t *create_bitmap_postings(roaring_t *, bool);
+
+/*
+ * Destroys a postings list.
+ */
+void destroy_postings(postings_t *);
+
+/*
+ * Appends a document id to a postings list. Ids must be appended in
+ * ascending order.
+ */
+void append_posting(postings_t *, uint32_t);
+
+/*
+ * Sorts the ids of a postings list that were appended out of order, and
+ * removes duplicates.
+ */
+void sort_postings(postings_t *);
+
+/*
+ * Creates a copy of a postings list. The copy always owns its bitmap. The
+ * caller is responsible for freeing the allocated memory.
+ */
+postings_t *copy_postings(postings_t *);
+
+/*
+ * Gets the number of bytes a postings list takes up.
+ */
+size_t get_postings_memory_size(postings_t *);
+
+/*
+ * Creates the postings list of an indexer entry, given the indexer (whose
+ * document table must have been built) and the entry.
+ */
+postings_t *create_entry_postings(indexer_t *, indexer_entry_t *);
+
+/*
+ * Converts the postings of every high-frequency entry of an indexer (whose
+ * document table must have been built) to a bitmap, freeing its records.
+ * An entry that has both a bitmap and records (from an appended index file)
+ * gets a single bitmap of both.
+ */
+void compress_postings(indexer_t *);
+
+/*
+ * Converts the bitmaps of an indexer (whose document table must have been
+ * built) back to records, so documents can be added to it. The counts of
+ * those records were never stored, so they are set to 1. Records an entry
+ * already has are kept.
+ */
+void decompress_postings(indexer_t *);
+
+/*
+ * Makes sure a postings list has an array of ids, converting its bitmap
+ * if it has one.
+ */
+void expand_postings(postings_t *);
+
+/*
+ * Checks whether a postings list contains a document id.
+ */
+bool postings_contains(postings_t *, uint32_t);
+
+/*
+ * Keeps only the given number of highest ids of a postings list (the last
+ * documents in path order), dropping the others.
+ */
+void keep_highest_postings(postings_t *, int);
+
+/*
+ * Creates a postings list containing every document of an indexer.
+ */
+postings_t *create_all_postings(indexer_t *);
+
+/*
+ * Creates the intersection of two postings lists. Each of these operations
+ * has a kernel for every combination of arrays and bitmaps.
+ */
+postings_t *intersect_postings(postings_t *, postings_t *);
+
+/*
+ * Creates the union of two postings lists.
+ */
+postings_t *union_postings(postings_t *, postings_t *);
+
+/*
+ * Creates the difference of two postings lists: every document of the
+ * first that isn't in the second.
+ */
+postings_t *difference_postings(postings_t *, postings_t *);
+
+#endif
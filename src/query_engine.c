@@ -0,0 +1,544 @@
+#include <stdlib.h>
+#include <string.h>
+#include "query_engine.h"
+#include "index_directory.h"
+#include "packed_index.h"
+#include "levenshtein.h"
+#include "tokenizer.h"
+
+/*
+ * The most terms a fuzzy term expands to. A short term can be within a
+ * couple of edits of a large part of the dictionary, so only the closest
+ * of them are kept, and of those, the most frequent.
+ */
+#ifndef MAX_FUZZY_TERMS
+#define MAX_FUZZY_TERMS 64
+#endif
+
+/*
+ * Gets the document frequency of a term in an indexer.
+ */
+static long get_document_frequency(indexer_t *indexer, char *term) {
+    if (indexer->directory != NULL) {
+        return get_directory_frequency(indexer, term);
+    } else if (indexer->packed != NULL) {
+        return get_packed_frequency(indexer, term);
+    }
+    indexer_entry_t *entry = get_indexer_entry(indexer, term);
+    return entry != NULL ? get_entry_frequency(entry) : 0;
+}
+
+/*
+ * Adds a planned child to an operator node, flattening it into the node if
+ * it is the same operator.
+ */
+static void add_planned_child(query_node_t *node, query_node_t *child) {
+    if (child->type == node->type) {
+        int i;
+        for (i = 0; i < child->child_count; i++) {
+            add_query_child(node, child->children[i]);
+        }
+        child->child_count = 0;
+        destroy_query_node(child);
+    } else {
+        add_query_child(node, child);
+    }
+}
+
+/*
+ * Comparison function for the operands of an 'and': positive operands come
+ * first, from the cheapest to the most expensive, then negations, from the
+ * one that removes the most documents to the one that removes the least.
+ */
+static int and_operand_compare_function(const void *first, const void *second) {
+    query_node_t *first_node = *(query_node_t * const *) first;
+    query_node_t *second_node = *(query_node_t * const *) second;
+    bool first_negated = first_node->type == QUERY_NOT;
+    bool second_negated = second_node->type == QUERY_NOT;
+    if (first_negated != second_negated) {
+        return first_negated ? 1 : -1;
+    }
+    long first_cost = first_negated ? -first_node->children[0]->cost : first_node->cost;
+    long second_cost = second_negated ? -second_node->children[0]->cost : second_node->cost;
+    return first_cost < second_cost ? -1 : (first_cost > second_cost ? 1 : 0);
+}
+
+static int or_operand_compare_function(const void *first, const void *second) {
+    query_node_t *first_node = *(query_node_t * const *) first;
+    query_node_t *second_node = *(query_node_t * const *) second;
+    return first_node->cost < second_node->cost ? -1 : (first_node->cost > second_node->cost ? 1 : 0);
+}
+
+/*
+ * Replaces an operator node that has a single child with that child.
+ */
+static query_node_t *collapse_node(query_node_t *node) {
+    if (node->child_count == 1) {
+        query_node_t *child = node->children[0];
+        node->child_count = 0;
+        destroy_query_node(node);
+        return child;
+    }
+    return node;
+}
+
+static query_node_t *plan_node(indexer_t *, query_node_t *);
+
+/*
+ * Finishes planning an 'and' or an 'or' whose operands are planned: works
+ * out its cost and orders its operands. Returns NULL if it has none left.
+ */
+static query_node_t *finish_operator(indexer_t *indexer, query_node_t *node) {
+    if (node->child_count == 0) {
+        destroy_query_node(node);
+        return NULL;
+    }
+    int i;
+    if (node->type == QUERY_AND) {
+        /* an 'and' matches at most as many documents as its rarest positive operand */
+        node->cost = indexer->documents->count;
+        for (i = 0; i < node->child_count; i++) {
+            if (node->children[i]->type != QUERY_NOT && node->children[i]->cost < node->cost) {
+                node->cost = node->children[i]->cost;
+            }
+        }
+        qsort(node->children, node->child_count, sizeof(query_node_t *), &and_operand_compare_function);
+    } else {
+        /* an 'or' matches at most as many documents as all of its operands together */
+        node->cost = 0;
+        for (i = 0; i < node->child_count; i++) {
+            node->cost += node->children[i]->cost;
+        }
+        if (node->cost > indexer->documents->count) {
+            node->cost = indexer->documents->count;
+        }
+        qsort(node->children, node->child_count, sizeof(query_node_t *), &or_operand_compare_function);
+    }
+    return collapse_node(node);
+}
+
+/*
+ * Plans a term. A term goes through the same tokenizer and filters the
+ * indexed text did, so it can turn into several tokens, which all have to
+ * match, or into none, if it is a stop word for instance.
+ */
+static query_node_t *plan_term(indexer_t *indexer, query_node_t *query) {
+    query_node_t *node = create_query_node(QUERY_AND, NULL);
+    list_t *tokens = tokenize(query->term);
+    list_element_t *element = tokens->head;
+    while (element != NULL) {
+        char *token = element->value;
+        if (filter_token(&indexer->filter, token)) {
+            query_node_t *term = create_query_node(QUERY_TERM, token);
+            term->cost = get_document_frequency(indexer, token);
+            add_query_child(node, term);
+        }
+        element = element->next;
+    }
+    destroy_list(tokens);
+    return finish_operator(indexer, node);
+}
+
+/*
+ * Adds a term a fuzzy term matched to the 'or' it expands to, remembering
+ * how far it is from the fuzzy term.
+ */
+static void add_fuzzy_match(indexer_t *indexer, query_node_t *node, char *token, int distance) {
+    query_node_t *term = create_query_node(QUERY_TERM, token);
+    term->distance = distance;
+    term->cost = get_document_frequency(indexer, token);
+    add_query_child(node, term);
+}
+
+/*
+ * Finds the terms of a dictionary an automaton accepts, skipping ahead
+ * whenever it rules out a range of terms.
+ */
+static void match_dictionary_terms(indexer_t *indexer, term_dictionary_t *terms,
+        levenshtein_automaton_t *automaton, query_node_t *node) {
+    size_t max_length = get_dictionary_max_length(terms);
+    char *term = malloc(max_length + 1);
+    char *next = malloc(max_length + 5);
+    int count = get_dictionary_size(terms);
+    int id = 0;
+    while (id < count) {
+        get_dictionary_term(terms, id, term);
+        int result = match_levenshtein_term(automaton, term, next);
+        if (result >= 0) {
+            add_fuzzy_match(indexer, node, term, result);
+        }
+        if (result == LEVENSHTEIN_DONE) {
+            break;
+        }
+        id = result == LEVENSHTEIN_SKIP ? seek_dictionary_term(terms, next) : id + 1;
+    }
+    free(term);
+    free(next);
+}
+
+/*
+ * Finds the entries of an indexer an automaton accepts. The entries are a
+ * list, so the ones it rules out are passed over rather than sought past.
+ * The entries of a live indexer aren't sorted, so each of them is tried.
+ */
+static void match_entry_terms(indexer_t *indexer, levenshtein_automaton_t *automaton, query_node_t *node) {
+    char *next = NULL;
+    size_t next_size = 0;
+    if (indexer->live != NULL) {
+        int count;
+        indexer_entry_t **entries = get_live_entries(indexer, &count);
+        int i;
+        for (i = 0; i < count; i++) {
+            size_t size = strlen(entries[i]->token) + 5;
+            if (size > next_size) {
+                next_size = size;
+                next = realloc(next, next_size);
+            }
+            int result = match_levenshtein_term(automaton, entries[i]->token, next);
+            if (result >= 0) {
+                add_fuzzy_match(indexer, node, entries[i]->token, result);
+            }
+        }
+        free(next);
+        return;
+    }
+    list_element_t *element = indexer->entries->head;
+    while (element != NULL) {
+        char *token = ((indexer_entry_t *) element->value)->token;
+        size_t size = strlen(token) + 5;
+        if (size > next_size) {
+            next_size = size;
+            next = realloc(next, next_size);
+        }
+        int result = match_levenshtein_term(automaton, token, next);
+        if (result >= 0) {
+            add_fuzzy_match(indexer, node, token, result);
+        }
+        if (result == LEVENSHTEIN_DONE) {
+            break;
+        }
+        element = element->next;
+        while (result == LEVENSHTEIN_SKIP && element != NULL
+                && strcmp(((indexer_entry_t *) element->value)->token, next) < 0) {
+            element = element->next;
+        }
+    }
+    free(next);
+}
+
+/*
+ * Comparison function for the terms a fuzzy term matched: the closest
+ * first, and of equally close ones, the most frequent, then in term order.
+ */
+static int fuzzy_match_compare_function(const void *first, const void *second) {
+    query_node_t *first_node = *(query_node_t * const *) first;
+    query_node_t *second_node = *(query_node_t * const *) second;
+    if (first_node->distance != second_node->distance) {
+        return first_node->distance - second_node->distance;
+    }
+    if (first_node->cost != second_node->cost) {
+        return first_node->cost > second_node->cost ? -1 : 1;
+    }
+    return strcmp(first_node->term, second_node->term);
+}
+
+/*
+ * Expands a single token of a fuzzy term into an 'or' of the indexed terms
+ * within its distance, found by intersecting a Levenshtein automaton with
+ * the indexer's sorted terms. If no term is close enough, the token is left
+ * as a plain term, which matches nothing just the same.
+ */
+static query_node_t *expand_fuzzy_token(indexer_t *indexer, char *token, int distance) {
+    query_node_t *node = create_query_node(QUERY_OR, NULL);
+    levenshtein_automaton_t *automaton = create_levenshtein_automaton(token, distance);
+    if (indexer->directory != NULL) {
+        match_dictionary_terms(indexer, get_directory_terms(indexer), automaton, node);
+    } else if (indexer->packed != NULL) {
+        match_dictionary_terms(indexer, get_packed_terms(indexer), automaton, node);
+    } else {
+        match_entry_terms(indexer, automaton, node);
+    }
+    destroy_levenshtein_automaton(automaton);
+    if (node->child_count == 0) {
+        destroy_query_node(node);
+        return create_query_node(QUERY_TERM, token);
+    }
+    if (node->child_count > MAX_FUZZY_TERMS) {
+        qsort(node->children, node->child_count, sizeof(query_node_t *), &fuzzy_match_compare_function);
+        while (node->child_count > MAX_FUZZY_TERMS) {
+            destroy_query_node(node->children[--node->child_count]);
+        }
+    }
+    return finish_operator(indexer, node);
+}
+
+/*
+ * Plans a fuzzy term. Its tokens go through the tokenizer and filters just
+ * like those of a plain term, and each is expanded to the terms close to it.
+ */
+static query_node_t *plan_fuzzy(indexer_t *indexer, query_node_t *query) {
+    query_node_t *node = create_query_node(QUERY_AND, NULL);
+    list_t *tokens = tokenize(query->term);
+    list_element_t *element = tokens->head;
+    while (element != NULL) {
+        char *token = element->value;
+        if (filter_token(&indexer->filter, token)) {
+            add_query_child(node, expand_fuzzy_token(indexer, token, query->distance));
+        }
+        element = element->next;
+    }
+    destroy_list(tokens);
+    return finish_operator(indexer, node);
+}
+
+/*
+ * Plans a negation. Returns NULL if nothing is left of the negated query.
+ */
+static query_node_t *plan_not(indexer_t *indexer, query_node_t *query) {
+    query_node_t *child = plan_node(indexer, query->children[0]);
+    if (child == NULL) {
+        return NULL;
+    }
+    if (child->type == QUERY_NOT) {
+        /* NOT NOT a is just a */
+        query_node_t *grandchild = child->children[0];
+        child->child_count = 0;
+        destroy_query_node(child);
+        return grandchild;
+    }
+    if (child->type == QUERY_OR) {
+        /* NOT (a OR b) becomes NOT a AND NOT b, so both become streaming differences */
+        query_node_t *node = create_query_node(QUERY_AND, NULL);
+        int i;
+        for (i = 0; i < child->child_count; i++) {
+            query_node_t *negation = create_query_node(QUERY_NOT, NULL);
+            add_query_child(negation, child->children[i]);
+            negation->cost = indexer->documents->count - child->children[i]->cost;
+            add_query_child(node, negation);
+        }
+        child->child_count = 0;
+        destroy_query_node(child);
+        node->cost = indexer->documents->count;
+        qsort(node->children, node->child_count, sizeof(query_node_t *), &and_operand_compare_function);
+        return node;
+    }
+    query_node_t *node = create_query_node(QUERY_NOT, NULL);
+    add_query_child(node, child);
+    node->cost = indexer->documents->count - child->cost;
+    return node;
+}
+
+/*
+ * Plans a node of the query, returning a new planned node, or NULL if
+ * nothing is left of it.
+ */
+static query_node_t *plan_node(indexer_t *indexer, query_node_t *query) {
+    if (query->type == QUERY_TERM) {
+        return plan_term(indexer, query);
+    } else if (query->type == QUERY_FUZZY) {
+        return plan_fuzzy(indexer, query);
+    } else if (query->type == QUERY_NOT) {
+        return plan_not(indexer, query);
+    }
+    query_node_t *node = create_query_node(query->type, NULL);
+    int i;
+    for (i = 0; i < query->child_count; i++) {
+        query_node_t *child = plan_node(indexer, query->children[i]);
+        if (child != NULL) {
+            add_planned_child(node, child);
+        }
+    }
+    return finish_operator(indexer, node);
+}
+
+/*
+ * Plans a query for the given indexer. A query nothing is left of matches
+ * nothing, like an empty 'or'.
+ */
+query_node_t *plan_query(indexer_t *indexer, query_node_t *query) {
+    query_node_t *node = plan_node(indexer, query);
+    return node != NULL ? node : create_query_node(QUERY_OR, NULL);
+}
+
+/*
+ * Evaluates an 'and'. We start from the rarest operand and intersect the
+ * others into it, stopping as soon as nothing is left, then stream the
+ * result through every negated operand.
+ */
+static postings_t *evaluate_and(indexer_t *indexer, query_node_t *node) {
+    postings_t *result = NULL;
+    int i;
+    for (i = 0; i < node->child_count; i++) {
+        query_node_t *child = node->children[i];
+        if (result != NULL && result->size == 0) {
+            break;
+        }
+        postings_t *child_postings = evaluate_query(indexer,
+                child->type == QUERY_NOT ? child->children[0] : child);
+        child->scanned = child_postings->size;
+        postings_t *next;
+        if (result == NULL) {
+            if (child->type != QUERY_NOT) {
+                result = child_postings;
+                child->remaining = result->size;
+                continue;
+            }
+            /* the query only has negations, so we start from every document */
+            result = create_all_postings(indexer);
+        }
+        if (child->type == QUERY_NOT) {
+            next = difference_postings(result, child_postings);
+        } else {
+            next = intersect_postings(result, child_postings);
+        }
+        destroy_postings(child_postings);
+        destroy_postings(result);
+        result = next;
+        child->remaining = result->size;
+    }
+    if (result == NULL) {
+        result = create_postings(0);
+    }
+    node->scanned = node->remaining = result->size;
+    return result;
+}
+
+/*
+ * Evaluates a planned query against the given indexer.
+ */
+postings_t *evaluate_query(indexer_t *indexer, query_node_t *node) {
+    postings_t *result;
+    if (node->type == QUERY_TERM) {
+        if (indexer->directory != NULL) {
+            /* the postings are read from the index file the first time they're needed */
+            result = get_directory_postings(indexer, node->term);
+        } else if (indexer->packed != NULL) {
+            result = get_packed_postings(indexer, node->term);
+        } else {
+            indexer_entry_t *entry = get_indexer_entry(indexer, node->term);
+            result = entry != NULL ? create_entry_postings(indexer, entry) : create_postings(0);
+        }
+    } else if (node->type == QUERY_NOT) {
+        postings_t *all = create_all_postings(indexer);
+        postings_t *child_postings = evaluate_query(indexer, node->children[0]);
+        result = difference_postings(all, child_postings);
+        destroy_postings(all);
+        destroy_postings(child_postings);
+    } else if (node->type == QUERY_AND) {
+        return evaluate_and(indexer, node);
+    } else {
+        result = create_postings(0);
+        int i;
+        for (i = 0; i < node->child_count; i++) {
+            postings_t *child_postings = evaluate_query(indexer, node->children[i]);
+            postings_t *next = union_postings(result, child_postings);
+            destroy_postings(child_postings);
+            destroy_postings(result);
+            result = next;
+        }
+    }
+    node->scanned = node->remaining = result->size;
+    return result;
+}
+
+/*
+ * Evaluates the operands of an 'and' (or a lone negation) for its highest
+ * matching ids only. Its rarest positive operand, or every document if it
+ * only has negations, is walked from the highest id down, and every id is
+ * checked against the other operands, until enough of them match.
+ */
+static postings_t *evaluate_and_top(indexer_t *indexer, query_node_t **operands, int count, int limit) {
+    postings_t **postings = calloc(count, sizeof(postings_t *));
+    postings_t *result = create_postings(limit > 0 ? (limit < 1024 ? limit : 1024) : 1);
+    bool empty = false;
+    int i;
+    for (i = 0; i < count && !empty; i++) {
+        bool negated = operands[i]->type == QUERY_NOT;
+        postings[i] = evaluate_query(indexer, negated ? operands[i]->children[0] : operands[i]);
+        operands[i]->scanned = postings[i]->size;
+        operands[i]->remaining = 0;
+        /* positive operands come first, so nothing matches if one is empty */
+        empty = !negated && postings[i]->size == 0;
+    }
+    if (!empty) {
+        bool driven = operands[0]->type != QUERY_NOT;
+        if (driven) {
+            expand_postings(postings[0]);
+        }
+        long position = driven ? postings[0]->size - 1 : indexer->documents->count - 1;
+        for (; position >= 0 && result->size < limit; position--) {
+            uint32_t id = driven ? postings[0]->ids[position] : (uint32_t) position;
+            if (driven) {
+                /* the candidates that got past each operand are counted */
+                operands[0]->remaining++;
+            }
+            for (i = driven ? 1 : 0; i < count; i++) {
+                if (postings_contains(postings[i], id) == (operands[i]->type == QUERY_NOT)) {
+                    break;
+                }
+                operands[i]->remaining++;
+            }
+            if (i == count) {
+                append_posting(result, id);
+            }
+        }
+        /* the ids were found from the highest down */
+        int low = 0;
+        int high = result->size - 1;
+        while (low < high) {
+            uint32_t id = result->ids[low];
+            result->ids[low++] = result->ids[high];
+            result->ids[high--] = id;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        if (postings[i] != NULL) {
+            destroy_postings(postings[i]);
+        }
+    }
+    free(postings);
+    return result;
+}
+
+/*
+ * Evaluates a planned query for its highest matching ids only.
+ */
+postings_t *evaluate_query_top(indexer_t *indexer, query_node_t *node, int limit) {
+    postings_t *result;
+    if (node->type == QUERY_AND) {
+        result = evaluate_and_top(indexer, node->children, node->child_count, limit);
+        node->scanned = result->size;
+    } else if (node->type == QUERY_NOT) {
+        /* a lone negation is its own operand, whose counts are kept */
+        return evaluate_and_top(indexer, &node, 1, limit);
+    } else if (node->type == QUERY_TERM) {
+        result = evaluate_query(indexer, node);
+        keep_highest_postings(result, limit);
+    } else {
+        /* the highest ids of an 'or' are among the highest ids of its operands */
+        result = create_postings(0);
+        int i;
+        for (i = 0; i < node->child_count; i++) {
+            postings_t *child_postings = evaluate_query_top(indexer, node->children[i], limit);
+            postings_t *next = union_postings(result, child_postings);
+            destroy_postings(child_postings);
+            destroy_postings(result);
+            result = next;
+            keep_highest_postings(result, limit);
+        }
+        node->scanned = result->size;
+    }
+    node->remaining = result->size;
+    return result;
+}
+
+/*
+ * Counts the documents matching a planned query. Dense results stay
+ * bitmaps, whose cardinality is known without listing their ids.
+ */
+long count_query(indexer_t *indexer, query_node_t *node) {
+    postings_t *postings = evaluate_query(indexer, node);
+    long count = postings->size;
+    destroy_postings(postings);
+    return count;
+}
@@ -0,0 +1,45 @@
+#ifndef _QUERY_ENGINE_H_
+#define _QUERY_ENGINE_H_
+
+#include "indexer.h"
+#include "postings.h"
+#include "query_parser.h"
+
+/*
+ * Plans a query for the given indexer, given the parsed query. The plan is
+ * a normalized copy of the query: nested operators are flattened, double
+ * negations are removed, negated 'or's are pushed down into 'and's, and the
+ * operands of every 'and' are ordered from the rarest term (by document
+ * frequency) to the most common, with negations last. Terms go through the
+ * tokenizer and the indexer's token filters like indexed text does, and
+ * terms nothing is left of are dropped. Fuzzy terms are expanded to an 'or'
+ * of the indexer's terms within their edit distance. The caller is
+ * responsible for freeing the plan using destroy_query_node.
+ */
+query_node_t *plan_query(indexer_t *, query_node_t *);
+
+/*
+ * Evaluates a planned query against the given indexer, whose document table
+ * must have been built. The caller is responsible for freeing the returned
+ * postings list.
+ */
+postings_t *evaluate_query(indexer_t *, query_node_t *);
+
+/*
+ * Evaluates a planned query against the given indexer, keeping only the
+ * given number of matching documents with the highest ids, which are the
+ * ones listed first since results are listed in descending path order.
+ * The limit is pushed down: an 'or' only takes the highest ids of each of
+ * its operands, and an 'and' or a negation walks its rarest operand from
+ * the top and stops as soon as enough documents match. The caller is
+ * responsible for freeing the returned postings list.
+ */
+postings_t *evaluate_query_top(indexer_t *, query_node_t *, int);
+
+/*
+ * Counts the documents matching a planned query against the given indexer,
+ * without listing them.
+ */
+long count_query(indexer_t *, query_node_t *);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "query_parser.h"
+
+/*
+ * The types of tokens in a boolean query.
+ */
+typedef enum query_token_type {
+    TOKEN_TERM,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+    TOKEN_END
+} query_token_type_t;
+
+/*
+ * The state of the parser: the query string, the current position in it,
+ * and the current (already scanned) token.
+ */
+typedef struct query_scanner {
+    char *position;
+    query_token_type_t type;
+    char *term_start;
+    size_t term_size;
+} query_scanner_t;
+
+/*
+ * Creates a query node, given its type and term (NULL for operators).
+ */
+query_node_t *create_query_node(query_node_type_t type, char *term) {
+    query_node_t *node = malloc(sizeof(query_node_t));
+    node->type = type;
+    node->term = term != NULL ? strdup(term) : NULL;
+    node->children = NULL;
+    node->child_count = 0;
+    node->distance = 0;
+    node->cost = 0;
+    node->scanned = -1;
+    node->remaining = -1;
+    return node;
+}
+
+/*
+ * Creates the node of a query term, which is fuzzy if it has a "~" suffix.
+ * A "~" anywhere else is left to the tokenizer, like any punctuation.
+ */
+query_node_t *create_term_node(char *term) {
+    char *tilde = strrchr(term, '~');
+    if (tilde == NULL || tilde == term || strspn(tilde + 1, "0123456789") != strlen(tilde + 1)) {
+        return create_query_node(QUERY_TERM, term);
+    }
+    int distance = tilde[1] != '\0' ? atoi(tilde + 1) : MAX_FUZZY_DISTANCE;
+    if (strlen(tilde + 1) > 2 || distance > MAX_FUZZY_DISTANCE) {
+        fprintf(stderr, "Error: The edit distance of a fuzzy term can be at most %d.\n", MAX_FUZZY_DISTANCE);
+        return NULL;
+    }
+    *tilde = '\0';
+    query_node_t *node = create_query_node(QUERY_FUZZY, term);
+    *tilde = '~';
+    node->distance = distance;
+    return node;
+}
+
+/*
+ * Adds a child to a query node.
+ */
+void add_query_child(query_node_t *node, query_node_t *child) {
+    node->children = realloc(node->children, (node->child_count + 1) * sizeof(query_node_t *));
+    node->children[node->child_count++] = child;
+}
+
+/*
+ * Destroys a query node and all of its children.
+ */
+void destroy_query_node(query_node_t *node) {
+    int i;
+    for (i = 0; i < node->child_count; i++) {
+        destroy_query_node(node->children[i]);
+    }
+    free(node->children);
+    free(node->term);
+    free(node);
+}
+
+/*
+ * Flag for whether a character ends a term.
+ */
+static bool is_separator(char c) {
+    return c == '\0' || c == ' ' || c == '\t' || c == '(' || c == ')';
+}
+
+/*
+ * Scans the next token of the query.
+ */
+static void next_token(query_scanner_t *scanner) {
+    while (*scanner->position == ' ' || *scanner->position == '\t') {
+        scanner->position++;
+    }
+    char c = *scanner->position;
+    if (c == '\0') {
+        scanner->type = TOKEN_END;
+        return;
+    } else if (c == '(' || c == ')') {
+        scanner->type = c == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+        scanner->position++;
+        return;
+    }
+    char *start = scanner->position;
+    while (!is_separator(*scanner->position)) {
+        scanner->position++;
+    }
+    size_t size = scanner->position - start;
+    /* operators are upper case, so they can't clash with indexed terms */
+    if (size == 3 && strncmp(start, "AND", 3) == 0) {
+        scanner->type = TOKEN_AND;
+    } else if (size == 2 && strncmp(start, "OR", 2) == 0) {
+        scanner->type = TOKEN_OR;
+    } else if (size == 3 && strncmp(start, "NOT", 3) == 0) {
+        scanner->type = TOKEN_NOT;
+    } else {
+        scanner->type = TOKEN_TERM;
+        scanner->term_start = start;
+        scanner->term_size = size;
+    }
+}
+
+static query_node_t *parse_or(query_scanner_t *);
+
+/*
+ * Parses a term, a negation, or a parenthesized group.
+ */
+static query_node_t *parse_unary(query_scanner_t *scanner) {
+    if (scanner->type == TOKEN_NOT) {
+        next_token(scanner);
+        query_node_t *child = parse_unary(scanner);
+        if (child == NULL) {
+            return NULL;
+        }
+        query_node_t *node = create_query_node(QUERY_NOT, NULL);
+        add_query_child(node, child);
+        return node;
+    } else if (scanner->type == TOKEN_OPEN) {
+        next_token(scanner);
+        query_node_t *node = parse_or(scanner);
+        if (node == NULL) {
+            return NULL;
+        }
+        if (scanner->type != TOKEN_CLOSE) {
+            fprintf(stderr, "Error: Expected ')' in query.\n");
+            destroy_query_node(node);
+            return NULL;
+        }
+        next_token(scanner);
+        return node;
+    } else if (scanner->type == TOKEN_TERM) {
+        char *term = malloc(scanner->term_size + sizeof(char));
+        memcpy(term, scanner->term_start, scanner->term_size);
+        term[scanner->term_size] = '\0';
+        query_node_t *node = create_term_node(term);
+        free(term);
+        if (node != NULL) {
+            next_token(scanner);
+        }
+        return node;
+    }
+    fprintf(stderr, "Error: Expected a term, 'NOT' or '(' in query.\n");
+    return NULL;
+}
+
+/*
+ * Flag for whether the current token can start an operand.
+ */
+static bool starts_operand(query_scanner_t *scanner) {
+    return scanner->type == TOKEN_TERM || scanner->type == TOKEN_NOT || scanner->type == TOKEN_OPEN;
+}
+
+/*
+ * Parses a chain of operands joined by 'AND' (or by nothing at all).
+ */
+static query_node_t *parse_and(query_scanner_t *scanner) {
+    query_node_t *first = parse_unary(scanner);
+    if (first == NULL) {
+        return NULL;
+    }
+    query_node_t *node = NULL;
+    while (scanner->type == TOKEN_AND || starts_operand(scanner)) {
+        if (scanner->type == TOKEN_AND) {
+            next_token(scanner);
+        }
+        query_node_t *next = parse_unary(scanner);
+        if (next == NULL) {
+            destroy_query_node(node != NULL ? node : first);
+            return NULL;
+        }
+        if (node == NULL) {
+            node = create_query_node(QUERY_AND, NULL);
+            add_query_child(node, first);
+        }
+        add_query_child(node, next);
+    }
+    return node != NULL ? node : first;
+}
+
+/*
+ * Parses a chain of operands joined by 'OR'.
+ */
+static query_node_t *parse_or(query_scanner_t *scanner) {
+    query_node_t *first = parse_and(scanner);
+    if (first == NULL) {
+        return NULL;
+    }
+    query_node_t *node = NULL;
+    while (scanner->type == TOKEN_OR) {
+        next_token(scanner);
+        query_node_t *next = parse_and(scanner);
+        if (next == NULL) {
+            destroy_query_node(node != NULL ? node : first);
+            return NULL;
+        }
+        if (node == NULL) {
+            node = create_query_node(QUERY_OR, NULL);
+            add_query_child(node, first);
+        }
+        add_query_child(node, next);
+    }
+    return node != NULL ? node : first;
+}
+
+/*
+ * Parses a boolean query into a syntax tree.
+ */
+query_node_t *parse_query(char *query) {
+    query_scanner_t scanner;
+    scanner.position = query;
+    next_token(&scanner);
+    if (scanner.type == TOKEN_END) {
+        fprintf(stderr, "Error: Empty query.\n");
+        return NULL;
+    }
+    query_node_t *node = parse_or(&scanner);
+    if (node != NULL && scanner.type != TOKEN_END) {
+        fprintf(stderr, "Error: Unexpected '%s' in query.\n",
+                scanner.type == TOKEN_CLOSE ? ")" : "token");
+        destroy_query_node(node);
+        return NULL;
+    }
+    return node;
+}
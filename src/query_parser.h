@@ -0,0 +1,80 @@
+#ifndef _QUERY_PARSER_H_
+#define _QUERY_PARSER_H_
+
+/*
+ * The types of nodes in a boolean query.
+ */
+typedef enum query_node_type {
+    QUERY_TERM,
+    QUERY_FUZZY,
+    QUERY_AND,
+    QUERY_OR,
+    QUERY_NOT
+} query_node_type_t;
+
+/*
+ * The largest edit distance a fuzzy term can be given.
+ */
+#define MAX_FUZZY_DISTANCE 2
+
+/*
+ * A node in the syntax tree of a boolean query. Term and fuzzy term nodes
+ * have a term and no children, 'not' nodes have exactly one child, and
+ * 'and'/'or' nodes have one or more.
+ */
+typedef struct query_node {
+    query_node_type_t type;
+    char *term;
+    /* the most edits (inserted, deleted or substituted characters) a fuzzy
+     * term can be away from the terms it matches */
+    int distance;
+    struct query_node **children;
+    int child_count;
+    /* the estimated number of matching documents, filled in by the planner */
+    long cost;
+    /* filled in by the evaluator, so a query can be explained: the number
+     * of documents the node's own postings held, and the number of
+     * candidates left once the node was applied, which for an operand of
+     * an 'and' is what is left of the 'and' so far. Both are -1 if the node
+     * wasn't evaluated */
+    long scanned;
+    long remaining;
+} query_node_t;
+
+/*
+ * Parses a boolean query, such as "a AND (b OR c) AND NOT d". Terms next to
+ * each other without an operator are and-ed together, and a term followed
+ * by "~" and an edit distance, such as "color~1", is a fuzzy term (see
+ * create_term_node). Returns NULL and prints an error if the query is
+ * malformed. The caller is responsible for freeing the returned tree using
+ * destroy_query_node.
+ */
+query_node_t *parse_query(char *);
+
+/*
+ * Creates a query node, given its type and term (NULL for operators). The
+ * caller is responsible for freeing the allocated memory.
+ */
+query_node_t *create_query_node(query_node_type_t, char *);
+
+/*
+ * Creates the node of a single query term: a fuzzy term if it ends with "~"
+ * and an edit distance of at most MAX_FUZZY_DISTANCE ("~" alone stands for
+ * the largest), which matches every indexed term within that distance of
+ * it, or a plain term otherwise. Returns NULL and prints an error if the
+ * distance is too large. The caller is responsible for freeing the
+ * allocated memory.
+ */
+query_node_t *create_term_node(char *);
+
+/*
+ * Adds a child to a query node.
+ */
+void add_query_child(query_node_t *, query_node_t *);
+
+/*
+ * Destroys a query node and all of its children.
+ */
+void destroy_query_node(query_node_t *);
+
+#endif
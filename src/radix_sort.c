@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "radix_sort.h"
+
+/*
+ * Buckets of at most this many items are insertion sorted.
+ */
+#define RADIX_CUTOFF 32
+
+/*
+ * Fewer items than this are sorted on the calling thread alone, since
+ * starting threads would take longer than sorting them.
+ */
+#define RADIX_PARALLEL_MINIMUM 4096
+
+/*
+ * The buckets of the first byte, shared by the threads that sort them: the
+ * threads take the next bucket until there are none left.
+ */
+typedef struct radix_pool {
+    radix_item_t *items;
+    radix_item_t *buffer;
+    /* where every bucket starts, and the order they're handed out in */
+    int starts[257];
+    int order[256];
+    int order_count;
+    int next;
+    pthread_mutex_t lock;
+} radix_pool_t;
+
+/*
+ * Insertion sorts items whose keys are known to be equal up to the given
+ * depth.
+ */
+static void insertion_sort(radix_item_t *items, int count, int depth) {
+    int i;
+    for (i = 1; i < count; i++) {
+        radix_item_t item = items[i];
+        int j = i;
+        while (j > 0 && strcmp(items[j - 1].key + depth, item.key + depth) > 0) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+/*
+ * Splits items into buckets by the byte of their keys at the given depth,
+ * using the buffer, and fills in where every bucket starts. The items of
+ * bucket 0 have keys that end there.
+ */
+static void split_buckets(radix_item_t *items, radix_item_t *buffer, int count, int depth, int *starts) {
+    int counts[256];
+    memset(counts, 0, sizeof(counts));
+    int i;
+    for (i = 0; i < count; i++) {
+        counts[(unsigned char) items[i].key[depth]]++;
+    }
+    int positions[256];
+    starts[0] = 0;
+    for (i = 0; i < 256; i++) {
+        positions[i] = starts[i];
+        starts[i + 1] = starts[i] + counts[i];
+    }
+    for (i = 0; i < count; i++) {
+        buffer[positions[(unsigned char) items[i].key[depth]]++] = items[i];
+    }
+    memcpy(items, buffer, count * sizeof(radix_item_t));
+}
+
+/*
+ * Sorts items whose keys are known to be equal up to the given depth, on
+ * the calling thread.
+ */
+static void sort_bucket(radix_item_t *items, radix_item_t *buffer, int count, int depth) {
+    if (count <= RADIX_CUTOFF) {
+        insertion_sort(items, count, depth);
+        return;
+    }
+    int starts[257];
+    split_buckets(items, buffer, count, depth, starts);
+    int i;
+    for (i = 1; i < 256; i++) {
+        int size = starts[i + 1] - starts[i];
+        if (size > 1) {
+            sort_bucket(items + starts[i], buffer + starts[i], size, depth + 1);
+        }
+    }
+}
+
+/*
+ * Sorts the buckets of the first byte until there are none left.
+ */
+static void *sort_buckets(void *argument) {
+    radix_pool_t *pool = argument;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        int bucket = pool->next < pool->order_count ? pool->order[pool->next++] : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (bucket == -1) {
+            break;
+        }
+        int start = pool->starts[bucket];
+        sort_bucket(pool->items + start, pool->buffer + start, pool->starts[bucket + 1] - start, 1);
+    }
+    return NULL;
+}
+
+/*
+ * Sorts items by their keys.
+ */
+void radix_sort(radix_item_t *items, int count, int thread_count) {
+    if (count < 2) {
+        return;
+    }
+    radix_pool_t pool;
+    pool.items = items;
+    pool.buffer = malloc(count * sizeof(radix_item_t));
+    if (count < RADIX_PARALLEL_MINIMUM || thread_count < 2) {
+        sort_bucket(items, pool.buffer, count, 0);
+        free(pool.buffer);
+        return;
+    }
+    split_buckets(items, pool.buffer, count, 0, pool.starts);
+    /* the largest buckets are handed out first, so no thread is left with a
+     * large one at the end */
+    pool.order_count = 0;
+    int i;
+    for (i = 1; i < 256; i++) {
+        int size = pool.starts[i + 1] - pool.starts[i];
+        if (size > 1) {
+            int j = pool.order_count++;
+            while (j > 0 && pool.starts[pool.order[j - 1] + 1] - pool.starts[pool.order[j - 1]] < size) {
+                pool.order[j] = pool.order[j - 1];
+                j--;
+            }
+            pool.order[j] = i;
+        }
+    }
+    pool.next = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_t *threads = malloc((thread_count - 1) * sizeof(pthread_t));
+    bool *started = malloc((thread_count - 1) * sizeof(bool));
+    for (i = 0; i < thread_count - 1; i++) {
+        started[i] = pthread_create(&threads[i], NULL, &sort_buckets, &pool) == 0;
+    }
+    /* the calling thread sorts buckets too, so this works without threads */
+    sort_buckets(&pool);
+    for (i = 0; i < thread_count - 1; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.buffer);
+}
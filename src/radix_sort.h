@@ -0,0 +1,22 @@
+#ifndef _RADIX_SORT_H_
+#define _RADIX_SORT_H_
+
+/*
+ * An item to sort: a string key, and the value it belongs to.
+ */
+typedef struct radix_item {
+    const char *key;
+    void *value;
+} radix_item_t;
+
+/*
+ * Sorts items by their keys, in the byte order strcmp uses, given the
+ * items, their number, and how many threads to use. This is a most
+ * significant digit radix sort: the items are split into buckets by the
+ * first byte of their keys, and every bucket is sorted on by the next byte
+ * on its own, so the buckets are sorted in parallel. Small buckets are
+ * insertion sorted. Items with equal keys end up in no particular order.
+ */
+void radix_sort(radix_item_t *, int, int);
+
+#endif
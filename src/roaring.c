@@ -0,0 +1,652 @@
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+
+/*
+ * Postings smaller than this are never worth a bitmap. It can be lowered at
+ * build time so that small test folders get bitmaps too.
+ */
+#ifndef ROARING_MIN_CARDINALITY
+#define ROARING_MIN_CARDINALITY 64
+#endif
+
+/*
+ * Flag for whether a postings list is dense enough to be stored as a bitmap.
+ * A bitmap container costs a bit per document while a list costs 32, so
+ * bitmaps win once at least one in 32 documents is in the list.
+ */
+bool is_roaring_worthwhile(long cardinality, long document_count) {
+    return cardinality >= ROARING_MIN_CARDINALITY && cardinality * 32 >= document_count;
+}
+
+/*
+ * Creates an empty roaring bitmap.
+ */
+roaring_t *create_roaring() {
+    roaring_t *roaring = malloc(sizeof(roaring_t));
+    roaring->containers = NULL;
+    roaring->count = 0;
+    roaring->capacity = 0;
+    roaring->cardinality = 0;
+    return roaring;
+}
+
+static void destroy_container(roaring_container_t *container) {
+    free(container->values);
+    free(container->words);
+}
+
+/*
+ * Destroys a roaring bitmap.
+ */
+void destroy_roaring(roaring_t *roaring) {
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        destroy_container(&roaring->containers[i]);
+    }
+    free(roaring->containers);
+    free(roaring);
+}
+
+static int popcount_words(const uint64_t *words) {
+    int count = 0;
+    int i;
+    for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+        count += __builtin_popcountll(words[i]);
+    }
+    return count;
+}
+
+/*
+ * Adds a container at the end of the container array.
+ */
+static roaring_container_t *push_container(roaring_t *roaring, roaring_container_t *container) {
+    if (roaring->count == roaring->capacity) {
+        roaring->capacity = roaring->capacity == 0 ? 4 : roaring->capacity * 2;
+        roaring->containers = realloc(roaring->containers,
+                roaring->capacity * sizeof(roaring_container_t));
+    }
+    roaring->containers[roaring->count] = *container;
+    roaring->cardinality += container->cardinality;
+    return &roaring->containers[roaring->count++];
+}
+
+/*
+ * Appends a container to a roaring bitmap, taking ownership of its data.
+ * Empty containers are dropped.
+ */
+void append_roaring_container(roaring_t *roaring, roaring_container_t *container) {
+    if (container->cardinality == 0) {
+        destroy_container(container);
+        return;
+    }
+    push_container(roaring, container);
+}
+
+/*
+ * Initializes an empty container of the given type and key.
+ */
+static void init_container(roaring_container_t *container, uint16_t key, uint8_t type) {
+    container->key = key;
+    container->type = type;
+    container->cardinality = 0;
+    container->size = 0;
+    container->values = NULL;
+    container->words = NULL;
+    if (type == ROARING_ARRAY) {
+        container->values = malloc(ROARING_ARRAY_MAX * sizeof(uint16_t));
+    } else if (type == ROARING_BITMAP) {
+        container->words = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    }
+}
+
+/*
+ * Turns a full array container into a bitmap container.
+ */
+static void array_to_bitmap(roaring_container_t *container) {
+    uint64_t *words = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    int i;
+    for (i = 0; i < container->size; i++) {
+        words[container->values[i] >> 6] |= 1ULL << (container->values[i] & 63);
+    }
+    free(container->values);
+    container->values = NULL;
+    container->words = words;
+    container->size = 0;
+    container->type = ROARING_BITMAP;
+}
+
+/*
+ * Appends a value to a roaring bitmap, in ascending order.
+ */
+void append_roaring(roaring_t *roaring, uint32_t value) {
+    uint16_t key = (uint16_t) (value >> 16);
+    uint16_t low = (uint16_t) (value & 0xFFFF);
+    roaring_container_t *container = roaring->count > 0 ? &roaring->containers[roaring->count - 1] : NULL;
+    if (container == NULL || container->key != key) {
+        roaring_container_t new_container;
+        init_container(&new_container, key, ROARING_ARRAY);
+        container = push_container(roaring, &new_container);
+    }
+    if (container->type == ROARING_ARRAY) {
+        if (container->size == ROARING_ARRAY_MAX) {
+            array_to_bitmap(container);
+        } else {
+            container->values[container->size++] = low;
+        }
+    }
+    if (container->type == ROARING_BITMAP) {
+        container->words[low >> 6] |= 1ULL << (low & 63);
+    }
+    container->cardinality++;
+    roaring->cardinality++;
+}
+
+/*
+ * Fills a 1024 word bitmap with the values of any container.
+ */
+static void container_to_words(roaring_container_t *container, uint64_t *words) {
+    int i;
+    if (container->type == ROARING_BITMAP) {
+        memcpy(words, container->words, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        return;
+    }
+    memset(words, 0, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    if (container->type == ROARING_ARRAY) {
+        for (i = 0; i < container->size; i++) {
+            words[container->values[i] >> 6] |= 1ULL << (container->values[i] & 63);
+        }
+    } else {
+        for (i = 0; i < container->size; i++) {
+            uint32_t value = container->values[2 * i];
+            uint32_t end = value + container->values[2 * i + 1];
+            for (; value <= end; value++) {
+                words[value >> 6] |= 1ULL << (value & 63);
+            }
+        }
+    }
+}
+
+/*
+ * Creates a container from a 1024 word bitmap, as an array container if it
+ * is sparse enough. Takes ownership of the words.
+ */
+static void container_from_words(roaring_container_t *container, uint16_t key, uint64_t *words) {
+    container->key = key;
+    container->cardinality = popcount_words(words);
+    container->size = 0;
+    if (container->cardinality > ROARING_ARRAY_MAX) {
+        container->type = ROARING_BITMAP;
+        container->values = NULL;
+        container->words = words;
+        return;
+    }
+    container->type = ROARING_ARRAY;
+    container->words = NULL;
+    container->values = malloc((container->cardinality > 0 ? container->cardinality : 1) * sizeof(uint16_t));
+    int i;
+    for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+        uint64_t word = words[i];
+        while (word != 0) {
+            container->values[container->size++] = (uint16_t) (i * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    free(words);
+}
+
+static bool container_contains(roaring_container_t *container, uint16_t value) {
+    if (container->type == ROARING_BITMAP) {
+        return (container->words[value >> 6] >> (value & 63)) & 1;
+    }
+    int low = 0;
+    int high = container->size - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        uint16_t start = container->values[container->type == ROARING_RUN ? 2 * middle : middle];
+        if (container->type == ROARING_RUN) {
+            uint32_t end = (uint32_t) start + container->values[2 * middle + 1];
+            if (value >= start && value <= end) {
+                return true;
+            }
+        } else if (value == start) {
+            return true;
+        }
+        if (start < value) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return false;
+}
+
+/*
+ * Counts the runs of consecutive values in a container.
+ */
+static int count_runs(roaring_container_t *container) {
+    int runs = 0;
+    int i;
+    if (container->type == ROARING_ARRAY) {
+        for (i = 0; i < container->size; i++) {
+            if (i == 0 || container->values[i] != container->values[i - 1] + 1) {
+                runs++;
+            }
+        }
+    } else if (container->type == ROARING_BITMAP) {
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            uint64_t word = container->words[i];
+            /* a run starts at every set bit whose previous bit is clear */
+            uint64_t previous = (word << 1) | (i > 0 ? container->words[i - 1] >> 63 : 0);
+            runs += __builtin_popcountll(word & ~previous);
+        }
+    } else {
+        runs = container->size;
+    }
+    return runs;
+}
+
+/*
+ * Converts a container to whichever representation takes the least space.
+ */
+static void optimize_container(roaring_container_t *container) {
+    int runs = count_runs(container);
+    size_t run_size = 4 * (size_t) runs;
+    size_t array_size = 2 * (size_t) container->cardinality;
+    size_t bitmap_size = ROARING_BITMAP_WORDS * sizeof(uint64_t);
+    uint8_t best = ROARING_BITMAP;
+    if (run_size < bitmap_size && run_size < array_size) {
+        best = ROARING_RUN;
+    } else if (container->cardinality <= ROARING_ARRAY_MAX) {
+        best = ROARING_ARRAY;
+    }
+    if (best == container->type) {
+        return;
+    }
+    uint64_t *words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    container_to_words(container, words);
+    uint16_t key = container->key;
+    destroy_container(container);
+    if (best != ROARING_RUN) {
+        container_from_words(container, key, words);
+        if (best == ROARING_BITMAP && container->type != ROARING_BITMAP) {
+            array_to_bitmap(container);
+        }
+        return;
+    }
+    container->key = key;
+    container->type = ROARING_RUN;
+    container->cardinality = popcount_words(words);
+    container->size = 0;
+    container->words = NULL;
+    container->values = malloc(2 * runs * sizeof(uint16_t));
+    int value = 0;
+    while (value < 65536) {
+        if ((words[value >> 6] >> (value & 63)) & 1) {
+            int start = value;
+            while (value < 65536 && ((words[value >> 6] >> (value & 63)) & 1)) {
+                value++;
+            }
+            container->values[2 * container->size] = (uint16_t) start;
+            container->values[2 * container->size + 1] = (uint16_t) (value - start - 1);
+            container->size++;
+        } else {
+            value++;
+        }
+    }
+    free(words);
+}
+
+/*
+ * Converts every container to the smallest representation.
+ */
+void optimize_roaring(roaring_t *roaring) {
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        optimize_container(&roaring->containers[i]);
+    }
+}
+
+/*
+ * Gives back the unused capacity of a roaring bitmap. Array containers are
+ * made with room for as many values as they can ever hold, which is mostly
+ * wasted on the few values of a sparse container.
+ */
+void trim_roaring(roaring_t *roaring) {
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        roaring_container_t *container = &roaring->containers[i];
+        if (container->type == ROARING_ARRAY && container->size > 0) {
+            container->values = realloc(container->values, container->size * sizeof(uint16_t));
+        }
+    }
+    if (roaring->count > 0 && roaring->count < roaring->capacity) {
+        roaring->containers = realloc(roaring->containers, roaring->count * sizeof(roaring_container_t));
+        roaring->capacity = roaring->count;
+    }
+}
+
+/*
+ * Finds the container with the given key. Returns NULL if there is none.
+ */
+static roaring_container_t *find_container(roaring_t *roaring, uint16_t key) {
+    int low = 0;
+    int high = roaring->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (roaring->containers[middle].key == key) {
+            return &roaring->containers[middle];
+        } else if (roaring->containers[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Checks if a roaring bitmap contains the given value.
+ */
+bool roaring_contains(roaring_t *roaring, uint32_t value) {
+    roaring_container_t *container = find_container(roaring, (uint16_t) (value >> 16));
+    return container != NULL && container_contains(container, (uint16_t) (value & 0xFFFF));
+}
+
+/*
+ * Copies every value of a container, in ascending order, into the given
+ * array. Returns the number of values copied.
+ */
+static int container_to_array(roaring_container_t *container, uint32_t *array) {
+    uint32_t high = (uint32_t) container->key << 16;
+    int count = 0;
+    int i;
+    if (container->type == ROARING_ARRAY) {
+        for (i = 0; i < container->size; i++) {
+            array[count++] = high | container->values[i];
+        }
+    } else if (container->type == ROARING_BITMAP) {
+        for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            uint64_t word = container->words[i];
+            while (word != 0) {
+                array[count++] = high | (uint32_t) (i * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    } else {
+        for (i = 0; i < container->size; i++) {
+            uint32_t value = container->values[2 * i];
+            uint32_t end = value + container->values[2 * i + 1];
+            for (; value <= end; value++) {
+                array[count++] = high | value;
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Copies every value of a roaring bitmap into the given array.
+ */
+void roaring_to_array(roaring_t *roaring, uint32_t *array) {
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        array += container_to_array(&roaring->containers[i], array);
+    }
+}
+
+/*
+ * The operations roaring bitmaps support.
+ */
+typedef enum roaring_operation {
+    OPERATION_AND,
+    OPERATION_OR,
+    OPERATION_ANDNOT
+} roaring_operation_t;
+
+/*
+ * Merges two array containers with the given operation.
+ */
+static void array_operation(roaring_container_t *first, roaring_container_t *second,
+        roaring_operation_t operation, roaring_container_t *result) {
+    int capacity = operation == OPERATION_OR ? first->size + second->size : first->size;
+    uint16_t *values = malloc((capacity > 0 ? capacity : 1) * sizeof(uint16_t));
+    int count = 0;
+    int i = 0;
+    int j = 0;
+    while (i < first->size && j < second->size) {
+        if (first->values[i] < second->values[j]) {
+            if (operation != OPERATION_AND) values[count++] = first->values[i];
+            i++;
+        } else if (first->values[i] > second->values[j]) {
+            if (operation == OPERATION_OR) values[count++] = second->values[j];
+            j++;
+        } else {
+            if (operation != OPERATION_ANDNOT) values[count++] = first->values[i];
+            i++;
+            j++;
+        }
+    }
+    if (operation != OPERATION_AND) {
+        while (i < first->size) values[count++] = first->values[i++];
+    }
+    if (operation == OPERATION_OR) {
+        while (j < second->size) values[count++] = second->values[j++];
+    }
+    result->key = first->key;
+    result->type = ROARING_ARRAY;
+    result->cardinality = count;
+    result->size = count;
+    result->values = values;
+    result->words = NULL;
+    if (count > ROARING_ARRAY_MAX) {
+        array_to_bitmap(result);
+    }
+}
+
+/*
+ * Filters an array container by membership in another container.
+ */
+static void filter_array_container(roaring_container_t *array, roaring_container_t *other,
+        bool keep_present, roaring_container_t *result) {
+    uint16_t *values = malloc((array->size > 0 ? array->size : 1) * sizeof(uint16_t));
+    int count = 0;
+    int i;
+    for (i = 0; i < array->size; i++) {
+        if (container_contains(other, array->values[i]) == keep_present) {
+            values[count++] = array->values[i];
+        }
+    }
+    result->key = array->key;
+    result->type = ROARING_ARRAY;
+    result->cardinality = count;
+    result->size = count;
+    result->values = values;
+    result->words = NULL;
+}
+
+/*
+ * Combines two containers with the same key, given the operation. Arrays
+ * are merged or filtered, everything else is combined a word at a time.
+ */
+static void container_operation(roaring_container_t *first, roaring_container_t *second,
+        roaring_operation_t operation, roaring_container_t *result) {
+    if (first->type == ROARING_ARRAY && second->type == ROARING_ARRAY) {
+        array_operation(first, second, operation, result);
+        return;
+    }
+    if (first->type == ROARING_ARRAY && operation != OPERATION_OR) {
+        filter_array_container(first, second, operation == OPERATION_AND, result);
+        return;
+    }
+    if (second->type == ROARING_ARRAY && operation == OPERATION_AND) {
+        filter_array_container(second, first, true, result);
+        return;
+    }
+    uint64_t *words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    uint64_t *other_words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    container_to_words(first, words);
+    container_to_words(second, other_words);
+    int i;
+    for (i = 0; i < ROARING_BITMAP_WORDS; i++) {
+        if (operation == OPERATION_AND) {
+            words[i] &= other_words[i];
+        } else if (operation == OPERATION_OR) {
+            words[i] |= other_words[i];
+        } else {
+            words[i] &= ~other_words[i];
+        }
+    }
+    free(other_words);
+    container_from_words(result, first->key, words);
+}
+
+/*
+ * Copies a container, so it can be appended to another bitmap.
+ */
+static void copy_container(roaring_container_t *container, roaring_container_t *copy) {
+    *copy = *container;
+    if (container->values != NULL) {
+        size_t size = (container->type == ROARING_RUN ? 2 * container->size : container->size) * sizeof(uint16_t);
+        copy->values = malloc(size > 0 ? size : 1);
+        memcpy(copy->values, container->values, size);
+    }
+    if (container->words != NULL) {
+        copy->words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        memcpy(copy->words, container->words, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    }
+}
+
+/*
+ * Combines two roaring bitmaps by walking their containers in key order.
+ */
+static roaring_t *roaring_operation(roaring_t *first, roaring_t *second, roaring_operation_t operation) {
+    roaring_t *result = create_roaring();
+    int i = 0;
+    int j = 0;
+    roaring_container_t container;
+    while (i < first->count && j < second->count) {
+        uint16_t first_key = first->containers[i].key;
+        uint16_t second_key = second->containers[j].key;
+        if (first_key < second_key) {
+            if (operation != OPERATION_AND) {
+                copy_container(&first->containers[i], &container);
+                append_roaring_container(result, &container);
+            }
+            i++;
+        } else if (first_key > second_key) {
+            if (operation == OPERATION_OR) {
+                copy_container(&second->containers[j], &container);
+                append_roaring_container(result, &container);
+            }
+            j++;
+        } else {
+            container_operation(&first->containers[i], &second->containers[j], operation, &container);
+            append_roaring_container(result, &container);
+            i++;
+            j++;
+        }
+    }
+    for (; operation != OPERATION_AND && i < first->count; i++) {
+        copy_container(&first->containers[i], &container);
+        append_roaring_container(result, &container);
+    }
+    for (; operation == OPERATION_OR && j < second->count; j++) {
+        copy_container(&second->containers[j], &container);
+        append_roaring_container(result, &container);
+    }
+    return result;
+}
+
+/*
+ * Creates a copy of a roaring bitmap.
+ */
+roaring_t *copy_roaring(roaring_t *roaring) {
+    roaring_t *copy = create_roaring();
+    roaring_container_t container;
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        copy_container(&roaring->containers[i], &container);
+        append_roaring_container(copy, &container);
+    }
+    return copy;
+}
+
+/*
+ * Gets the number of bytes the containers of a roaring bitmap take up.
+ */
+size_t get_roaring_memory_size(roaring_t *roaring) {
+    size_t size = roaring->capacity * sizeof(roaring_container_t);
+    int i;
+    for (i = 0; i < roaring->count; i++) {
+        roaring_container_t *container = &roaring->containers[i];
+        if (container->words != NULL) {
+            size += ROARING_BITMAP_WORDS * sizeof(uint64_t);
+        } else {
+            size += (container->type == ROARING_RUN ? 2 * container->size : container->size) * sizeof(uint16_t);
+        }
+    }
+    return size;
+}
+
+roaring_t *roaring_and(roaring_t *first, roaring_t *second) {
+    return roaring_operation(first, second, OPERATION_AND);
+}
+
+roaring_t *roaring_or(roaring_t *first, roaring_t *second) {
+    return roaring_operation(first, second, OPERATION_OR);
+}
+
+roaring_t *roaring_andnot(roaring_t *first, roaring_t *second) {
+    return roaring_operation(first, second, OPERATION_ANDNOT);
+}
+
+/*
+ * Filters a sorted array of ids by membership in the bitmap. Since the ids
+ * are sorted, we only look up each container once.
+ */
+int roaring_filter_array(roaring_t *roaring, const uint32_t *ids, int size,
+        uint32_t *output, bool keep_present) {
+    int count = 0;
+    int container_index = 0;
+    int i;
+    for (i = 0; i < size; i++) {
+        uint16_t key = (uint16_t) (ids[i] >> 16);
+        while (container_index < roaring->count && roaring->containers[container_index].key < key) {
+            container_index++;
+        }
+        bool present = container_index < roaring->count
+                && roaring->containers[container_index].key == key
+                && container_contains(&roaring->containers[container_index], (uint16_t) (ids[i] & 0xFFFF));
+        if (present == keep_present) {
+            output[count++] = ids[i];
+        }
+    }
+    return count;
+}
+
+/*
+ * Builds a bitmap out of a sorted array of ids.
+ */
+static roaring_t *roaring_from_array(const uint32_t *ids, int size) {
+    roaring_t *roaring = create_roaring();
+    int i;
+    for (i = 0; i < size; i++) {
+        append_roaring(roaring, ids[i]);
+    }
+    return roaring;
+}
+
+roaring_t *roaring_or_array(roaring_t *roaring, const uint32_t *ids, int size) {
+    roaring_t *other = roaring_from_array(ids, size);
+    roaring_t *result = roaring_or(roaring, other);
+    destroy_roaring(other);
+    return result;
+}
+
+roaring_t *roaring_andnot_array(roaring_t *roaring, const uint32_t *ids, int size) {
+    roaring_t *other = roaring_from_array(ids, size);
+    roaring_t *result = roaring_andnot(roaring, other);
+    destroy_roaring(other);
+    return result;
+}
@@ -0,0 +1,131 @@
+#ifndef _ROARING_H_
+#define _ROARING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The container types of a roaring bitmap.
+ */
+#define ROARING_ARRAY 0
+#define ROARING_BITMAP 1
+#define ROARING_RUN 2
+
+/*
+ * An array container never holds more values than this, and a bitmap
+ * container is made of this many words.
+ */
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_BITMAP_WORDS 1024
+
+/*
+ * A container holds the low 16 bits of every value that shares the same
+ * high 16 bits (the key). Array containers keep the sorted values, bitmap
+ * containers keep a bit per possible value, and run containers keep pairs
+ * of (start, length - 1).
+ */
+typedef struct roaring_container {
+    uint16_t key;
+    uint8_t type;
+    int cardinality;
+    /* the number of values (array containers) or of runs (run containers) */
+    int size;
+    uint16_t *values;
+    uint64_t *words;
+} roaring_container_t;
+
+/*
+ * A compressed bitmap of 32-bit document ids, made of containers sorted
+ * by key.
+ */
+typedef struct roaring {
+    roaring_container_t *containers;
+    int count;
+    int capacity;
+    long cardinality;
+} roaring_t;
+
+/*
+ * Flag for whether a postings list with the given number of documents,
+ * out of the given total number of documents, is dense enough to be
+ * stored as a bitmap.
+ */
+bool is_roaring_worthwhile(long, long);
+
+/*
+ * Creates an empty roaring bitmap. The caller is responsible for freeing
+ * the allocated memory.
+ */
+roaring_t *create_roaring();
+
+/*
+ * Destroys a roaring bitmap.
+ */
+void destroy_roaring(roaring_t *);
+
+/*
+ * Appends a value to a roaring bitmap. Values must be appended in
+ * ascending order.
+ */
+void append_roaring(roaring_t *, uint32_t);
+
+/*
+ * Appends a container to a roaring bitmap, taking ownership of its values
+ * or words. Containers must be appended in ascending key order.
+ */
+void append_roaring_container(roaring_t *, roaring_container_t *);
+
+/*
+ * Converts every container to whichever representation is the smallest,
+ * including run containers for long stretches of consecutive values.
+ */
+void optimize_roaring(roaring_t *);
+
+/*
+ * Gives back the unused capacity of a roaring bitmap's containers, once no
+ * more values will be appended to it.
+ */
+void trim_roaring(roaring_t *);
+
+/*
+ * Checks if a roaring bitmap contains the given value.
+ */
+bool roaring_contains(roaring_t *, uint32_t);
+
+/*
+ * Copies every value of a roaring bitmap, in ascending order, into the
+ * given array, which must have room for all of them.
+ */
+void roaring_to_array(roaring_t *, uint32_t *);
+
+/*
+ * Creates a copy of a roaring bitmap. The caller is responsible for freeing
+ * the allocated memory.
+ */
+roaring_t *copy_roaring(roaring_t *);
+
+/*
+ * Gets the number of bytes the containers of a roaring bitmap take up.
+ */
+size_t get_roaring_memory_size(roaring_t *);
+
+/*
+ * Creates the intersection, union, or difference of two roaring bitmaps.
+ */
+roaring_t *roaring_and(roaring_t *, roaring_t *);
+roaring_t *roaring_or(roaring_t *, roaring_t *);
+roaring_t *roaring_andnot(roaring_t *, roaring_t *);
+
+/*
+ * Kernels for mixed bitmap/list operations, given a bitmap and a sorted
+ * array of ids with its size. roaring_filter_array copies into the output
+ * array every id that is (or, if the flag is false, isn't) in the bitmap and
+ * returns how many were copied. roaring_or_array and roaring_andnot_array
+ * create a new bitmap.
+ */
+int roaring_filter_array(roaring_t *, const uint32_t *, int, uint32_t *, bool);
+roaring_t *roaring_or_array(roaring_t *, const uint32_t *, int);
+roaring_t *roaring_andnot_array(roaring_t *, const uint32_t *, int);
+
+#endif
@@ -0,0 +1,657 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <regex.h>
+#include "search_command.h"
+#include "query_engine.h"
+#include "pattern_query.h"
+#include "index_directory.h"
+#include "util.h"
+
+/*
+ * The options of a search command, given before its terms: "-limit=<n>"
+ * and "-offset=<n>" to page through the results, "-count" to only count
+ * them, and "-i" to ignore case, for pattern searches.
+ */
+typedef struct search_options {
+    /* the most results to list, or -1 for all of them */
+    int limit;
+    int offset;
+    bool count;
+    bool ignore_case;
+} search_options_t;
+
+/*
+ * What an explained search found out about a single indexer of its set:
+ * the plan, with the counts the evaluator filled in, the time planning and
+ * evaluating took, in milliseconds, and what the indexer's postings cache
+ * did in the meantime. Pattern searches also count the candidates that
+ * were read and checked against the expression, and those that matched.
+ */
+typedef struct indexer_profile {
+    query_node_t *plan;
+    double start;
+    double plan_time;
+    double evaluate_time;
+    directory_stats_t cache;
+    long checked;
+    long matched;
+} indexer_profile_t;
+
+/*
+ * The profile of an explained search: the time, in milliseconds, every
+ * stage took, and the profile of every indexer of the set, in order.
+ */
+typedef struct search_profile {
+    index_set_t *index_set;
+    indexer_profile_t *indexers;
+    double parse_time;
+    double search_time;
+    double output_time;
+} search_profile_t;
+
+/*
+ * A search of a query over the indexers of a set, with its options, the
+ * number of results of a count, and its profile if it is explained, or
+ * NULL.
+ */
+typedef struct query_search {
+    query_node_t *query;
+    search_options_t *options;
+    long count;
+    search_profile_t *profile;
+} query_search_t;
+
+/*
+ * Gets the time of a monotonic clock, in milliseconds.
+ */
+static double get_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec * 1000 + (double) time.tv_nsec / 1000000;
+}
+
+/*
+ * Starts profiling the search of a single indexer of the set, if the search
+ * is being explained, given the profile of the search, the indexer, and the
+ * indexer that is actually searched, which is its trigram index for pattern
+ * searches. Returns the indexer's profile, or NULL.
+ */
+static indexer_profile_t *start_indexer_profile(search_profile_t *profile, indexer_t *indexer,
+        indexer_t *searched) {
+    if (profile == NULL) {
+        return NULL;
+    }
+    int i = 0;
+    while (profile->index_set->indexers[i] != indexer) {
+        i++;
+    }
+    indexer_profile_t *indexer_profile = &profile->indexers[i];
+    if (searched->directory != NULL) {
+        get_directory_stats(searched, &indexer_profile->cache);
+    }
+    indexer_profile->start = get_milliseconds();
+    return indexer_profile;
+}
+
+/*
+ * Marks the end of planning, if the search is being explained.
+ */
+static void mark_indexer_planned(indexer_profile_t *profile) {
+    if (profile != NULL) {
+        profile->plan_time = get_milliseconds() - profile->start;
+    }
+}
+
+/*
+ * Finishes the search of a single indexer, given its profile (or NULL), the
+ * indexer that was searched, and the plan, which is kept in the profile if
+ * the search is being explained, and freed otherwise.
+ */
+static void finish_indexer_profile(indexer_profile_t *profile, indexer_t *indexer, query_node_t *plan) {
+    if (profile == NULL) {
+        if (plan != NULL) {
+            destroy_query_node(plan);
+        }
+        return;
+    }
+    profile->evaluate_time = get_milliseconds() - profile->start - profile->plan_time;
+    profile->plan = plan;
+    if (indexer->directory != NULL) {
+        directory_stats_t stats;
+        get_directory_stats(indexer, &stats);
+        profile->cache.hits = stats.hits - profile->cache.hits;
+        profile->cache.misses = stats.misses - profile->cache.misses;
+        profile->cache.decoded_bytes = stats.decoded_bytes - profile->cache.decoded_bytes;
+    }
+}
+
+/*
+ * Plans and evaluates a search over a single indexer. The query is planned
+ * separately for every indexer, since document frequencies differ per shard.
+ * With a limit, only the documents up to the end of the requested page are
+ * evaluated.
+ */
+static postings_t *evaluate_search(indexer_t *indexer, query_search_t *search) {
+    indexer_profile_t *profile = start_indexer_profile(search->profile, indexer, indexer);
+    query_node_t *plan = plan_query(indexer, search->query);
+    mark_indexer_planned(profile);
+    postings_t *postings;
+    if (search->options->limit >= 0) {
+        postings = evaluate_query_top(indexer, plan, search->options->offset + search->options->limit);
+    } else {
+        postings = evaluate_query(indexer, plan);
+    }
+    expand_postings(postings);
+    finish_indexer_profile(profile, indexer, plan);
+    return postings;
+}
+
+/*
+ * Handles a search over a single indexer of a set, adding the paths of its
+ * results to the indexer's result list.
+ */
+static void handle_query_search(indexer_t *indexer, void *argument, list_t *results) {
+    query_search_t *search = argument;
+    postings_t *postings = evaluate_search(indexer, search);
+    /* results are kept in descending order, so the ascending postings are
+     * put in front of each other, rather than each walking the list */
+    int i;
+    for (i = 0; i < postings->size; i++) {
+        char *file_path = strdup(get_pooled_string(indexer->documents, postings->ids[i]));
+        results->head = create_list_element(file_path, results->head);
+    }
+    destroy_postings(postings);
+}
+
+/*
+ * Handles a count over a single indexer of a set whose indexers never share
+ * documents, such as the shards of an index, so their counts add up.
+ */
+static void handle_count_search(indexer_t *indexer, void *argument, list_t *results) {
+    query_search_t *search = argument;
+    indexer_profile_t *profile = start_indexer_profile(search->profile, indexer, indexer);
+    query_node_t *plan = plan_query(indexer, search->query);
+    mark_indexer_planned(profile);
+    __atomic_add_fetch(&search->count, count_query(indexer, plan), __ATOMIC_RELAXED);
+    finish_indexer_profile(profile, indexer, plan);
+}
+
+/*
+ * A search of the documents with a line that matches a regular expression,
+ * with the trigram query of the expression (NULL if every document has to
+ * be checked), the options of the search, and its profile if it is
+ * explained, or NULL.
+ */
+typedef struct pattern_search {
+    regex_t regex;
+    query_node_t *query;
+    search_options_t *options;
+    search_profile_t *profile;
+} pattern_search_t;
+
+/*
+ * Checks whether a file has a line that matches a regular expression.
+ */
+static bool match_file(regex_t *regex, char *file_path) {
+    char *file_data = read_file(file_path);
+    if (file_data == NULL) {
+        return false;
+    }
+    /* the newline that ends the last line doesn't start another one */
+    size_t size = strlen(file_data);
+    if (size > 0 && file_data[size - 1] == '\n') {
+        file_data[size - 1] = '\0';
+    }
+    bool match = regexec(regex, file_data, 0, NULL, 0) == 0;
+    free(file_data);
+    return match;
+}
+
+/*
+ * Handles a pattern search over a single indexer of a set. The documents
+ * the trigram query matches are only candidates, so each of them is read
+ * and checked against the expression, from the highest id down, until the
+ * requested page is full. An index without a trigram index has all of its
+ * documents checked.
+ */
+static void handle_pattern_search(indexer_t *indexer, void *argument, list_t *results) {
+    pattern_search_t *search = argument;
+    indexer_t *trigrams = indexer->trigrams != NULL ? indexer->trigrams : indexer;
+    indexer_profile_t *profile = start_indexer_profile(search->profile, indexer, trigrams);
+    postings_t *candidates;
+    query_node_t *plan = NULL;
+    if (search->query != NULL && indexer->trigrams != NULL) {
+        plan = plan_query(trigrams, search->query);
+        mark_indexer_planned(profile);
+        candidates = evaluate_query(trigrams, plan);
+    } else {
+        mark_indexer_planned(profile);
+        candidates = create_all_postings(trigrams);
+    }
+    expand_postings(candidates);
+    search_options_t *options = search->options;
+    int wanted = options->limit >= 0 && !options->count ? options->offset + options->limit : -1;
+    int found = 0;
+    int i;
+    for (i = candidates->size - 1; i >= 0 && (wanted < 0 || found < wanted); i--) {
+        char *file_path = get_pooled_string(trigrams->documents, candidates->ids[i]);
+        if (match_file(&search->regex, file_path)) {
+            insert_object(results, strdup(file_path));
+            found++;
+        }
+    }
+    if (profile != NULL) {
+        profile->checked = candidates->size - 1 - i;
+        profile->matched = found;
+    }
+    destroy_postings(candidates);
+    finish_indexer_profile(profile, trigrams, plan);
+}
+
+/*
+ * Prints a search result, given the output stream, the path, and whether
+ * it is the first result.
+ */
+static void print_result(FILE *output, char *result, bool first) {
+    fprintf(output, first ? "[%s]" : ", [%s]", result);
+}
+
+/*
+ * Prints the given page of search results to the given output stream.
+ */
+static void print_results(FILE *output, list_t *results, search_options_t *options) {
+    list_iterator_t *results_iterator = create_iterator(results);
+    char *result = get_item(results_iterator);
+    int position = 0;
+    while (result != NULL && (options->limit < 0 || position < options->offset + options->limit)) {
+        if (position >= options->offset) {
+            print_result(output, result, position == options->offset);
+        }
+        position++;
+        result = next_item(results_iterator);
+    }
+    fprintf(output, "\n");
+    destroy_iterator(results_iterator);
+}
+
+static int compare_function(void *first_object, void *second_object) {
+    char *first = first_object;
+    char *second = second_object;
+    int result = strcmp(first, second);
+    return result == 0 ? 0 : (result > 0 ? 1 : -1);
+}
+
+static void destroy_function(void *object) {
+    free(object);
+}
+
+/*
+ * Sets the default options of a search: every result is listed.
+ */
+static void init_search_options(search_options_t *options) {
+    options->limit = -1;
+    options->offset = 0;
+    options->count = false;
+    options->ignore_case = false;
+}
+
+/*
+ * Runs a search over every indexer of a set and prints its results, or
+ * their number. An index of a single file needs no merging, so its results
+ * are printed as they are read off the postings, without collecting them.
+ * Separate indexes can list the same document, so they are counted by
+ * merging their results, which drops the duplicates.
+ */
+static void handle_search(index_set_t *index_set, query_node_t *query, search_options_t *options, FILE *output,
+        search_profile_t *profile) {
+    query_search_t search;
+    search.query = query;
+    search.options = options;
+    search.count = 0;
+    search.profile = profile;
+    list_t *results = create_list(&compare_function, &destroy_function);
+    double start = profile != NULL ? get_milliseconds() : 0;
+    double searched = start;
+    if (options->count && index_set->disjoint) {
+        search_index_set(index_set, &handle_count_search, &search, results);
+        searched = profile != NULL ? get_milliseconds() : 0;
+        fprintf(output, "%ld\n", search.count);
+    } else if (options->count) {
+        search_options_t all_options;
+        init_search_options(&all_options);
+        search.options = &all_options;
+        search_index_set(index_set, &handle_query_search, &search, results);
+        searched = profile != NULL ? get_milliseconds() : 0;
+        fprintf(output, "%d\n", get_size(results));
+    } else if (index_set->count == 1) {
+        indexer_t *indexer = index_set->indexers[0];
+        postings_t *postings = evaluate_search(indexer, &search);
+        searched = profile != NULL ? get_milliseconds() : 0;
+        int i;
+        for (i = postings->size - 1 - options->offset; i >= 0; i--) {
+            print_result(output, get_pooled_string(indexer->documents, postings->ids[i]), i == postings->size - 1 - options->offset);
+        }
+        fprintf(output, "\n");
+        destroy_postings(postings);
+    } else {
+        search_index_set(index_set, &handle_query_search, &search, results);
+        searched = profile != NULL ? get_milliseconds() : 0;
+        print_results(output, results, options);
+    }
+    destroy_list(results);
+    if (profile != NULL) {
+        profile->search_time = searched - start;
+        profile->output_time = get_milliseconds() - searched;
+    }
+}
+
+/*
+ * Parses the options of a search command, given the iterator over its
+ * tokens, the first token after the command, which is updated to the
+ * first token after the options, and whether the command is a pattern
+ * search. Returns the number of options, or -1 if an option is invalid.
+ */
+static int parse_search_options(list_iterator_t *token_iterator, char **token, search_options_t *options,
+        bool pattern) {
+    init_search_options(options);
+    int count = 0;
+    while (*token != NULL && (*token)[0] == '-') {
+        char *option = *token;
+        char *end = NULL;
+        if (strncmp(option, "-limit=", 7) == 0) {
+            options->limit = (int) strtol(option + 7, &end, 10);
+        } else if (strncmp(option, "-offset=", 8) == 0) {
+            options->offset = (int) strtol(option + 8, &end, 10);
+        } else if (strcmp(option, "-count") == 0) {
+            options->count = true;
+        } else if (pattern && strcmp(option, "-i") == 0) {
+            options->ignore_case = true;
+        } else {
+            return -1;
+        }
+        if (end != NULL && (*end != '\0' || end == strchr(option, '=') + 1
+                || options->limit < -1 || options->offset < 0)) {
+            return -1;
+        }
+        *token = next_item(token_iterator);
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Runs a search for the documents with a line that matches an extended
+ * regular expression, and prints them, or their number. Returns false and
+ * prints an error if the expression is invalid.
+ */
+static bool handle_pattern(index_set_t *index_set, char *pattern, search_options_t *options, FILE *output,
+        search_profile_t *profile) {
+    double start = profile != NULL ? get_milliseconds() : 0;
+    pattern_search_t search;
+    int flags = REG_EXTENDED | REG_NOSUB | REG_NEWLINE | (options->ignore_case ? REG_ICASE : 0);
+    int error = regcomp(&search.regex, pattern, flags);
+    if (error != 0) {
+        char message[256];
+        regerror(error, &search.regex, message, sizeof(message));
+        fprintf(stderr, "Error: Invalid pattern: %s.\n", message);
+        return false;
+    }
+    search.query = create_pattern_query(pattern);
+    search.options = options;
+    search.profile = profile;
+    list_t *results = create_list(&compare_function, &destroy_function);
+    double compiled = profile != NULL ? get_milliseconds() : 0;
+    search_index_set(index_set, &handle_pattern_search, &search, results);
+    double searched = profile != NULL ? get_milliseconds() : 0;
+    if (options->count) {
+        fprintf(output, "%d\n", get_size(results));
+    } else {
+        print_results(output, results, options);
+    }
+    destroy_list(results);
+    if (profile != NULL) {
+        /* compiling the expression is part of parsing the command */
+        profile->parse_time += compiled - start;
+        profile->search_time = searched - compiled;
+        profile->output_time = get_milliseconds() - searched;
+    }
+    if (search.query != NULL) {
+        destroy_query_node(search.query);
+    }
+    regfree(&search.regex);
+    return true;
+}
+
+/*
+ * Skips the given number of space separated words of the input.
+ */
+static char *skip_words(char *input, int count) {
+    while (count-- > 0) {
+        char *space = strchr(input, ' ');
+        input = space != NULL ? space + 1 : input + strlen(input);
+    }
+    return input;
+}
+
+/*
+ * Creates a query that combines the given token and every token after it
+ * with the given operator. Returns NULL if a token is an invalid fuzzy term.
+ */
+static query_node_t *create_token_query(list_iterator_t *token_iterator, char *token, query_node_type_t type) {
+    query_node_t *query = create_query_node(type, NULL);
+    while (token != NULL) {
+        query_node_t *term = create_term_node(token);
+        if (term == NULL) {
+            destroy_query_node(query);
+            return NULL;
+        }
+        add_query_child(query, term);
+        token = next_item(token_iterator);
+    }
+    return query;
+}
+
+/*
+ * Parses and runs a search command, profiling it if the given profile
+ * isn't NULL.
+ */
+static bool run_search_command(index_set_t *index_set, char *input, FILE *output, search_profile_t *profile) {
+    double start = profile != NULL ? get_milliseconds() : 0;
+    /* first, we split the input into words */
+    list_t *tokens = split_string(input, ' ', true);
+    list_iterator_t *token_iterator = create_iterator(tokens);
+    char *command = get_item(token_iterator);
+    char *token = next_item(token_iterator);
+
+    query_node_t *query = NULL;
+    search_options_t options;
+    bool success = true;
+    bool searched = false;
+    /* next, we check to see which command the user entered */
+    if (strcmp(command, "sa") == 0 || strcmp(command, "so") == 0) {
+        /* time to do an 'and' or an 'or' search, on every shard in parallel. it's
+         * planned and evaluated like the boolean query "t1 AND t2 AND ..." (or
+         * "t1 OR t2 OR ..."), so an 'and' intersects from the rarest term */
+        success = parse_search_options(token_iterator, &token, &options, false) >= 0;
+        if (success) {
+            query = create_token_query(token_iterator, token, strcmp(command, "sa") == 0 ? QUERY_AND : QUERY_OR);
+        }
+    } else if (strcmp(command, "sq") == 0) {
+        /* time to do a boolean query search, such as "a AND (b OR c) AND NOT d" */
+        int option_count = parse_search_options(token_iterator, &token, &options, false);
+        success = option_count >= 0;
+        if (success) {
+            query = parse_query(skip_words(input, option_count + 1));
+        }
+    } else if (strcmp(command, "sr") == 0 || strcmp(command, "ss") == 0) {
+        /* time to do a pattern search, for a regular expression or for a substring, which is the
+         * rest of the line. only the documents with every trigram it needs are checked */
+        int option_count = parse_search_options(token_iterator, &token, &options, true);
+        success = option_count >= 0;
+        char *text = skip_words(input, option_count + 1);
+        if (success && *text != '\0') {
+            char *pattern = strcmp(command, "ss") == 0 ? escape_pattern(text) : strdup(text);
+            if (profile != NULL) {
+                profile->parse_time = get_milliseconds() - start;
+            }
+            searched = handle_pattern(index_set, pattern, &options, output, profile);
+            free(pattern);
+        }
+    } else {
+        /* invalid command, we need to tell the user */
+        success = false;
+    }
+    if (profile != NULL && !searched) {
+        profile->parse_time = get_milliseconds() - start;
+    }
+    if (query != NULL) {
+        handle_search(index_set, query, &options, output, profile);
+        destroy_query_node(query);
+    } else if (!searched) {
+        /* there's nothing to search for, so there are no results */
+        fprintf(output, "\n");
+    }
+
+    destroy_iterator(token_iterator);
+    destroy_list(tokens);
+    return success;
+}
+
+/*
+ * Gets the name of the type of a planned query node.
+ */
+static const char *get_node_name(query_node_t *node) {
+    switch (node->type) {
+        case QUERY_AND:
+            return "and";
+        case QUERY_OR:
+            return "or";
+        case QUERY_NOT:
+            return "not";
+        default:
+            return "term";
+    }
+}
+
+/*
+ * Prints a node of an evaluated plan, and its operands below it, indented
+ * by its depth. Terms show their document frequency and how many documents
+ * their postings held, operators the number of documents the planner
+ * estimated they'd match. The operands of an 'and' show how many
+ * candidates were left before and after them, and other nodes how many
+ * documents they matched.
+ */
+static void print_plan(FILE *output, query_node_t *node, int depth, long candidates) {
+    fprintf(output, "# %*s%s", 2 * depth, "", get_node_name(node));
+    if (node->type == QUERY_TERM) {
+        fprintf(output, " '%s': frequency %ld", node->term, node->cost);
+    } else {
+        fprintf(output, ": estimated %ld", node->cost);
+    }
+    if (node->scanned < 0) {
+        fprintf(output, ", skipped\n");
+        return;
+    }
+    if (node->type == QUERY_TERM) {
+        fprintf(output, ", scanned %ld", node->scanned);
+    }
+    if (candidates >= 0) {
+        fprintf(output, ", candidates %ld -> %ld\n", candidates, node->remaining);
+    } else {
+        fprintf(output, ", matched %ld\n", node->remaining);
+    }
+    long remaining = -1;
+    int i;
+    for (i = 0; i < node->child_count; i++) {
+        query_node_t *child = node->children[i];
+        if (node->type == QUERY_AND) {
+            print_plan(output, child, depth + 1, remaining);
+            remaining = child->remaining;
+        } else {
+            print_plan(output, child, depth + 1, -1);
+        }
+    }
+}
+
+/*
+ * Prints the profile of an explained search, one line per fact, each
+ * starting with '#', so the report can be told apart from the results.
+ */
+static void print_profile(FILE *output, search_profile_t *profile, bool pattern) {
+    fprintf(output, "# parse: %.3f ms\n", profile->parse_time);
+    int i;
+    for (i = 0; i < profile->index_set->count; i++) {
+        indexer_t *indexer = profile->index_set->indexers[i];
+        indexer_profile_t *indexer_profile = &profile->indexers[i];
+        fprintf(output, "# index %d of %d: %d documents, %s, plan %.3f ms, evaluate %.3f ms\n", i + 1,
+                profile->index_set->count, indexer->documents->count,
+                indexer->directory != NULL ? "loaded on demand" : (indexer->packed != NULL ? "packed" : "in memory"),
+                indexer_profile->plan_time, indexer_profile->evaluate_time);
+        indexer_t *searched = pattern && indexer->trigrams != NULL ? indexer->trigrams : indexer;
+        if (searched->directory != NULL) {
+            fprintf(output, "#   cache: %ld hits, %ld misses, %ld bytes decoded\n", indexer_profile->cache.hits,
+                    indexer_profile->cache.misses, indexer_profile->cache.decoded_bytes);
+        }
+        if (pattern) {
+            fprintf(output, "#   %s, %ld candidates checked, %ld matched\n",
+                    indexer->trigrams != NULL ? "trigram index" : "no trigram index",
+                    indexer_profile->checked, indexer_profile->matched);
+        }
+        if (indexer_profile->plan != NULL) {
+            print_plan(output, indexer_profile->plan, 1, -1);
+        }
+    }
+    fprintf(output, "# search: %.3f ms\n", profile->search_time);
+    fprintf(output, "# output: %.3f ms\n", profile->output_time);
+}
+
+/*
+ * Runs a search command and explains it: the report is printed first, then
+ * the results line, which the report's lines are told apart from.
+ */
+static bool explain_search_command(index_set_t *index_set, char *input, FILE *output) {
+    search_profile_t profile;
+    memset(&profile, 0, sizeof(search_profile_t));
+    profile.index_set = index_set;
+    profile.indexers = calloc(index_set->count, sizeof(indexer_profile_t));
+    /* the results are held back until the report is printed */
+    char *results = NULL;
+    size_t size = 0;
+    FILE *results_output = open_memstream(&results, &size);
+    if (results_output == NULL) {
+        free(profile.indexers);
+        return run_search_command(index_set, input, output, NULL);
+    }
+    double start = get_milliseconds();
+    bool success = run_search_command(index_set, input, results_output, &profile);
+    double total_time = get_milliseconds() - start;
+    fclose(results_output);
+    /* there's nothing to explain about a command that is invalid */
+    if (success) {
+        print_profile(output, &profile, strncmp(input, "sr ", 3) == 0 || strncmp(input, "ss ", 3) == 0);
+        fprintf(output, "# total: %.3f ms\n", total_time);
+    }
+    fputs(results, output);
+    free(results);
+    int i;
+    for (i = 0; i < index_set->count; i++) {
+        if (profile.indexers[i].plan != NULL) {
+            destroy_query_node(profile.indexers[i].plan);
+        }
+    }
+    free(profile.indexers);
+    return success;
+}
+
+/*
+ * Parses and handles a search command, explaining it if it starts with
+ * "explain".
+ */
+bool handle_search_command(index_set_t *index_set, char *input, FILE *output) {
+    if (strncmp(input, "explain ", 8) == 0) {
+        return explain_search_command(index_set, input + 8, output);
+    }
+    return run_search_command(index_set, input, output, NULL);
+}
@@ -0,0 +1,26 @@
+#ifndef _SEARCH_COMMAND_H_
+#define _SEARCH_COMMAND_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "index_set.h"
+
+/*
+ * Parses and handles a search command, given the set of indexers to search,
+ * the command line, and the stream to print the results to. The commands
+ * are "sa" and "so" (an 'and' or an 'or' of the terms that follow), "sq" (a
+ * boolean query), and "sr" and "ss" (the documents with a line matching a
+ * regular expression, or containing a substring). Their options come
+ * before their terms: "-limit=<n>" and "-offset=<n>" page through the
+ * results, "-count" only counts them, and "-i" makes a pattern search ignore
+ * case. Exactly one line is printed for every command. A command prefixed
+ * with "explain" is profiled: its line is preceded by a report whose lines
+ * start with '#', giving the time spent parsing, searching and printing,
+ * and for every indexer its evaluated plan (how many documents each term's
+ * postings held, and how many candidates each operand of an 'and' left),
+ * the time spent planning and evaluating, and its cache hits, misses and
+ * decoded bytes. Returns false if the command is invalid.
+ */
+bool handle_search_command(index_set_t *, char *, FILE *);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "string_pool.h"
+
+/*
+ * Creates an empty string pool.
+ */
+string_pool_t *create_string_pool() {
+    string_pool_t *pool = malloc(sizeof(string_pool_t));
+    pool->data = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+    pool->offsets = NULL;
+    pool->count = 0;
+    pool->offset_capacity = 0;
+    return pool;
+}
+
+/*
+ * Destroys a string pool.
+ */
+void destroy_string_pool(string_pool_t *pool) {
+    free(pool->data);
+    free(pool->offsets);
+    free(pool);
+}
+
+/*
+ * Adds a copy of a string to the end of a pool, growing the buffer and the
+ * offsets by doubling.
+ */
+int add_pooled_string(string_pool_t *pool, const char *string) {
+    size_t length = strlen(string) + 1;
+    if ((size_t) pool->size + length > UINT32_MAX) {
+        /* offsets are 32 bits, so a pool can't hold more than 4 GiB */
+        fprintf(stderr, "Error: Too many strings to pool.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pool->size + length > pool->capacity) {
+        size_t capacity = pool->capacity == 0 ? 4096 : (size_t) pool->capacity * 2;
+        while (capacity < pool->size + length) {
+            capacity *= 2;
+        }
+        pool->capacity = capacity > UINT32_MAX ? UINT32_MAX : (uint32_t) capacity;
+        pool->data = realloc(pool->data, pool->capacity);
+    }
+    if (pool->count == pool->offset_capacity) {
+        pool->offset_capacity = pool->offset_capacity == 0 ? 64 : pool->offset_capacity * 2;
+        pool->offsets = realloc(pool->offsets, pool->offset_capacity * sizeof(uint32_t));
+    }
+    memcpy(pool->data + pool->size, string, length);
+    pool->offsets[pool->count] = pool->size;
+    pool->size += (uint32_t) length;
+    return pool->count++;
+}
+
+/*
+ * Inserts a copy of a string into a pool. The string itself goes at the end
+ * of the buffer like any other, and only its offset is moved into place.
+ */
+int insert_pooled_string(string_pool_t *pool, int position, const char *string) {
+    int last = add_pooled_string(pool, string);
+    uint32_t offset = pool->offsets[last];
+    memmove(pool->offsets + position + 1, pool->offsets + position, (last - position) * sizeof(uint32_t));
+    pool->offsets[position] = offset;
+    return position;
+}
+
+/*
+ * Removes a string from a pool.
+ */
+void remove_pooled_string(string_pool_t *pool, int position) {
+    pool->count--;
+    memmove(pool->offsets + position, pool->offsets + position + 1, (pool->count - position) * sizeof(uint32_t));
+}
+
+/*
+ * Gets a string of a pool.
+ */
+char *get_pooled_string(string_pool_t *pool, int position) {
+    return pool->data + pool->offsets[position];
+}
+
+/*
+ * Gives back the unused capacity of a pool.
+ */
+void trim_string_pool(string_pool_t *pool) {
+    if (pool->count == 0) {
+        return;
+    }
+    pool->data = realloc(pool->data, pool->size);
+    pool->capacity = pool->size;
+    pool->offsets = realloc(pool->offsets, pool->count * sizeof(uint32_t));
+    pool->offset_capacity = pool->count;
+}
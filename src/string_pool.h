@@ -0,0 +1,63 @@
+#ifndef _STRING_POOL_H_
+#define _STRING_POOL_H_
+
+#include <stdint.h>
+
+/*
+ * A table of strings kept back to back in one buffer, each found by its
+ * 32-bit offset into the buffer, so a string costs its bytes plus four
+ * instead of its own allocation and a pointer to it.
+ */
+typedef struct string_pool {
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t *offsets;
+    int count;
+    int offset_capacity;
+} string_pool_t;
+
+/*
+ * Creates an empty string pool. The caller is responsible for freeing the
+ * allocated memory.
+ */
+string_pool_t *create_string_pool();
+
+/*
+ * Destroys a string pool, along with its strings.
+ */
+void destroy_string_pool(string_pool_t *);
+
+/*
+ * Adds a copy of a string to the end of a pool, given the pool and the
+ * string. Returns the position of the string in the pool.
+ */
+int add_pooled_string(string_pool_t *, const char *);
+
+/*
+ * Inserts a copy of a string into a pool at the given position, moving the
+ * strings from that position on up by one. Returns the position.
+ */
+int insert_pooled_string(string_pool_t *, int, const char *);
+
+/*
+ * Removes a string from a pool, given the pool and the position of the
+ * string, moving the strings after it down by one. Its bytes are only
+ * given back when the pool is destroyed.
+ */
+void remove_pooled_string(string_pool_t *, int);
+
+/*
+ * Gets a string of a pool, given the pool and the position of the string.
+ * The string stays valid until the pool is destroyed, or until another
+ * string is added.
+ */
+char *get_pooled_string(string_pool_t *, int);
+
+/*
+ * Gives back the unused capacity of a pool, once no more strings will be
+ * added to it.
+ */
+void trim_string_pool(string_pool_t *);
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "term_dictionary.h"
+#include "term_hash.h"
+
+/*
+ * The number of terms in a block. Larger blocks share more prefixes but
+ * make every lookup scan further.
+ */
+#ifndef DICTIONARY_BLOCK_SIZE
+#define DICTIONARY_BLOCK_SIZE 16
+#endif
+
+struct term_dictionary {
+    /* the encoded blocks, back to back */
+    unsigned char *data;
+    size_t size;
+    /* the offset of every block, whose first term is stored whole */
+    uint32_t *blocks;
+    int block_count;
+    int count;
+    size_t max_length;
+    /* the hash terms are found with, if it has one */
+    term_hash_t *hash;
+};
+
+/*
+ * Appends a number to a buffer as a variable length integer, seven bits
+ * per byte. Returns the new end of the buffer.
+ */
+static unsigned char *write_varint(unsigned char *position, size_t value) {
+    while (value >= 0x80) {
+        *position++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *position++ = (unsigned char) value;
+    return position;
+}
+
+/*
+ * Reads a variable length integer. Returns the position after it.
+ */
+static const unsigned char *read_varint(const unsigned char *position, size_t *value) {
+    *value = 0;
+    int shift = 0;
+    while (*position & 0x80) {
+        *value |= (size_t) (*position++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *value |= (size_t) *position++ << shift;
+    return position;
+}
+
+/*
+ * Decodes the term that follows the given term of a block into the same
+ * buffer. Returns the position of the term after it.
+ */
+static const unsigned char *decode_term(const unsigned char *position, char *term) {
+    size_t prefix;
+    size_t suffix;
+    position = read_varint(position, &prefix);
+    position = read_varint(position, &suffix);
+    memcpy(term + prefix, position, suffix);
+    term[prefix + suffix] = '\0';
+    return position + suffix;
+}
+
+/*
+ * Creates a dictionary, given the sorted terms and their number.
+ */
+term_dictionary_t *create_term_dictionary(char **terms, int count) {
+    term_dictionary_t *dictionary = malloc(sizeof(term_dictionary_t));
+    dictionary->count = count;
+    dictionary->block_count = (count + DICTIONARY_BLOCK_SIZE - 1) / DICTIONARY_BLOCK_SIZE;
+    dictionary->blocks = malloc((dictionary->block_count > 0 ? dictionary->block_count : 1) * sizeof(uint32_t));
+    dictionary->max_length = 0;
+    dictionary->hash = NULL;
+    size_t capacity = 4096;
+    dictionary->data = malloc(capacity);
+    dictionary->size = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        size_t length = strlen(terms[i]);
+        if (length > dictionary->max_length) {
+            dictionary->max_length = length;
+        }
+        /* a term never takes more than its bytes, a terminator and two varints */
+        while (dictionary->size + length + 21 > capacity) {
+            capacity *= 2;
+            dictionary->data = realloc(dictionary->data, capacity);
+        }
+        unsigned char *position = dictionary->data + dictionary->size;
+        if (i % DICTIONARY_BLOCK_SIZE == 0) {
+            dictionary->blocks[i / DICTIONARY_BLOCK_SIZE] = (uint32_t) dictionary->size;
+            memcpy(position, terms[i], length + 1);
+            position += length + 1;
+        } else {
+            size_t prefix = 0;
+            while (prefix < length && terms[i - 1][prefix] == terms[i][prefix]) {
+                prefix++;
+            }
+            position = write_varint(position, prefix);
+            position = write_varint(position, length - prefix);
+            memcpy(position, terms[i] + prefix, length - prefix);
+            position += length - prefix;
+        }
+        dictionary->size = (size_t) (position - dictionary->data);
+    }
+    dictionary->data = realloc(dictionary->data, dictionary->size > 0 ? dictionary->size : 1);
+    return dictionary;
+}
+
+/*
+ * Destroys a dictionary.
+ */
+void destroy_term_dictionary(term_dictionary_t *dictionary) {
+    if (dictionary->hash != NULL) {
+        destroy_term_hash(dictionary->hash);
+    }
+    free(dictionary->data);
+    free(dictionary->blocks);
+    free(dictionary);
+}
+
+/*
+ * Finds the first term that isn't less than a token: the block it would be
+ * in is the last one whose first term isn't greater than the token, and the
+ * block is decoded until the token is reached or passed. Sets the given
+ * flag to whether the term found is the token itself.
+ */
+static int search_dictionary(term_dictionary_t *dictionary, const char *token, bool *found) {
+    *found = false;
+    int low = 0;
+    int high = dictionary->block_count - 1;
+    int block = -1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int comparison = strcmp((const char *) dictionary->data + dictionary->blocks[middle], token);
+        if (comparison == 0) {
+            *found = true;
+            return middle * DICTIONARY_BLOCK_SIZE;
+        } else if (comparison < 0) {
+            block = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (block < 0) {
+        return 0;
+    }
+    char buffer[256];
+    char *term = dictionary->max_length < sizeof(buffer) ? buffer : malloc(dictionary->max_length + 1);
+    const unsigned char *position = dictionary->data + dictionary->blocks[block];
+    size_t length = strlen((const char *) position);
+    memcpy(term, position, length + 1);
+    position += length + 1;
+    int id = block * DICTIONARY_BLOCK_SIZE + 1;
+    int last = id - 1 + DICTIONARY_BLOCK_SIZE;
+    if (last > dictionary->count) {
+        last = dictionary->count;
+    }
+    for (; id < last; id++) {
+        position = decode_term(position, term);
+        int comparison = strcmp(term, token);
+        if (comparison >= 0) {
+            *found = comparison == 0;
+            break;
+        }
+    }
+    if (term != buffer) {
+        free(term);
+    }
+    return id;
+}
+
+/*
+ * Sets the hash of a dictionary.
+ */
+void set_dictionary_hash(term_dictionary_t *dictionary, term_hash_t *hash) {
+    if (dictionary->hash != NULL) {
+        destroy_term_hash(dictionary->hash);
+    }
+    dictionary->hash = hash;
+}
+
+/*
+ * Tells whether a term of a dictionary is the given token, decoding its
+ * block only as far as the term.
+ */
+static bool is_dictionary_term(term_dictionary_t *dictionary, int id, const char *token) {
+    const unsigned char *position = dictionary->data + dictionary->blocks[id / DICTIONARY_BLOCK_SIZE];
+    if (id % DICTIONARY_BLOCK_SIZE == 0) {
+        return strcmp((const char *) position, token) == 0;
+    }
+    char buffer[256];
+    char *term = dictionary->max_length < sizeof(buffer) ? buffer : malloc(dictionary->max_length + 1);
+    size_t length = strlen((const char *) position);
+    memcpy(term, position, length + 1);
+    position += length + 1;
+    int i;
+    for (i = 0; i < id % DICTIONARY_BLOCK_SIZE; i++) {
+        position = decode_term(position, term);
+    }
+    bool equal = strcmp(term, token) == 0;
+    if (term != buffer) {
+        free(term);
+    }
+    return equal;
+}
+
+/*
+ * Gets the id of a term. With a hash, the hash names the only term the
+ * token can be, so a single term is compared instead of searching.
+ */
+int find_dictionary_term(term_dictionary_t *dictionary, const char *token) {
+    if (dictionary->hash != NULL) {
+        int id = find_term_hash(dictionary->hash, token);
+        return id >= 0 && is_dictionary_term(dictionary, id, token) ? id : -1;
+    }
+    bool found;
+    int id = search_dictionary(dictionary, token, &found);
+    return found ? id : -1;
+}
+
+/*
+ * Gets the id of the first term that isn't less than a string.
+ */
+int seek_dictionary_term(term_dictionary_t *dictionary, const char *token) {
+    bool found;
+    return search_dictionary(dictionary, token, &found);
+}
+
+/*
+ * Gets the number of terms in a dictionary.
+ */
+int get_dictionary_size(term_dictionary_t *dictionary) {
+    return dictionary->count;
+}
+
+/*
+ * Gets the length of the longest term of a dictionary.
+ */
+size_t get_dictionary_max_length(term_dictionary_t *dictionary) {
+    return dictionary->max_length;
+}
+
+/*
+ * Decodes a term of a dictionary, starting from the first term of its block.
+ */
+void get_dictionary_term(term_dictionary_t *dictionary, int id, char *term) {
+    const unsigned char *position = dictionary->data + dictionary->blocks[id / DICTIONARY_BLOCK_SIZE];
+    size_t length = strlen((const char *) position);
+    memcpy(term, position, length + 1);
+    position += length + 1;
+    int i;
+    for (i = 0; i < id % DICTIONARY_BLOCK_SIZE; i++) {
+        position = decode_term(position, term);
+    }
+}
+
+/*
+ * Gets the number of bytes a dictionary takes up.
+ */
+size_t get_dictionary_memory_size(term_dictionary_t *dictionary) {
+    size_t size = sizeof(term_dictionary_t) + dictionary->size + dictionary->block_count * sizeof(uint32_t);
+    return dictionary->hash != NULL ? size + get_term_hash_memory_size(dictionary->hash) : size;
+}
@@ -0,0 +1,74 @@
+#ifndef _TERM_DICTIONARY_H_
+#define _TERM_DICTIONARY_H_
+
+#include <stddef.h>
+#include "term_hash.h"
+
+/*
+ * A read-only dictionary of sorted terms, front coded: the terms are split
+ * into blocks of a few terms each, the first term of a block is stored
+ * whole and every other term as the length of the prefix it shares with
+ * the term before it plus the rest of its bytes. The first terms double as
+ * a sampled index, so a term is found by a binary search over the blocks
+ * and a scan of a single block. A term's position in the sorted order is
+ * its id.
+ */
+typedef struct term_dictionary term_dictionary_t;
+
+/*
+ * Creates a dictionary, given the terms, which must be distinct and in
+ * ascending order, and their number. The terms are copied. The caller is
+ * responsible for freeing the dictionary using destroy_term_dictionary.
+ */
+term_dictionary_t *create_term_dictionary(char **, int);
+
+/*
+ * Destroys a dictionary.
+ */
+void destroy_term_dictionary(term_dictionary_t *);
+
+/*
+ * Sets the hash a dictionary finds terms with, given the dictionary and a
+ * hash built over its terms in id order (see term_hash.h), or NULL to go
+ * back to searching the blocks. The dictionary takes ownership of the
+ * hash.
+ */
+void set_dictionary_hash(term_dictionary_t *, term_hash_t *);
+
+/*
+ * Gets the id of a term, given the dictionary and the term. Returns -1 if
+ * the term is not in the dictionary.
+ */
+int find_dictionary_term(term_dictionary_t *, const char *);
+
+/*
+ * Gets the id of the first term of a dictionary that isn't less than the
+ * given string, given the dictionary and the string, so a sorted walk over
+ * the terms can skip ahead. Returns the number of terms if every term is
+ * less than the string.
+ */
+int seek_dictionary_term(term_dictionary_t *, const char *);
+
+/*
+ * Gets the number of terms in a dictionary.
+ */
+int get_dictionary_size(term_dictionary_t *);
+
+/*
+ * Gets the length of the longest term of a dictionary, so callers know how
+ * large a buffer get_dictionary_term needs.
+ */
+size_t get_dictionary_max_length(term_dictionary_t *);
+
+/*
+ * Decodes a term of a dictionary, given the dictionary, the id of the term
+ * and a buffer of at least the longest term's length plus one.
+ */
+void get_dictionary_term(term_dictionary_t *, int, char *);
+
+/*
+ * Gets the number of bytes a dictionary takes up.
+ */
+size_t get_dictionary_memory_size(term_dictionary_t *);
+
+#endif
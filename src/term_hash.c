@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include "term_hash.h"
+#include "hash.h"
+
+/*
+ * The average number of terms in a bucket. Larger buckets take fewer
+ * pilots but make a pilot take longer to find.
+ */
+#define TERM_HASH_BUCKET_SIZE 3
+
+/*
+ * The number of seeds tried before giving up on building a hash.
+ */
+#define TERM_HASH_ATTEMPTS 4
+
+/*
+ * Mixes the bits of a hash, so every bit of the result depends on every
+ * bit of the input (the finalizer of SplitMix64).
+ */
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+/*
+ * Hashes a term with the seed of a hash. The high half of the key picks
+ * the term's bucket and the low half is its fingerprint.
+ */
+static uint64_t get_key(term_hash_t *hash, const char *term) {
+    return mix(hash_string(term) ^ hash->seed);
+}
+
+/*
+ * Maps the high half of a number onto a range, without a division.
+ */
+static uint32_t reduce(uint64_t value, int range) {
+    return (uint32_t) (((value >> 32) * (uint64_t) range) >> 32);
+}
+
+/*
+ * Gets the slot a key lands in with the given pilot.
+ */
+static uint32_t get_slot(term_hash_t *hash, uint64_t key, uint32_t pilot) {
+    return reduce(mix(key ^ mix((uint64_t) pilot ^ hash->seed)), hash->count);
+}
+
+/*
+ * Creates a hash to be loaded.
+ */
+term_hash_t *create_empty_term_hash(int count, int bucket_count, uint64_t seed) {
+    term_hash_t *hash = malloc(sizeof(term_hash_t));
+    hash->seed = seed;
+    hash->count = count;
+    hash->bucket_count = bucket_count;
+    hash->pilots = calloc(bucket_count > 0 ? bucket_count : 1, sizeof(uint32_t));
+    hash->slots = calloc(count > 0 ? count : 1, sizeof(term_slot_t));
+    return hash;
+}
+
+/*
+ * Finds a pilot for every bucket, given the keys of the terms, in id
+ * order. The buckets with the most terms go first, while most slots are
+ * still free, and every bucket takes the first pilot that puts its terms
+ * in free slots. Returns false if a bucket has two equal keys, which no
+ * pilot can tell apart.
+ */
+static bool place_buckets(term_hash_t *hash, uint64_t *keys) {
+    /* first we group the terms by bucket */
+    int *starts = calloc(hash->bucket_count + 1, sizeof(int));
+    int *members = malloc((hash->count > 0 ? hash->count : 1) * sizeof(int));
+    int i;
+    for (i = 0; i < hash->count; i++) {
+        starts[reduce(keys[i], hash->bucket_count) + 1]++;
+    }
+    int largest = 0;
+    for (i = 0; i < hash->bucket_count; i++) {
+        if (starts[i + 1] > largest) {
+            largest = starts[i + 1];
+        }
+        starts[i + 1] += starts[i];
+    }
+    int *positions = malloc(hash->bucket_count * sizeof(int));
+    memcpy(positions, starts, hash->bucket_count * sizeof(int));
+    for (i = 0; i < hash->count; i++) {
+        members[positions[reduce(keys[i], hash->bucket_count)]++] = i;
+    }
+
+    /* next, we order the buckets from the largest to the smallest */
+    int *size_starts = calloc(largest + 2, sizeof(int));
+    for (i = 0; i < hash->bucket_count; i++) {
+        size_starts[largest - (starts[i + 1] - starts[i]) + 1]++;
+    }
+    int size;
+    for (size = 0; size <= largest; size++) {
+        size_starts[size + 1] += size_starts[size];
+    }
+    int *order = malloc(hash->bucket_count * sizeof(int));
+    for (i = 0; i < hash->bucket_count; i++) {
+        order[size_starts[largest - (starts[i + 1] - starts[i])]++] = i;
+    }
+
+    /* a string lands in its last free slot once in count tries on average,
+     * so this many tries practically always find one */
+    uint64_t max_tries = (uint64_t) hash->count * 64 + 1024;
+    if (max_tries > UINT32_MAX) {
+        max_tries = UINT32_MAX;
+    }
+    bool *taken = calloc(hash->count > 0 ? hash->count : 1, sizeof(bool));
+    uint32_t *bucket_slots = malloc((largest > 0 ? largest : 1) * sizeof(uint32_t));
+    bool success = true;
+    for (i = 0; i < hash->bucket_count && success; i++) {
+        int bucket = order[i];
+        int *first = members + starts[bucket];
+        int bucket_size = starts[bucket + 1] - starts[bucket];
+        if (bucket_size == 0) {
+            break;
+        }
+        int j;
+        int k;
+        for (j = 0; j < bucket_size && success; j++) {
+            for (k = 0; k < j; k++) {
+                if (keys[first[j]] == keys[first[k]]) {
+                    success = false;
+                }
+            }
+        }
+        uint64_t pilot;
+        for (pilot = 0; success; pilot++) {
+            if (pilot == max_tries) {
+                success = false;
+                break;
+            }
+            /* we take slots as we go, so terms of the bucket can't share one */
+            for (j = 0; j < bucket_size; j++) {
+                uint32_t slot = get_slot(hash, keys[first[j]], (uint32_t) pilot);
+                if (taken[slot]) {
+                    break;
+                }
+                taken[slot] = true;
+                bucket_slots[j] = slot;
+            }
+            if (j == bucket_size) {
+                break;
+            }
+            for (k = 0; k < j; k++) {
+                taken[bucket_slots[k]] = false;
+            }
+        }
+        if (success) {
+            hash->pilots[bucket] = (uint32_t) pilot;
+            for (j = 0; j < bucket_size; j++) {
+                hash->slots[bucket_slots[j]].id = (uint32_t) first[j];
+                hash->slots[bucket_slots[j]].fingerprint = (uint32_t) keys[first[j]];
+            }
+        }
+    }
+    free(starts);
+    free(members);
+    free(positions);
+    free(size_starts);
+    free(order);
+    free(taken);
+    free(bucket_slots);
+    return success;
+}
+
+/*
+ * Builds a hash, trying a few seeds in turn, so the same terms always get
+ * the same hash.
+ */
+term_hash_t *create_term_hash(char **terms, int count) {
+    uint64_t *keys = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    int attempt;
+    for (attempt = 0; attempt < TERM_HASH_ATTEMPTS; attempt++) {
+        term_hash_t *hash = create_empty_term_hash(count, count / TERM_HASH_BUCKET_SIZE + 1,
+                mix((uint64_t) attempt + 1));
+        int i;
+        for (i = 0; i < count; i++) {
+            keys[i] = get_key(hash, terms[i]);
+        }
+        if (place_buckets(hash, keys)) {
+            free(keys);
+            return hash;
+        }
+        destroy_term_hash(hash);
+    }
+    free(keys);
+    return NULL;
+}
+
+/*
+ * Fills in the term ids of a loaded hash. Every slot must be taken by
+ * exactly one term, with the fingerprint the slot was saved with.
+ */
+bool link_term_hash(term_hash_t *hash, char **terms, int count) {
+    if (count != hash->count) {
+        return false;
+    }
+    bool *taken = calloc(count > 0 ? count : 1, sizeof(bool));
+    bool success = true;
+    int i;
+    for (i = 0; i < count && success; i++) {
+        uint64_t key = get_key(hash, terms[i]);
+        uint32_t slot = get_slot(hash, key, hash->pilots[reduce(key, hash->bucket_count)]);
+        if (taken[slot] || hash->slots[slot].fingerprint != (uint32_t) key) {
+            success = false;
+        } else {
+            taken[slot] = true;
+            hash->slots[slot].id = (uint32_t) i;
+        }
+    }
+    free(taken);
+    return success;
+}
+
+/*
+ * Gets the id of the only term a string can be: the pilot of its bucket
+ * gives its slot, and the slot's fingerprint has to match.
+ */
+int find_term_hash(term_hash_t *hash, const char *string) {
+    if (hash->count == 0) {
+        return -1;
+    }
+    uint64_t key = get_key(hash, string);
+    term_slot_t *slot = &hash->slots[get_slot(hash, key, hash->pilots[reduce(key, hash->bucket_count)])];
+    return slot->fingerprint == (uint32_t) key ? (int) slot->id : -1;
+}
+
+/*
+ * Gets the number of bytes a hash takes up.
+ */
+size_t get_term_hash_memory_size(term_hash_t *hash) {
+    return sizeof(term_hash_t) + hash->bucket_count * sizeof(uint32_t) + hash->count * sizeof(term_slot_t);
+}
+
+/*
+ * Destroys a hash.
+ */
+void destroy_term_hash(term_hash_t *hash) {
+    free(hash->pilots);
+    free(hash->slots);
+    free(hash);
+}
@@ -0,0 +1,76 @@
+#ifndef _TERM_HASH_H_
+#define _TERM_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A slot of a term hash: the id of the term that hashes to it, and a
+ * fingerprint of the term, so most other strings are told apart from it
+ * without looking at the term itself.
+ */
+typedef struct term_slot {
+    uint32_t id;
+    uint32_t fingerprint;
+} term_slot_t;
+
+/*
+ * A minimal perfect hash over a fixed set of terms, built the way PTHash
+ * builds one: every term falls in a bucket, and every bucket has a pilot,
+ * a number chosen when the hash is built so that its terms, hashed along
+ * with the pilot, land in slots no other term landed in. There are as many
+ * slots as terms, so a term is found by reading the pilot of its bucket
+ * and then its slot. A string that isn't one of the terms lands in some
+ * term's slot too, and is almost always turned away by the fingerprint.
+ */
+typedef struct term_hash {
+    uint64_t seed;
+    uint32_t *pilots;
+    int bucket_count;
+    term_slot_t *slots;
+    int count;
+} term_hash_t;
+
+/*
+ * Builds a hash, given the terms, which must be distinct, in id order, and
+ * their number. Returns NULL if no hash could be found for them, which
+ * only happens if two terms share a 64-bit hash. The caller is responsible
+ * for freeing the hash using destroy_term_hash.
+ */
+term_hash_t *create_term_hash(char **, int);
+
+/*
+ * Creates a hash to be loaded, given the number of terms, the number of
+ * buckets and the seed it was built with. The pilots and the fingerprints
+ * are zeroed, to be filled in by the caller before link_term_hash.
+ */
+term_hash_t *create_empty_term_hash(int, int, uint64_t);
+
+/*
+ * Fills in the term ids of a loaded hash, given the hash and the terms in
+ * id order. Returns false if the hash wasn't built over these terms: if
+ * two of them land in the same slot, or one lands in a slot with another
+ * fingerprint.
+ */
+bool link_term_hash(term_hash_t *, char **, int);
+
+/*
+ * Gets the id of the only term a string can be, given the hash and the
+ * string. Returns -1 if the string is certainly not one of the terms. The
+ * caller must still compare the string with the term, since a string that
+ * isn't a term matches a fingerprint once in about four billion lookups.
+ */
+int find_term_hash(term_hash_t *, const char *);
+
+/*
+ * Gets the number of bytes a hash takes up.
+ */
+size_t get_term_hash_memory_size(term_hash_t *);
+
+/*
+ * Destroys a hash.
+ */
+void destroy_term_hash(term_hash_t *);
+
+#endif
@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "token_filter.h"
+#include "hash.h"
+
+/*
+ * The stop words, which are too common to be worth indexing.
+ */
+static const char *stop_words[] = {
+    "a", "about", "above", "after", "again", "against", "all", "am", "an", "and",
+    "any", "are", "as", "at", "be", "because", "been", "before", "being", "below",
+    "between", "both", "but", "by", "can", "could", "did", "do", "does", "doing",
+    "down", "during", "each", "few", "for", "from", "further", "had", "has", "have",
+    "having", "he", "her", "here", "hers", "herself", "him", "himself", "his", "how",
+    "i", "if", "in", "into", "is", "it", "its", "itself", "just", "me",
+    "more", "most", "my", "myself", "no", "nor", "not", "now", "of", "off",
+    "on", "once", "only", "or", "other", "our", "ours", "ourselves", "out", "over",
+    "own", "same", "she", "should", "so", "some", "such", "than", "that", "the",
+    "their", "theirs", "them", "themselves", "then", "there", "these", "they", "this", "those",
+    "through", "to", "too", "under", "until", "up", "very", "was", "we", "were",
+    "what", "when", "where", "which", "while", "who", "whom", "why", "will", "with",
+    "would", "you", "your", "yours", "yourself", "yourselves"
+};
+
+/*
+ * The number of slots of the stop word table, a power of two at least
+ * twice the number of stop words.
+ */
+#define STOP_WORD_SLOTS 512
+
+/*
+ * The stop words, hashed into a table with linear probing. It is built the
+ * first time it's needed, and only read after that.
+ */
+static const char *stop_word_table[STOP_WORD_SLOTS];
+static pthread_once_t stop_word_once = PTHREAD_ONCE_INIT;
+
+static void build_stop_word_table() {
+    size_t i;
+    for (i = 0; i < sizeof(stop_words) / sizeof(stop_words[0]); i++) {
+        size_t slot = hash_string(stop_words[i]) & (STOP_WORD_SLOTS - 1);
+        while (stop_word_table[slot] != NULL) {
+            slot = (slot + 1) & (STOP_WORD_SLOTS - 1);
+        }
+        stop_word_table[slot] = stop_words[i];
+    }
+}
+
+static bool is_stop_word(char *token) {
+    pthread_once(&stop_word_once, &build_stop_word_table);
+    size_t slot = hash_string(token) & (STOP_WORD_SLOTS - 1);
+    while (stop_word_table[slot] != NULL) {
+        if (strcmp(stop_word_table[slot], token) == 0) {
+            return true;
+        }
+        slot = (slot + 1) & (STOP_WORD_SLOTS - 1);
+    }
+    return false;
+}
+
+/*
+ * Parses a length bound of a filter specification.
+ */
+static bool parse_length(char *value, int *length) {
+    char *end;
+    long result = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || result < 1 || result > 1024) {
+        return false;
+    }
+    *length = (int) result;
+    return true;
+}
+
+/*
+ * Parses a filter specification, such as "stop,stem,min=2,max=64".
+ */
+bool parse_token_filter(token_filter_t *filter, char *spec) {
+    memset(filter, 0, sizeof(token_filter_t));
+    char *copy = strdup(spec);
+    char *save = NULL;
+    char *item = strtok_r(copy, ",", &save);
+    bool valid = true;
+    while (item != NULL && valid) {
+        if (strcmp(item, "stop") == 0) {
+            filter->stop_words = true;
+        } else if (strcmp(item, "stem") == 0) {
+            filter->stemming = true;
+        } else if (strncmp(item, "min=", 4) == 0) {
+            valid = parse_length(item + 4, &filter->min_length);
+        } else if (strncmp(item, "max=", 4) == 0) {
+            valid = parse_length(item + 4, &filter->max_length);
+        } else {
+            valid = false;
+        }
+        item = strtok_r(NULL, ",", &save);
+    }
+    free(copy);
+    if (filter->max_length > 0 && filter->min_length > filter->max_length) {
+        valid = false;
+    }
+    if (!valid) {
+        memset(filter, 0, sizeof(token_filter_t));
+    }
+    return valid;
+}
+
+/*
+ * Formats a filter as a specification, with its parts in a fixed order.
+ */
+void format_token_filter(token_filter_t *filter, char *buffer, size_t size) {
+    char spec[TOKEN_FILTER_SPEC_SIZE] = "";
+    size_t length = 0;
+    if (filter->stop_words) {
+        length += snprintf(spec + length, sizeof(spec) - length, ",stop");
+    }
+    if (filter->stemming) {
+        length += snprintf(spec + length, sizeof(spec) - length, ",stem");
+    }
+    if (filter->min_length > 0) {
+        length += snprintf(spec + length, sizeof(spec) - length, ",min=%d", filter->min_length);
+    }
+    if (filter->max_length > 0) {
+        length += snprintf(spec + length, sizeof(spec) - length, ",max=%d", filter->max_length);
+    }
+    /* every part starts with a comma, which we skip for the first one */
+    snprintf(buffer, size, "%s", length > 0 ? spec + 1 : spec);
+}
+
+/*
+ * Counts the characters of a UTF-8 token, which are all the bytes except
+ * continuation bytes.
+ */
+static int count_characters(char *token) {
+    int count = 0;
+    unsigned char *position = (unsigned char *) token;
+    while (*position != '\0') {
+        count += (*position & 0xC0) != 0x80;
+        position++;
+    }
+    return count;
+}
+
+/*
+ * The state of the stemmer: the word, the offset of its last character,
+ * and an offset into it the steps below work with.
+ */
+typedef struct stemmer {
+    char *word;
+    int end;
+    int offset;
+} stemmer_t;
+
+/*
+ * Checks whether the character at an offset is a consonant.
+ */
+static bool is_consonant(stemmer_t *stemmer, int i) {
+    switch (stemmer->word[i]) {
+        case 'a': case 'e': case 'i': case 'o': case 'u':
+            return false;
+        case 'y':
+            return i == 0 ? true : !is_consonant(stemmer, i - 1);
+        default:
+            return true;
+    }
+}
+
+/*
+ * Measures the number of vowel-consonant sequences before the offset.
+ */
+static int measure(stemmer_t *stemmer) {
+    int count = 0;
+    int i = 0;
+    while (true) {
+        if (i > stemmer->offset) return count;
+        if (!is_consonant(stemmer, i)) break;
+        i++;
+    }
+    i++;
+    while (true) {
+        while (true) {
+            if (i > stemmer->offset) return count;
+            if (is_consonant(stemmer, i)) break;
+            i++;
+        }
+        i++;
+        count++;
+        while (true) {
+            if (i > stemmer->offset) return count;
+            if (!is_consonant(stemmer, i)) break;
+            i++;
+        }
+        i++;
+    }
+}
+
+/*
+ * Checks whether there is a vowel before the offset.
+ */
+static bool has_vowel(stemmer_t *stemmer) {
+    int i;
+    for (i = 0; i <= stemmer->offset; i++) {
+        if (!is_consonant(stemmer, i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Checks whether the characters at i and i - 1 are the same consonant.
+ */
+static bool is_double_consonant(stemmer_t *stemmer, int i) {
+    return i >= 1 && stemmer->word[i] == stemmer->word[i - 1] && is_consonant(stemmer, i);
+}
+
+/*
+ * Checks whether the characters from i - 2 to i are consonant, vowel,
+ * consonant, with the last one not w, x or y, as in "hop".
+ */
+static bool is_cvc(stemmer_t *stemmer, int i) {
+    if (i < 2 || !is_consonant(stemmer, i) || is_consonant(stemmer, i - 1)
+            || !is_consonant(stemmer, i - 2)) {
+        return false;
+    }
+    char last = stemmer->word[i];
+    return last != 'w' && last != 'x' && last != 'y';
+}
+
+/*
+ * Checks whether the word ends with a suffix, and if so, sets the offset
+ * to just before it.
+ */
+static bool ends_with(stemmer_t *stemmer, const char *suffix) {
+    int length = (int) strlen(suffix);
+    if (length > stemmer->end + 1 || suffix[length - 1] != stemmer->word[stemmer->end]) {
+        return false;
+    }
+    if (memcmp(stemmer->word + stemmer->end - length + 1, suffix, length) != 0) {
+        return false;
+    }
+    stemmer->offset = stemmer->end - length;
+    return true;
+}
+
+/*
+ * Replaces the end of the word after the offset.
+ */
+static void set_suffix(stemmer_t *stemmer, const char *suffix) {
+    int length = (int) strlen(suffix);
+    memcpy(stemmer->word + stemmer->offset + 1, suffix, length);
+    stemmer->end = stemmer->offset + length;
+}
+
+/*
+ * Replaces the end of the word after the offset, if there is a
+ * vowel-consonant sequence before it.
+ */
+static void replace_suffix(stemmer_t *stemmer, const char *suffix) {
+    if (measure(stemmer) > 0) {
+        set_suffix(stemmer, suffix);
+    }
+}
+
+/*
+ * Removes plurals and -ed or -ing, as in "caresses", "ponies" or "matting".
+ */
+static void stem_plurals(stemmer_t *stemmer) {
+    char *word = stemmer->word;
+    if (word[stemmer->end] == 's') {
+        if (ends_with(stemmer, "sses")) {
+            stemmer->end -= 2;
+        } else if (ends_with(stemmer, "ies")) {
+            set_suffix(stemmer, "i");
+        } else if (word[stemmer->end - 1] != 's') {
+            stemmer->end--;
+        }
+    }
+    if (ends_with(stemmer, "eed")) {
+        if (measure(stemmer) > 0) {
+            stemmer->end--;
+        }
+    } else if ((ends_with(stemmer, "ed") || ends_with(stemmer, "ing")) && has_vowel(stemmer)) {
+        stemmer->end = stemmer->offset;
+        if (ends_with(stemmer, "at")) {
+            set_suffix(stemmer, "ate");
+        } else if (ends_with(stemmer, "bl")) {
+            set_suffix(stemmer, "ble");
+        } else if (ends_with(stemmer, "iz")) {
+            set_suffix(stemmer, "ize");
+        } else if (is_double_consonant(stemmer, stemmer->end)) {
+            char last = word[stemmer->end];
+            if (last != 'l' && last != 's' && last != 'z') {
+                stemmer->end--;
+            }
+        } else {
+            stemmer->offset = stemmer->end;
+            if (measure(stemmer) == 1 && is_cvc(stemmer, stemmer->end)) {
+                set_suffix(stemmer, "e");
+            }
+        }
+    }
+}
+
+/*
+ * Turns a final y into an i when there is another vowel, as in "happy".
+ */
+static void stem_y(stemmer_t *stemmer) {
+    if (ends_with(stemmer, "y") && has_vowel(stemmer)) {
+        stemmer->word[stemmer->end] = 'i';
+    }
+}
+
+/*
+ * A suffix and what it's replaced with.
+ */
+typedef struct suffix_rule {
+    const char *suffix;
+    const char *replacement;
+} suffix_rule_t;
+
+/*
+ * Replaces the first suffix of a list of rules the word ends with. Returns
+ * false if it ends with none of them.
+ */
+static bool apply_rules(stemmer_t *stemmer, const suffix_rule_t *rules) {
+    for (; rules->suffix != NULL; rules++) {
+        if (ends_with(stemmer, rules->suffix)) {
+            replace_suffix(stemmer, rules->replacement);
+            return true;
+        }
+    }
+    return false;
+}
+
+static const suffix_rule_t double_suffixes[] = {
+    { "ational", "ate" }, { "tional", "tion" }, { "enci", "ence" }, { "anci", "ance" },
+    { "izer", "ize" }, { "bli", "ble" }, { "alli", "al" }, { "entli", "ent" },
+    { "eli", "e" }, { "ousli", "ous" }, { "ization", "ize" }, { "ation", "ate" },
+    { "ator", "ate" }, { "alism", "al" }, { "iveness", "ive" }, { "fulness", "ful" },
+    { "ousness", "ous" }, { "aliti", "al" }, { "iviti", "ive" }, { "biliti", "ble" },
+    { "logi", "log" }, { NULL, NULL }
+};
+
+static const suffix_rule_t simple_suffixes[] = {
+    { "icate", "ic" }, { "ative", "" }, { "alize", "al" }, { "iciti", "ic" },
+    { "ical", "ic" }, { "ful", "" }, { "ness", "" }, { NULL, NULL }
+};
+
+static const char *removed_suffixes[] = {
+    "al", "ance", "ence", "er", "ic", "able", "ible", "ant", "ement", "ment",
+    "ent", "ion", "ou", "ism", "ate", "iti", "ous", "ive", "ize", NULL
+};
+
+/*
+ * Removes the suffixes left of a longer word, as in "revival" or
+ * "adjustment".
+ */
+static void stem_suffixes(stemmer_t *stemmer) {
+    const char **suffix;
+    for (suffix = removed_suffixes; *suffix != NULL; suffix++) {
+        if (ends_with(stemmer, *suffix)) {
+            /* "ion" is only a suffix after s or t, as in "adoption" */
+            if (strcmp(*suffix, "ion") == 0 && (stemmer->offset < 0
+                    || (stemmer->word[stemmer->offset] != 's' && stemmer->word[stemmer->offset] != 't'))) {
+                continue;
+            }
+            if (measure(stemmer) > 1) {
+                stemmer->end = stemmer->offset;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Removes a final e and a double l, as in "probate" or "controll".
+ */
+static void stem_final(stemmer_t *stemmer) {
+    stemmer->offset = stemmer->end;
+    if (stemmer->word[stemmer->end] == 'e') {
+        int count = measure(stemmer);
+        if (count > 1 || (count == 1 && !is_cvc(stemmer, stemmer->end - 1))) {
+            stemmer->end--;
+        }
+    }
+    if (stemmer->word[stemmer->end] == 'l' && is_double_consonant(stemmer, stemmer->end)
+            && measure(stemmer) > 1) {
+        stemmer->end--;
+    }
+}
+
+/*
+ * Stems a lower case English word in place with the Porter algorithm.
+ * Words of one or two letters are left alone.
+ */
+static void stem_word(char *word) {
+    stemmer_t stemmer;
+    stemmer.word = word;
+    stemmer.end = (int) strlen(word) - 1;
+    stemmer.offset = 0;
+    if (stemmer.end <= 1) {
+        return;
+    }
+    stem_plurals(&stemmer);
+    if (stemmer.end > 0) {
+        stem_y(&stemmer);
+        apply_rules(&stemmer, double_suffixes);
+        apply_rules(&stemmer, simple_suffixes);
+        stem_suffixes(&stemmer);
+        stem_final(&stemmer);
+    }
+    word[stemmer.end + 1] = '\0';
+}
+
+/*
+ * Checks whether a token is made of the letters a to z only, which are the
+ * only words the stemmer knows about.
+ */
+static bool is_plain_word(char *token) {
+    for (; *token != '\0'; token++) {
+        if (*token < 'a' || *token > 'z') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Runs a token through a filter.
+ */
+bool filter_token(token_filter_t *filter, char *token) {
+    if (filter->min_length > 0 || filter->max_length > 0) {
+        int length = count_characters(token);
+        if (length < filter->min_length || (filter->max_length > 0 && length > filter->max_length)) {
+            return false;
+        }
+    }
+    if (filter->stop_words && is_stop_word(token)) {
+        return false;
+    }
+    if (filter->stemming && is_plain_word(token)) {
+        stem_word(token);
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef _TOKEN_FILTER_H_
+#define _TOKEN_FILTER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * The filters applied to every token between the tokenizer and the index,
+ * and to every query term, so both sides agree on what a term looks like.
+ * In order: tokens outside the length bounds (in characters) are dropped,
+ * then stop words are dropped, then the remaining words are stemmed.
+ */
+typedef struct token_filter {
+    /* the length bounds, or 0 for none */
+    int min_length;
+    int max_length;
+    bool stop_words;
+    bool stemming;
+} token_filter_t;
+
+/*
+ * The longest filter specification format_token_filter can produce.
+ */
+#define TOKEN_FILTER_SPEC_SIZE 64
+
+/*
+ * Parses a filter specification, given the filter to fill in and a comma
+ * separated list of "stop", "stem", "min=<length>" and "max=<length>".
+ * Returns false, and leaves the filter empty, if the specification is
+ * invalid.
+ */
+bool parse_token_filter(token_filter_t *, char *);
+
+/*
+ * Formats a filter as a specification parse_token_filter understands,
+ * given the filter, a buffer and its size. An empty string means the
+ * filter doesn't change anything.
+ */
+void format_token_filter(token_filter_t *, char *, size_t);
+
+/*
+ * Runs a token through a filter, given the filter and the token, which is
+ * rewritten in place (stemming only ever shortens it). Returns false if
+ * the token is dropped.
+ */
+bool filter_token(token_filter_t *, char *);
+
+#endif
@@ -1,15 +1,190 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
-#include <tic.h>
+#include <stdio.h>
 #include "tokenizer.h"
 
 /*
- * Flag for whether a given character is valid for this tokenizer.
+ * The class of every byte of the input. ASCII letters and digits, which are
+ * all that most input is made of, map to themselves with their case folded,
+ * so they're handled without any decoding. Bytes that start a multibyte
+ * UTF-8 sequence are lead bytes, and every other byte is a separator.
  */
-static bool is_valid(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+#define CLASS_SEPARATOR 0
+#define CLASS_LEAD 1
+
+static const unsigned char byte_classes[256] = {
+    /* 0x00: control characters, space and punctuation */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0x30: digits */
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 0, 0, 0, 0, 0, 0,
+    /* 0x40: upper case letters, folded to lower case */
+    0, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0, 0, 0, 0, 0,
+    /* 0x60: lower case letters */
+    0, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0, 0, 0, 0, 0,
+    /* 0x80: continuation bytes, which are invalid on their own */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xc0: lead bytes, except for the ones that are never valid */
+    0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/*
+ * A range of code points, inclusive.
+ */
+typedef struct code_point_range {
+    uint32_t first;
+    uint32_t last;
+} code_point_range_t;
+
+/*
+ * The non-ASCII code points that are part of words: letters, digits, and
+ * the combining marks that are written on top of them, for the scripts we
+ * support. Sorted, so they can be binary searched. Scripts without spaces
+ * between words (such as Chinese) end up as one token per run of text.
+ */
+static const code_point_range_t word_ranges[] = {
+    { 0x00aa, 0x00aa }, { 0x00b5, 0x00b5 }, { 0x00ba, 0x00ba }, { 0x00c0, 0x00d6 },
+    { 0x00d8, 0x00f6 }, { 0x00f8, 0x02c1 }, { 0x02c6, 0x02d1 }, { 0x02e0, 0x02e4 },
+    { 0x02ec, 0x02ec }, { 0x02ee, 0x02ee }, { 0x0300, 0x0374 }, { 0x0376, 0x037d },
+    { 0x037f, 0x037f }, { 0x0386, 0x0386 }, { 0x0388, 0x0481 }, { 0x0483, 0x052f },
+    { 0x0531, 0x0556 }, { 0x0559, 0x0559 }, { 0x0560, 0x0588 }, { 0x0591, 0x05bd },
+    { 0x05bf, 0x05bf }, { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 }, { 0x05c7, 0x05c7 },
+    { 0x05d0, 0x05ea }, { 0x05ef, 0x05f2 }, { 0x0610, 0x061a }, { 0x0620, 0x0669 },
+    { 0x066e, 0x06d3 }, { 0x06d5, 0x06dc }, { 0x06df, 0x06e8 }, { 0x06ea, 0x06fc },
+    { 0x06ff, 0x06ff }, { 0x0900, 0x0963 }, { 0x0966, 0x096f }, { 0x0971, 0x0dff },
+    { 0x0e01, 0x0e3a }, { 0x0e40, 0x0e4e }, { 0x0e50, 0x0e59 }, { 0x0e81, 0x0edf },
+    { 0x10a0, 0x10fa }, { 0x10fc, 0x11ff }, { 0x1e00, 0x1fbc }, { 0x1fc2, 0x1fcc },
+    { 0x1fd0, 0x1fdb }, { 0x1fe0, 0x1fec }, { 0x1ff2, 0x1ffc }, { 0x2d00, 0x2d25 },
+    { 0x3041, 0x3096 }, { 0x3099, 0x309f }, { 0x30a1, 0x30fa }, { 0x30fc, 0x30ff },
+    { 0x3400, 0x4dbf }, { 0x4e00, 0x9fff }, { 0xac00, 0xd7a3 }, { 0xf900, 0xfaff },
+    { 0xff10, 0xff19 }, { 0xff21, 0xff3a }, { 0xff41, 0xff5a }, { 0xff66, 0xffdc },
+    { 0x20000, 0x2fa1f }
+};
+
+/*
+ * A simple case folding rule: every code point of the range (or every
+ * other one, starting with the first, if the step is 2) is folded by adding
+ * the delta. Sorted, so they can be binary searched.
+ */
+typedef struct case_fold {
+    uint32_t first;
+    uint32_t last;
+    int32_t delta;
+    int step;
+} case_fold_t;
+
+/*
+ * Simple case folding for Latin, Greek, Cyrillic, Armenian, Georgian and
+ * fullwidth letters.
+ */
+static const case_fold_t case_folds[] = {
+    { 0x00c0, 0x00d6, 32, 1 }, { 0x00d8, 0x00de, 32, 1 }, { 0x0100, 0x012e, 1, 2 },
+    { 0x0132, 0x0136, 1, 2 }, { 0x0139, 0x0147, 1, 2 }, { 0x014a, 0x0176, 1, 2 },
+    { 0x0178, 0x0178, -121, 1 }, { 0x0179, 0x017d, 1, 2 }, { 0x01cd, 0x01db, 1, 2 },
+    { 0x01de, 0x01ee, 1, 2 }, { 0x01f8, 0x021e, 1, 2 }, { 0x0222, 0x0232, 1, 2 },
+    { 0x0386, 0x0386, 38, 1 }, { 0x0388, 0x038a, 37, 1 }, { 0x038c, 0x038c, 64, 1 },
+    { 0x038e, 0x038f, 63, 1 }, { 0x0391, 0x03a1, 32, 1 }, { 0x03a3, 0x03ab, 32, 1 },
+    { 0x03c2, 0x03c2, 1, 1 }, { 0x0400, 0x040f, 80, 1 }, { 0x0410, 0x042f, 32, 1 },
+    { 0x0460, 0x0480, 1, 2 }, { 0x048a, 0x04be, 1, 2 }, { 0x04c0, 0x04c0, 15, 1 },
+    { 0x04c1, 0x04cd, 1, 2 }, { 0x04d0, 0x052e, 1, 2 }, { 0x0531, 0x0556, 48, 1 },
+    { 0x10a0, 0x10c5, 7264, 1 }, { 0x1e00, 0x1e94, 1, 2 }, { 0x1e9e, 0x1e9e, -7615, 1 },
+    { 0x1ea0, 0x1efe, 1, 2 }, { 0xff21, 0xff3a, 32, 1 }
+};
+
+/*
+ * Flag for whether a non-ASCII code point is part of words.
+ */
+static bool is_word_code_point(uint32_t code_point) {
+    int low = 0;
+    int high = (int) (sizeof(word_ranges) / sizeof(word_ranges[0])) - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (code_point < word_ranges[middle].first) {
+            high = middle - 1;
+        } else if (code_point > word_ranges[middle].last) {
+            low = middle + 1;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Folds the case of a non-ASCII code point.
+ */
+static uint32_t fold_code_point(uint32_t code_point) {
+    int low = 0;
+    int high = (int) (sizeof(case_folds) / sizeof(case_folds[0])) - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const case_fold_t *fold = &case_folds[middle];
+        if (code_point < fold->first) {
+            high = middle - 1;
+        } else if (code_point > fold->last) {
+            low = middle + 1;
+        } else {
+            return (code_point - fold->first) % fold->step == 0
+                    ? (uint32_t) ((int32_t) code_point + fold->delta) : code_point;
+        }
+    }
+    return code_point;
+}
+
+/*
+ * Decodes the UTF-8 sequence starting with a lead byte. Returns its length,
+ * or 0 if it isn't valid (truncated, overlong, a surrogate or too large).
+ */
+static int decode_utf8(const unsigned char *bytes, uint32_t *code_point) {
+    unsigned char lead = bytes[0];
+    int length = lead < 0xe0 ? 2 : (lead < 0xf0 ? 3 : 4);
+    uint32_t value = lead & (0x7f >> length);
+    int i;
+    for (i = 1; i < length; i++) {
+        if ((bytes[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        value = (value << 6) | (bytes[i] & 0x3f);
+    }
+    if ((length == 3 && (value < 0x800 || (value >= 0xd800 && value <= 0xdfff)))
+            || (length == 4 && (value < 0x10000 || value > 0x10ffff))) {
+        return 0;
+    }
+    *code_point = value;
+    return length;
+}
+
+/*
+ * Encodes a code point as UTF-8, returning the number of bytes written.
+ */
+static int encode_utf8(uint32_t code_point, char *bytes) {
+    if (code_point < 0x800) {
+        bytes[0] = (char) (0xc0 | (code_point >> 6));
+        bytes[1] = (char) (0x80 | (code_point & 0x3f));
+        return 2;
+    } else if (code_point < 0x10000) {
+        bytes[0] = (char) (0xe0 | (code_point >> 12));
+        bytes[1] = (char) (0x80 | ((code_point >> 6) & 0x3f));
+        bytes[2] = (char) (0x80 | (code_point & 0x3f));
+        return 3;
+    }
+    bytes[0] = (char) (0xf0 | (code_point >> 18));
+    bytes[1] = (char) (0x80 | ((code_point >> 12) & 0x3f));
+    bytes[2] = (char) (0x80 | ((code_point >> 6) & 0x3f));
+    bytes[3] = (char) (0x80 | (code_point & 0x3f));
+    return 4;
 }
 
 /*
@@ -27,23 +202,19 @@ static void destroy_function(void *string) {
 }
 
 /*
- * Allocates memory for and copies a token given a pointer to the start
- * of the token and a pointer to the end. The caller is responsible for
- * freeing the allocated memory.
+ * Inserts a copy of the given bytes into the list as a token.
  */
-static char *create_token(char *start_index, char *current_index) {
-    size_t token_size = current_index - start_index;
-    if (token_size == 0) {
-        return NULL;
-    }
-    char *token = malloc(token_size + sizeof(char));
-    memcpy(token, start_index, token_size);
-    token[token_size] = '\0';
-    return token;
+static void insert_token(list_t *list, const char *start, size_t size) {
+    char *token = malloc(size + sizeof(char));
+    memcpy(token, start, size);
+    token[size] = '\0';
+    insert_object(list, token);
 }
 
 /*
- * Tokenizes a string and returns the token in a sorted linked list.
+ * Tokenizes a string and returns the tokens in a linked list. Tokens are
+ * built in a buffer as their characters are folded, with a single table
+ * lookup per byte for ASCII text.
  */
 list_t *tokenize(char *string) {
     list_t *list = create_list(&compare_function, &destroy_function);
@@ -51,29 +222,47 @@ list_t *tokenize(char *string) {
         fprintf(stderr, "Error creating list! Not enough memory?\n");
         return NULL;
     }
-    char *start_index = string;
-    char *current_index = string;
-    char *end_index = string + strlen(string);
-    while (current_index != end_index) {
-        if (is_valid(*current_index)) {
-            /* character is valid, so we keep searching */
-            current_index += sizeof(char);
-            if (current_index == end_index) {
-                /* we've hit the end of the string, so we need to insert the last token */
-                char *token = create_token(start_index, current_index);
-                if (token != NULL) {
-                    insert_object(list, token);
-                }
+    size_t capacity = 64;
+    char *token = malloc(capacity);
+    size_t token_size = 0;
+    const unsigned char *position = (const unsigned char *) string;
+    while (true) {
+        /* the fast path: a run of ASCII letters and digits, folded as it's copied */
+        unsigned char class;
+        while ((class = byte_classes[*position]) > CLASS_LEAD) {
+            if (token_size == capacity) {
+                capacity *= 2;
+                token = realloc(token, capacity);
             }
-        } else {
-            /* we've found an invalid character, so we need to insert the token right before it */
-            char *token = create_token(start_index, current_index);
-            if (token != NULL) {
-                insert_object(list, token);
+            token[token_size++] = (char) class;
+            position++;
+        }
+        if (class == CLASS_LEAD) {
+            uint32_t code_point;
+            int sequence_length = decode_utf8(position, &code_point);
+            if (sequence_length > 0 && is_word_code_point(code_point)) {
+                code_point = fold_code_point(code_point);
+                if (token_size + 4 > capacity) {
+                    capacity *= 2;
+                    token = realloc(token, capacity);
+                }
+                token_size += encode_utf8(code_point, token + token_size);
+                position += sequence_length;
+                continue;
             }
-            current_index += sizeof(char);
-            start_index = current_index;
+            /* any other character ends the token, and invalid bytes are
+             * skipped one at a time */
+            position += sequence_length > 0 ? sequence_length - 1 : 0;
+        }
+        if (token_size > 0) {
+            insert_token(list, token, token_size);
+            token_size = 0;
         }
+        if (*position == '\0') {
+            break;
+        }
+        position++;
     }
+    free(token);
     return list;
-}
\ No newline at end of file
+}
@@ -3,6 +3,11 @@
 
 #include "sorted_list.h"
 
+/*
+ * Tokenizes a UTF-8 string into words made of letters and digits, with
+ * their case folded. Bytes that aren't valid UTF-8 separate words. The
+ * caller is responsible for freeing the returned list.
+ */
 list_t *tokenize(char *);
 
 #endif
\ No newline at end of file
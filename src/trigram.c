@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <ctype.h>
+#include "trigram.h"
+
+/*
+ * Folds the case of a byte of a trigram.
+ */
+static uint32_t fold_byte(char byte) {
+    return (uint32_t) tolower((unsigned char) byte);
+}
+
+/*
+ * Gets the trigram that starts at the given byte.
+ */
+uint32_t get_trigram(const char *bytes) {
+    return fold_byte(bytes[0]) << 16 | fold_byte(bytes[1]) << 8 | fold_byte(bytes[2]);
+}
+
+/*
+ * Writes the token of a trigram.
+ */
+void format_trigram(uint32_t trigram, char *token) {
+    snprintf(token, TRIGRAM_TOKEN_SIZE, "%06x", trigram & 0xffffff);
+}
@@ -0,0 +1,25 @@
+#ifndef _TRIGRAM_H_
+#define _TRIGRAM_H_
+
+#include <stdint.h>
+
+/*
+ * The size of the token of a trigram, with its terminator. The trigram
+ * index of an index file is an index of its own ("<path>.tri"), whose
+ * tokens are the trigrams of the documents' bytes, as six hex digits.
+ */
+#define TRIGRAM_TOKEN_SIZE 7
+
+/*
+ * Gets the trigram that starts at the given byte. ASCII letters are folded
+ * to lower case, so the index can answer case-insensitive patterns too.
+ */
+uint32_t get_trigram(const char *);
+
+/*
+ * Writes the token of a trigram, given the trigram and a buffer of
+ * TRIGRAM_TOKEN_SIZE bytes.
+ */
+void format_trigram(uint32_t, char *);
+
+#endif
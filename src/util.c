@@ -20,11 +20,11 @@ static void tokenize_destroy_function(void *object) {
 }
 
 /*
- * Tokenizes a string, given the string, the delimiter, and whether
+ * Splits a string, given the string, the delimiter, and whether
  * the tokens should be sorted. This method returns a list_t containing
  * the resulting tokens.
  */
-list_t *tokenize(char *string, char delimiter, bool sort) {
+list_t *split_string(char *string, char delimiter, bool sort) {
     list_t *list = sort ? create_list(&tokenize_sort_function, &tokenize_destroy_function) :
             create_list(&tokenize_list_function, &tokenize_destroy_function);
     char *last_position = string;
@@ -33,7 +33,7 @@ list_t *tokenize(char *string, char delimiter, bool sort) {
         size_t line_size = position - last_position;
         char *line = malloc(line_size + sizeof(char));
         memcpy(line, last_position, line_size);
-        sprintf(line + line_size, "%c", '\0');
+        line[line_size] = '\0';
         insert_object(list, line);
         last_position = position + sizeof(char);
     }
@@ -41,7 +41,7 @@ list_t *tokenize(char *string, char delimiter, bool sort) {
     if (final_line_size > 0) {
         char *line = malloc(final_line_size + sizeof(char));
         memcpy(line, last_position, final_line_size);
-        sprintf(line + final_line_size, "%c", '\0');
+        line[final_line_size] = '\0';
         insert_object(list, line);
     }
     return list;
@@ -62,13 +62,9 @@ char *read_file(char *file_path) {
             off_t file_size = file_stat.st_size;
             if (file_size > 0) {
                 char *data = malloc((size_t) file_size + sizeof(char));
-                char *current_index = data;
-                int current;
-                while ((current = fgetc(file)) != EOF) {
-                    sprintf(current_index, "%c", current);
-                    current_index += sizeof(char);
-                }
-                sprintf(data + file_size, "%c", '\0');
+                /* a file that shrank since the stat just ends early */
+                size_t size = fread(data, sizeof(char), (size_t) file_size, file);
+                data[size] = '\0';
                 /* once we've read the file's contents, we can close it */
                 fclose(file);
                 return data;
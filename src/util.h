@@ -2,11 +2,11 @@
 #define _UTIL_H_
 
 /*
- * Tokenizes a string, given the string, the delimiter, and whether
+ * Splits a string, given the string, the delimiter, and whether
  * the tokens should be sorted. This method returns a list_t containing
  * the resulting tokens.
  */
-list_t *tokenize(char *, char, bool);
+list_t *split_string(char *, char, bool);
 
 /*
 * Reads the contents of a file, given the path, and returns it as a string. If this
@@ -0,0 +1,485 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "watch.h"
+#include "file_reader.h"
+#include "file_walker.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define USE_INOTIFY
+#endif
+
+/*
+ * How long the tree has to stay quiet, in milliseconds, before the changed
+ * files are applied, so a file that is still being written, or a batch of
+ * files being copied in, is only read once.
+ */
+#ifndef WATCH_DELAY
+#define WATCH_DELAY 250
+#endif
+
+/*
+ * The longest a change waits to be applied, in milliseconds, however busy
+ * the tree is.
+ */
+#ifndef WATCH_MAX_DELAY
+#define WATCH_MAX_DELAY 2000
+#endif
+
+/*
+ * The events of a directory that are watched. Modifications aren't applied
+ * until the file is closed, but they do put off the batch.
+ */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_MODIFY)
+
+struct watch {
+    char *path;
+    int inotify;
+    /* the path of the directory of every watch descriptor, or NULL */
+    char **directories;
+    int directory_capacity;
+    /* the paths of the files that changed since the last batch. A directory
+     * that went away is listed with a trailing '/', and stands for every
+     * document under it */
+    char **pending;
+    int pending_count;
+    int pending_capacity;
+    /* set when the kernel dropped events, so the whole tree has to be
+     * compared with the indexer again */
+    bool rescan;
+};
+
+/*
+ * The pipe the signal handler writes to when the process is interrupted.
+ */
+static int stop_pipe[2] = {-1, -1};
+
+/*
+ * Gets the time of a monotonic clock, in milliseconds.
+ */
+static long long get_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (long long) time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+/*
+ * Joins the path of a directory and the name of one of its entries, the way
+ * walk_directory does, so the paths match the ones that were indexed. The
+ * caller is responsible for freeing the allocated memory.
+ */
+static char *join_path(const char *directory, const char *name) {
+    size_t size = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/%s", directory, name);
+    return path;
+}
+
+/*
+ * Adds a path to the changed files of a watch. The path is copied.
+ */
+static void add_pending(watch_t *watch, const char *path) {
+    if (watch->pending_count == watch->pending_capacity) {
+        watch->pending_capacity = watch->pending_capacity == 0 ? 64 : watch->pending_capacity * 2;
+        watch->pending = realloc(watch->pending, watch->pending_capacity * sizeof(char *));
+    }
+    watch->pending[watch->pending_count++] = strdup(path);
+}
+
+#ifdef USE_INOTIFY
+/*
+ * Watches a directory and every directory under it. Symbolic links are not
+ * followed, like in walk_directory. If the directory is new to the tree,
+ * its files are added to the changed files too, since they may have been
+ * written before it was watched.
+ */
+static void add_watches(watch_t *watch, const char *path, bool new_directory) {
+    int descriptor = inotify_add_watch(watch->inotify, path, WATCH_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (descriptor == -1) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Warning: Out of inotify watches, '%s' won't be watched.\n", path);
+        }
+        return;
+    }
+    if (descriptor >= watch->directory_capacity) {
+        int capacity = watch->directory_capacity == 0 ? 64 : watch->directory_capacity;
+        while (descriptor >= capacity) {
+            capacity *= 2;
+        }
+        watch->directories = realloc(watch->directories, capacity * sizeof(char *));
+        memset(watch->directories + watch->directory_capacity, 0,
+                (capacity - watch->directory_capacity) * sizeof(char *));
+        watch->directory_capacity = capacity;
+    }
+    free(watch->directories[descriptor]);
+    watch->directories[descriptor] = strdup(path);
+    DIR *stream = opendir(path);
+    if (stream == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat file_stat;
+            if (fstatat(dirfd(stream), entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            type = S_ISDIR(file_stat.st_mode) ? DT_DIR : (S_ISREG(file_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+        if (type == DT_DIR || (type == DT_REG && new_directory)) {
+            char *child = join_path(path, entry->d_name);
+            if (type == DT_DIR) {
+                add_watches(watch, child, new_directory);
+            } else {
+                add_pending(watch, child);
+            }
+            free(child);
+        }
+    }
+    closedir(stream);
+}
+
+/*
+ * Stops watching a directory that left the tree, and every directory under
+ * it, and adds it to the changed files so its documents are removed.
+ */
+static void remove_watches(watch_t *watch, const char *path) {
+    size_t length = strlen(path);
+    int descriptor;
+    for (descriptor = 0; descriptor < watch->directory_capacity; descriptor++) {
+        char *directory = watch->directories[descriptor];
+        if (directory != NULL && strncmp(directory, path, length) == 0
+                && (directory[length] == '\0' || directory[length] == '/')) {
+            inotify_rm_watch(watch->inotify, descriptor);
+            free(directory);
+            watch->directories[descriptor] = NULL;
+        }
+    }
+    char *prefix = malloc(length + 2);
+    memcpy(prefix, path, length);
+    memcpy(prefix + length, "/", 2);
+    add_pending(watch, prefix);
+    free(prefix);
+}
+
+/*
+ * Reads the pending events of the inotify instance, adding the files they
+ * are about to the changed files. Returns true if any of them concerned the
+ * tree.
+ */
+static bool read_events(watch_t *watch) {
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool active = false;
+    ssize_t size;
+    while ((size = read(watch->inotify, buffer, sizeof(buffer))) > 0) {
+        ssize_t position = 0;
+        while (position < size) {
+            struct inotify_event *event = (struct inotify_event *) (buffer + position);
+            position += sizeof(struct inotify_event) + event->len;
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                watch->rescan = true;
+                active = true;
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= watch->directory_capacity
+                    || watch->directories[event->wd] == NULL) {
+                continue;
+            }
+            if ((event->mask & IN_IGNORED) != 0) {
+                /* the directory is gone, and the kernel dropped its watch */
+                free(watch->directories[event->wd]);
+                watch->directories[event->wd] = NULL;
+                continue;
+            } else if (event->len == 0) {
+                continue;
+            }
+            active = true;
+            char *path = join_path(watch->directories[event->wd], event->name);
+            if ((event->mask & IN_ISDIR) != 0) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                    add_watches(watch, path, true);
+                } else if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+                    remove_watches(watch, path);
+                }
+            } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)) != 0) {
+                add_pending(watch, path);
+            }
+            free(path);
+        }
+    }
+    return active;
+}
+#endif
+
+/*
+ * Starts watching a directory tree.
+ */
+watch_t *create_watch(char *path) {
+#ifdef USE_INOTIFY
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0 || !S_ISDIR(file_stat.st_mode)) {
+        fprintf(stderr, "Error: '%s' is not a directory that can be watched.\n", path);
+        return NULL;
+    }
+    watch_t *watch = calloc(1, sizeof(watch_t));
+    watch->path = strdup(path);
+    watch->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->inotify == -1) {
+        fprintf(stderr, "Error: Could not create an inotify instance.\n");
+        destroy_watch(watch);
+        return NULL;
+    }
+    add_watches(watch, path, false);
+    return watch;
+#else
+    fprintf(stderr, "Error: Directories can only be watched on Linux.\n");
+    return NULL;
+#endif
+}
+
+/*
+ * Stops watching a directory tree.
+ */
+void destroy_watch(watch_t *watch) {
+    if (watch->inotify != -1) {
+        close(watch->inotify);
+    }
+    int i;
+    for (i = 0; i < watch->directory_capacity; i++) {
+        free(watch->directories[i]);
+    }
+    for (i = 0; i < watch->pending_count; i++) {
+        free(watch->pending[i]);
+    }
+    free(watch->directories);
+    free(watch->pending);
+    free(watch->path);
+    free(watch);
+}
+
+/*
+ * Comparison function for qsort over an array of strings.
+ */
+static int string_compare_function(const void *first, const void *second) {
+    return strcmp(*(char * const *) first, *(char * const *) second);
+}
+
+/*
+ * Adds the path of every document of an indexer under a directory, given
+ * as a path with a trailing '/', to the changed files. The document table
+ * is sorted, so they are next to each other.
+ */
+static void add_pending_documents(watch_t *watch, indexer_t *indexer, const char *prefix) {
+    size_t length = strlen(prefix);
+    int low = 0;
+    int high = indexer->documents->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (strcmp(get_pooled_string(indexer->documents, middle), prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    while (low < indexer->documents->count
+            && strncmp(get_pooled_string(indexer->documents, low), prefix, length) == 0) {
+        add_pending(watch, get_pooled_string(indexer->documents, low++));
+    }
+}
+
+/*
+ * Callback for the file reader, which indexes a changed file again.
+ */
+static void handle_changed_file(char *file_path, char *file_data, size_t size, void *argument) {
+    index_document((indexer_t *) argument, file_path, file_data);
+}
+
+/*
+ * Applies the changed files to an indexer: their old records are removed,
+ * and the ones that are still regular files are read and indexed again.
+ * Returns the number of files that changed.
+ */
+static int apply_changes(watch_t *watch, indexer_t *indexer) {
+    int i;
+    if (watch->rescan) {
+        /* events were lost, so every document and every file is checked, and
+         * the directories that were missed are watched */
+#ifdef USE_INOTIFY
+        add_watches(watch, watch->path, false);
+#endif
+        for (i = 0; i < indexer->documents->count; i++) {
+            add_pending(watch, get_pooled_string(indexer->documents, i));
+        }
+        file_list_t files;
+        memset(&files, 0, sizeof(file_list_t));
+        if (walk_directory(watch->path, &files)) {
+            for (i = 0; i < files.count; i++) {
+                add_pending(watch, files.paths[i]);
+            }
+        }
+        clear_file_list(&files);
+        watch->rescan = false;
+    }
+    /* the directories that went away are expanded into their documents */
+    int count = watch->pending_count;
+    for (i = 0; i < count; i++) {
+        size_t length = strlen(watch->pending[i]);
+        if (length > 0 && watch->pending[i][length - 1] == '/') {
+            add_pending_documents(watch, indexer, watch->pending[i]);
+        }
+    }
+    qsort(watch->pending, watch->pending_count, sizeof(char *), &string_compare_function);
+    char **paths = malloc((watch->pending_count > 0 ? watch->pending_count : 1) * sizeof(char *));
+    int path_count = 0;
+    for (i = 0; i < watch->pending_count; i++) {
+        size_t length = strlen(watch->pending[i]);
+        if ((length > 0 && watch->pending[i][length - 1] == '/')
+                || (path_count > 0 && strcmp(paths[path_count - 1], watch->pending[i]) == 0)) {
+            continue;
+        }
+        paths[path_count++] = watch->pending[i];
+    }
+    remove_documents(indexer, paths, path_count);
+    char **files = malloc((path_count > 0 ? path_count : 1) * sizeof(char *));
+    int file_count = 0;
+    for (i = 0; i < path_count; i++) {
+        drop_document(indexer, paths[i]);
+        struct stat file_stat;
+        if (lstat(paths[i], &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            files[file_count++] = paths[i];
+        }
+    }
+    read_files(files, file_count, &handle_changed_file, indexer);
+    free(files);
+    free(paths);
+    for (i = 0; i < watch->pending_count; i++) {
+        free(watch->pending[i]);
+    }
+    watch->pending_count = 0;
+    return path_count;
+}
+
+/*
+ * Handles SIGINT and SIGTERM by asking the watch loop to stop.
+ */
+static void handle_stop_signal(int signal_number) {
+    char request = 'q';
+    (void) signal_number;
+    if (write(stop_pipe[1], &request, 1) != 1) {
+        /* the loop will be stopped by the next signal */
+    }
+}
+
+/*
+ * Flushes a sorted copy of a watched indexer.
+ */
+static bool flush_copy(indexer_t *indexer, watch_flush_function_t *flush, void *argument) {
+    indexer_t *copy = copy_live_indexer(indexer);
+    sort_entries(copy);
+    bool success = flush(copy, argument);
+    destroy_indexer(copy);
+    return success;
+}
+
+/*
+ * Applies changes to an indexer until the process is interrupted. A batch
+ * is applied once the tree has been quiet for WATCH_DELAY, or once its
+ * first change has waited WATCH_MAX_DELAY, and the indexer is flushed once
+ * the flush interval has passed since the last flush.
+ */
+bool run_watch(watch_t *watch, indexer_t *indexer, watch_flush_function_t *flush, void *argument,
+        int flush_interval) {
+    if (pipe2(stop_pipe, O_CLOEXEC) == -1) {
+        fprintf(stderr, "Error: Could not create a pipe.\n");
+        return false;
+    }
+    start_live_indexer(indexer);
+    struct sigaction action, old_interrupt, old_terminate;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = &handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_interrupt);
+    sigaction(SIGTERM, &action, &old_terminate);
+    struct pollfd descriptors[2];
+    descriptors[0].fd = stop_pipe[0];
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = watch->inotify;
+    descriptors[1].events = POLLIN;
+    bool changed = false;
+    bool success = true;
+    long long flushed = get_milliseconds();
+    long long first_event = 0;
+    long long last_event = 0;
+    while (true) {
+        bool pending = watch->pending_count > 0 || watch->rescan;
+        long long now = get_milliseconds();
+        long long deadline = -1;
+        if (pending) {
+            deadline = last_event + WATCH_DELAY < first_event + WATCH_MAX_DELAY
+                    ? last_event + WATCH_DELAY : first_event + WATCH_MAX_DELAY;
+        }
+        if (changed && (deadline == -1 || flushed + flush_interval < deadline)) {
+            deadline = flushed + flush_interval;
+        }
+        int timeout = deadline == -1 ? -1 : (deadline > now ? (int) (deadline - now) : 0);
+        int ready = poll(descriptors, 2, timeout);
+        if (ready == -1 && errno != EINTR) {
+            break;
+        }
+        now = get_milliseconds();
+        if (ready > 0 && (descriptors[0].revents & POLLIN) != 0) {
+            break;
+        }
+#ifdef USE_INOTIFY
+        if (ready > 0 && (descriptors[1].revents & POLLIN) != 0 && read_events(watch)) {
+            if (!pending) {
+                first_event = now;
+            }
+            last_event = now;
+        }
+#endif
+        pending = watch->pending_count > 0 || watch->rescan;
+        if (pending && (now >= last_event + WATCH_DELAY || now >= first_event + WATCH_MAX_DELAY)) {
+            int count = apply_changes(watch, indexer);
+            if (count > 0) {
+                fprintf(stderr, "Updated %d changed file%s.\n", count, count == 1 ? "" : "s");
+                changed = true;
+            }
+        }
+        if (changed && now >= flushed + flush_interval) {
+            success = flush_copy(indexer, flush, argument);
+            changed = !success;
+            flushed = now;
+        }
+    }
+    /* whatever is still pending is applied before the last flush */
+#ifdef USE_INOTIFY
+    read_events(watch);
+#endif
+    if (watch->pending_count > 0 || watch->rescan) {
+        changed = apply_changes(watch, indexer) > 0 || changed;
+    }
+    if (changed) {
+        success = flush_copy(indexer, flush, argument);
+    }
+    sigaction(SIGINT, &old_interrupt, NULL);
+    sigaction(SIGTERM, &old_terminate, NULL);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+    return success;
+}
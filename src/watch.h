@@ -0,0 +1,52 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include <stdbool.h>
+#include "indexer.h"
+
+/*
+ * A watch over a directory tree, which keeps an indexer of the tree up to
+ * date as its files change. Every directory of the tree is watched with
+ * inotify, and the files that are written, moved or deleted are collected
+ * until the tree has been quiet for a moment. They are then applied as one
+ * batch: their records are removed, each document touching only its own
+ * records (see start_live_indexer), and the files that still exist are read
+ * and indexed again. The tree is never
+ * walked again (unless the kernel drops events), so the work done follows
+ * the rate of change rather than the size of the tree. The indexer is
+ * flushed to disk periodically, but only if it changed.
+ */
+typedef struct watch watch_t;
+
+/*
+ * Writes a watched indexer to disk, given a sorted copy of the indexer (see
+ * copy_live_indexer) and the argument passed to run_watch. Returns false if it could not be written.
+ * Implemented by the caller.
+ */
+typedef bool watch_flush_function_t(indexer_t *, void *);
+
+/*
+ * Starts watching a directory tree, given the path of the directory. This
+ * is meant to be done before the tree is indexed, so the changes made while
+ * it is being indexed are applied afterwards rather than missed. Returns
+ * NULL and prints an error if the tree can't be watched. The caller is
+ * responsible for freeing the watch using destroy_watch.
+ */
+watch_t *create_watch(char *);
+
+/*
+ * Applies the changes to the watched tree to an indexer of it until the
+ * process is interrupted (SIGINT or SIGTERM), given the watch, the indexer,
+ * whose document table must have been built and which must have no
+ * bitmaps, and which is made live, the flush function, its argument, and the number of milliseconds
+ * between flushes. The indexer is flushed one last time before returning if
+ * it changed. Returns false if the last flush failed.
+ */
+bool run_watch(watch_t *, indexer_t *, watch_flush_function_t *, void *, int);
+
+/*
+ * Stops watching a directory tree and frees the watch.
+ */
+void destroy_watch(watch_t *);
+
+#endif